@@ -0,0 +1,725 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "timing.h"
+
+#include <arrow/io/interfaces.h>
+#include <arrow/result.h>
+#include <arrow/status.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The io_uring backend needs the kernel headers of Linux 5.6 or later,
+// which added IORING_OP_WRITE together with the opcode probe. Older headers
+// only get the thread pool backend.
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_SINGLE_MMAP) && defined(IO_URING_OP_SUPPORTED) && \
+    defined(__NR_io_uring_setup)
+#define XRAGE_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace xrage {
+
+// Result of a queued write: the id of its buffer and the number of bytes
+// written, or -errno
+struct WriteCompletion {
+  int id;
+  int64_t result;
+};
+
+// A queue of positional writes to a file that run in the background
+class WriteQueue {
+ public:
+  virtual ~WriteQueue() {}
+  // Start writing n bytes of data at offset. Returns 0 or -errno.
+  virtual int Submit(int id, const uint8_t* data, size_t n, int64_t offset) = 0;
+  // Block until a submitted write completes and store its result in c.
+  // Returns 0, or -errno if completions can't be waited for anymore.
+  virtual int Wait(WriteCompletion* c) = 0;
+  virtual const char* name() const = 0;
+};
+
+#ifdef XRAGE_HAVE_IO_URING
+// Write queue on an io_uring, driven through the raw system calls so that
+// no liburing is needed
+class UringWriteQueue : public WriteQueue {
+ public:
+  // Returns nullptr if the kernel doesn't support io_uring writes
+  static std::unique_ptr<UringWriteQueue> Create(int fd, unsigned entries) {
+    std::unique_ptr<UringWriteQueue> q(new UringWriteQueue(fd));
+    if (!q->Init(entries)) {
+      return nullptr;
+    }
+    return q;
+  }
+
+  ~UringWriteQueue() override {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ != -1) {
+      close(ring_fd_);
+    }
+  }
+
+  int Submit(int id, const uint8_t* data, size_t n, int64_t offset) override {
+    const unsigned tail = *sq_tail_;
+    const unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd_;
+    sqe->off = uint64_t(offset);
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = unsigned(n);
+    sqe->user_data = uint64_t(id);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (Enter(1, 0, 0) < 0) {
+      if (errno != EINTR && errno != EAGAIN) {
+        const int err = errno;
+        // Take the entry back unless the kernel consumed it anyway, so that
+        // a write reported as failed never runs
+        if (__atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) != tail) {
+          return 0;
+        }
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        return -err;
+      }
+    }
+    return 0;
+  }
+
+  int Wait(WriteCompletion* c) override {
+    for (;;) {
+      const unsigned head = *cq_head_;
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        const struct io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+        c->id = int(cqe.user_data);
+        c->result = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return 0;
+      }
+      if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+        return -errno;
+      }
+    }
+  }
+
+  const char* name() const override { return "io_uring"; }
+
+ private:
+  explicit UringWriteQueue(int fd)
+      : fd_(fd),
+        ring_fd_(-1),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)) {}
+
+  int Enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return int(syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                       flags, nullptr, 0));
+  }
+
+  bool Init(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring_fd_ = int(syscall(__NR_io_uring_setup, entries, &p));
+    if (ring_fd_ < 0) {
+      return false;
+    }
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return false;
+    }
+    cq_ring_ = single ? sq_ring_
+                      : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring_fd_,
+                             IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return false;
+    }
+    sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(
+        mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      return false;
+    }
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+    return SupportsWrite();
+  }
+
+  // IORING_OP_WRITE needs Linux 5.6, which is also when probing was added
+  bool SupportsWrite() {
+    const size_t size =
+        sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    std::vector<uint64_t> buf((size + 7) / 8, 0);
+    struct io_uring_probe* probe =
+        reinterpret_cast<struct io_uring_probe*>(buf.data());
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe,
+                256) < 0) {
+      return false;
+    }
+    return probe->last_op >= IORING_OP_WRITE &&
+           (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) != 0;
+  }
+
+  const int fd_;
+  int ring_fd_;
+  void* sq_ring_;
+  void* cq_ring_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  struct io_uring_cqe* cqes_;
+};
+#endif  // XRAGE_HAVE_IO_URING
+
+// Write queue served by a few threads issuing pwrite calls, for kernels
+// without io_uring
+class ThreadWriteQueue : public WriteQueue {
+ public:
+  ThreadWriteQueue(int fd, int threads) : fd_(fd), stop_(false) {
+    for (int i = 0; i < threads; i++) {
+      threads_.emplace_back(&ThreadWriteQueue::Run, this);
+    }
+  }
+
+  ~ThreadWriteQueue() override {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (std::thread& t : threads_) {
+      t.join();
+    }
+  }
+
+  int Submit(int id, const uint8_t* data, size_t n, int64_t offset) override {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      jobs_.push_back(Job{id, data, n, offset});
+    }
+    work_cv_.notify_one();
+    return 0;
+  }
+
+  int Wait(WriteCompletion* c) override {
+    std::unique_lock<std::mutex> lock(mu_);
+    done_cv_.wait(lock, [this] { return !done_.empty(); });
+    *c = done_.front();
+    done_.pop_front();
+    return 0;
+  }
+
+  const char* name() const override { return "threads"; }
+
+ private:
+  struct Job {
+    int id;
+    const uint8_t* data;
+    size_t n;
+    int64_t offset;
+  };
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+      work_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+      if (jobs_.empty()) {
+        return;
+      }
+      const Job job = jobs_.front();
+      jobs_.pop_front();
+      lock.unlock();
+      int64_t result = 0;
+      while (size_t(result) < job.n) {
+        const ssize_t r = pwrite(fd_, job.data + result, job.n - result,
+                                 job.offset + result);
+        if (r < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          result = -errno;
+          break;
+        }
+        result += r;
+      }
+      lock.lock();
+      done_.push_back(WriteCompletion{job.id, result});
+      done_cv_.notify_one();
+    }
+  }
+
+  const int fd_;
+  std::mutex mu_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::deque<Job> jobs_;
+  std::deque<WriteCompletion> done_;
+  bool stop_;
+  std::vector<std::thread> threads_;
+};
+
+// Settings of an AsyncOutputStream
+struct OutputStreamOptions {
+  OutputStreamOptions()
+      : direct(false), depth(4), buffer_size(size_t(4) << 20) {}
+  // Open the file with O_DIRECT so that output bypasses the page cache and
+  // doesn't evict input that is about to be read. Falls back to buffered
+  // writes on file systems without O_DIRECT support.
+  bool direct;
+  int depth;           // Most writes in flight at once
+  size_t buffer_size;  // Bytes per write, rounded up to kAlignment
+};
+
+// Counters of an AsyncOutputStream
+struct WriteStats {
+  WriteStats()
+      : bytes(0), writes(0), depth_sum(0), max_depth(0), stall_seconds(0) {}
+  int64_t bytes;
+  int64_t writes;
+  int64_t depth_sum;     // Sum of the queue depth seen by each write
+  int max_depth;         // Most writes in flight at once
+  double stall_seconds;  // Time the writing thread waited on the queue
+};
+
+// An arrow OutputStream that copies its input into a pool of large
+// page-aligned buffers and writes full buffers in the background, keeping
+// up to depth writes in flight. The caller only blocks when every buffer is
+// queued. Writes go through io_uring when the kernel supports it and
+// through a small pool of threads otherwise.
+//
+// With O_DIRECT every write covers whole aligned blocks. The last partial
+// block is kept buffered until Close, which writes it zero-padded and then
+// truncates the file to its real size.
+class AsyncOutputStream : public arrow::io::OutputStream {
+ public:
+  static constexpr size_t kAlignment = 4096;
+
+  static arrow::Result<std::shared_ptr<AsyncOutputStream>> Open(
+      const std::string& path,
+      const OutputStreamOptions& options = OutputStreamOptions()) {
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    bool direct = options.direct;
+    int fd = open(path.c_str(), flags | (direct ? O_DIRECT : 0), 0644);
+    if (fd == -1 && direct && errno == EINVAL) {
+      direct = false;
+      fd = open(path.c_str(), flags, 0644);
+    }
+    if (fd == -1) {
+      return arrow::Status::IOError("Fail to open file ", path, ": ",
+                                    strerror(errno));
+    }
+    std::shared_ptr<AsyncOutputStream> stream(
+        new AsyncOutputStream(fd, path, direct, options));
+    if (!stream->current_buffer()) {
+      return arrow::Status::OutOfMemory("Fail to allocate write buffers");
+    }
+    return stream;
+  }
+
+  ~AsyncOutputStream() override {
+    if (!closed()) {
+      const arrow::Status st = Close();
+      if (!st.ok()) {
+        st.Warn();
+      }
+    }
+    for (Buffer& b : buffers_) {
+      free(b.data);
+    }
+  }
+
+  arrow::Status Close() override {
+    if (closed()) {
+      return arrow::Status::OK();
+    }
+    arrow::Status st = error_;
+    if (queue_) {
+      Buffer& b = buffers_[current_];
+      const size_t tail = b.size;
+      if (direct_ && tail % kAlignment != 0) {
+        b.size = AlignUp(tail);
+        memset(b.data + tail, 0, b.size - tail);
+      }
+      st = WriteOut(true);
+      if (direct_ && st.ok() && ftruncate(fd_, position_) != 0) {
+        st = arrow::Status::IOError("Fail to truncate file ", path_, ": ",
+                                    strerror(errno));
+      }
+      elapsed_ = NowSeconds() - start_;
+    }
+    queue_.reset();
+    if (close(fd_) != 0 && st.ok()) {
+      st = arrow::Status::IOError("Fail to close file ", path_, ": ",
+                                  strerror(errno));
+    }
+    fd_ = -1;
+    return st;
+  }
+
+  bool closed() const override { return fd_ == -1; }
+
+  arrow::Result<int64_t> Tell() const override { return position_; }
+
+  arrow::Status Write(const void* data, int64_t nbytes) override {
+    if (closed()) {
+      return arrow::Status::Invalid("Write to closed file ", path_);
+    }
+    ARROW_RETURN_NOT_OK(error_);
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (nbytes > 0) {
+      Buffer& b = buffers_[current_];
+      const size_t n = std::min(size_t(nbytes), buffer_size_ - b.size);
+      memcpy(b.data + b.size, p, n);
+      b.size += n;
+      p += n;
+      nbytes -= int64_t(n);
+      position_ += int64_t(n);
+      if (b.size == buffer_size_) {
+        ARROW_RETURN_NOT_OK(SubmitCurrent());
+        ARROW_RETURN_NOT_OK(NextBuffer());
+      }
+    }
+    return error_;
+  }
+
+  // Write out buffered data and wait for all queued writes. Direct writes
+  // must cover whole blocks, so their buffered tail is left for Close.
+  arrow::Status Flush() override {
+    if (closed()) {
+      return arrow::Status::OK();
+    }
+    return WriteOut(!direct_);
+  }
+
+  const WriteStats& stats() const { return stats_; }
+  const char* backend() const { return backend_; }
+  bool direct() const { return direct_; }
+
+  // One line of write instrumentation for the converters' output. The rate
+  // is over the lifetime of the stream, so it includes encoding time.
+  std::string Summary() const {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "Wrote %lld bytes in %lld writes via %s%s at %.1f MB/s (queue "
+             "depth max %d, mean %.2f; stalled %.3f s)",
+             static_cast<long long>(stats_.bytes),
+             static_cast<long long>(stats_.writes), backend_,
+             direct_ ? " with O_DIRECT" : "",
+             elapsed_ > 0 ? stats_.bytes / elapsed_ * 1e-6 : 0.0,
+             stats_.max_depth,
+             stats_.writes ? double(stats_.depth_sum) / stats_.writes : 0.0,
+             stats_.stall_seconds);
+    return buf;
+  }
+
+ private:
+  struct Buffer {
+    uint8_t* data;
+    size_t size;     // Bytes of data
+    size_t written;  // Bytes already written to the file
+    int64_t offset;  // File offset of data
+  };
+
+  AsyncOutputStream(int fd, const std::string& path, bool direct,
+                    const OutputStreamOptions& options)
+      : fd_(fd),
+        path_(path),
+        direct_(direct),
+        buffer_size_(AlignUp(std::max<size_t>(options.buffer_size, 1))),
+        backend_(nullptr),
+        current_(-1),
+        inflight_(0),
+        position_(0),
+        offset_(0),
+        start_(NowSeconds()),
+        elapsed_(0) {
+    const int depth = std::max(options.depth, 1);
+    buffers_.resize(depth);
+    for (int i = 0; i < depth; i++) {
+      Buffer& b = buffers_[i];
+      b.data = nullptr;
+      b.size = b.written = 0;
+      b.offset = 0;
+      void* p;
+      if (posix_memalign(&p, kAlignment, buffer_size_) != 0) {
+        return;
+      }
+      b.data = static_cast<uint8_t*>(p);
+      free_.push_back(i);
+    }
+#ifdef XRAGE_HAVE_IO_URING
+    queue_ = UringWriteQueue::Create(fd, unsigned(depth));
+#endif
+    if (!queue_) {
+      queue_.reset(new ThreadWriteQueue(fd, std::min(depth, 2)));
+    }
+    backend_ = queue_->name();
+    current_ = free_.back();
+    free_.pop_back();
+  }
+
+  // Write out the current buffer if partial is set or it is full, and wait
+  // for all queued writes
+  arrow::Status WriteOut(bool partial) {
+    if (!queue_) {
+      return error_;
+    }
+    arrow::Status st;
+    const size_t size = buffers_[current_].size;
+    if (size == buffer_size_ || (partial && size > 0)) {
+      st = SubmitCurrent();
+    }
+    const double start = NowSeconds();
+    while (inflight_ > 0 && queue_) {
+      WaitOne();
+    }
+    stats_.stall_seconds += NowSeconds() - start;
+    if (current_ == -1 && queue_) {
+      st &= NextBuffer();
+    }
+    return st & error_;
+  }
+
+  static size_t AlignUp(size_t n) {
+    return (n + kAlignment - 1) / kAlignment * kAlignment;
+  }
+
+  uint8_t* current_buffer() const {
+    return current_ >= 0 && free_.size() + 1 == buffers_.size()
+               ? buffers_[current_].data
+               : nullptr;
+  }
+
+  // Queue the current buffer for writing at the end of the file. On success
+  // no buffer is current anymore. On errors the data is dropped and the
+  // buffer stays current.
+  arrow::Status SubmitCurrent() {
+    Buffer& b = buffers_[current_];
+    b.offset = offset_;
+    b.written = 0;
+    offset_ += int64_t(b.size);
+    const int r = queue_->Submit(current_, b.data, b.size, b.offset);
+    if (r < 0) {
+      b.size = 0;
+      SetError(-r);
+      return error_;
+    }
+    current_ = -1;
+    inflight_++;
+    stats_.writes++;
+    stats_.depth_sum += inflight_;
+    stats_.max_depth = std::max(stats_.max_depth, inflight_);
+    return arrow::Status::OK();
+  }
+
+  // Make a free buffer current, waiting for a queued write if needed
+  arrow::Status NextBuffer() {
+    if (free_.empty()) {
+      const double start = NowSeconds();
+      while (free_.empty() && queue_) {
+        WaitOne();
+      }
+      stats_.stall_seconds += NowSeconds() - start;
+      if (free_.empty()) {
+        return error_;
+      }
+    }
+    current_ = free_.back();
+    free_.pop_back();
+    return error_;
+  }
+
+  // Reap one completed write, resubmitting the rest of a short write. If
+  // the queue fails, the error sticks and the queue is shut down, which
+  // waits for or cancels the writes still in flight.
+  void WaitOne() {
+    WriteCompletion c;
+    const int err = queue_->Wait(&c);
+    if (err < 0) {
+      SetError(-err);
+      queue_.reset();
+      inflight_ = 0;
+      return;
+    }
+    Buffer& b = buffers_[c.id];
+    if (c.result > 0) {
+      const size_t before = b.written;
+      b.written += size_t(c.result);
+      if (direct_) {
+        // Direct writes must start on a block boundary, so the partial
+        // block of a short write is written again
+        b.written -= b.written % kAlignment;
+      }
+      stats_.bytes += int64_t(b.written - before);
+      if (b.written == before) {
+        // Not even one block of a direct write went through
+        SetError(EIO);
+      } else if (b.written < b.size) {
+        const int r = queue_->Submit(c.id, b.data + b.written,
+                                     b.size - b.written,
+                                     b.offset + int64_t(b.written));
+        if (r == 0) {
+          return;
+        }
+        SetError(-r);
+      }
+    } else {
+      SetError(c.result < 0 ? int(-c.result) : EIO);
+    }
+    b.size = 0;
+    inflight_--;
+    free_.push_back(c.id);
+  }
+
+  void SetError(int err) {
+    if (error_.ok()) {
+      error_ = arrow::Status::IOError("Fail to write file ", path_, ": ",
+                                      strerror(err));
+    }
+  }
+
+  int fd_;
+  const std::string path_;
+  const bool direct_;
+  const size_t buffer_size_;
+  std::unique_ptr<WriteQueue> queue_;
+  const char* backend_;
+  std::vector<Buffer> buffers_;
+  std::vector<int> free_;
+  int current_;  // Buffer being filled, -1 if none
+  int inflight_;
+  int64_t position_;  // Bytes written by the caller
+  int64_t offset_;    // Bytes queued for writing
+  const double start_;
+  double elapsed_;  // Seconds from open to close
+  arrow::Status error_;
+  WriteStats stats_;
+};
+
+// Fraction of the pages of a file that are in the page cache, or -1 if it
+// can't be determined. The converters report this for their input to show
+// how much of it output writes have evicted.
+inline double CachedFraction(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return 1;
+  }
+  const size_t size = size_t(st.st_size);
+  void* const map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  const size_t page = size_t(sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> resident((size + page - 1) / page);
+  double fraction = -1;
+  if (mincore(map, size, resident.data()) == 0) {
+    size_t n = 0;
+    for (unsigned char r : resident) {
+      n += r & 1;
+    }
+    fraction = double(n) / resident.size();
+  }
+  munmap(map, size);
+  return fraction;
+}
+
+}  // namespace xrage
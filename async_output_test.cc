@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "async_output.h"
+#include "test_util.h"
+
+#include <arrow/result.h>
+#include <arrow/status.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::vector<uint8_t> data;
+  FILE* f = fopen(path.c_str(), "rb");
+  XRAGE_CHECK(f != nullptr);
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(f);
+  return data;
+}
+
+// Write odd-sized pieces that straddle buffers and blocks through a stream
+// with small buffers, so that several writes are in flight, and read the
+// file back
+void RoundTrip(bool direct) {
+  xrage::TestDir dir;
+  const std::string path = dir.File("out.bin");
+  std::mt19937 rng(7);
+  std::vector<uint8_t> data(3 * 1000 * 1000 + 321);
+  for (uint8_t& b : data) {
+    b = uint8_t(rng());
+  }
+
+  xrage::OutputStreamOptions options;
+  options.direct = direct;
+  options.depth = 2;
+  options.buffer_size = 50000;  // Rounded up to whole blocks
+  std::shared_ptr<xrage::AsyncOutputStream> out;
+  {
+    arrow::Result<std::shared_ptr<xrage::AsyncOutputStream>> r =
+        xrage::AsyncOutputStream::Open(path, options);
+    XRAGE_CHECK(r.ok());
+    out = *r;
+  }
+  const size_t sizes[] = {1, 4095, 70001, 13, 200000, 4096, 12345};
+  size_t pos = 0;
+  for (int w = 0; pos < data.size(); w++) {
+    const size_t n = std::min(sizes[w % 7], data.size() - pos);
+    XRAGE_CHECK(out->Write(data.data() + pos, n).ok());
+    pos += n;
+    XRAGE_CHECK(*out->Tell() == int64_t(pos));
+    if (w % 10 == 9) {
+      XRAGE_CHECK(out->Flush().ok());
+    }
+  }
+  XRAGE_CHECK(out->Close().ok());
+  XRAGE_CHECK(out->closed());
+  XRAGE_CHECK(!out->Write(data.data(), 1).ok());
+
+  XRAGE_CHECK(ReadFile(path) == data);
+  const xrage::WriteStats& stats = out->stats();
+  // Direct writes pad the last block
+  XRAGE_CHECK(stats.bytes >= int64_t(data.size()));
+  XRAGE_CHECK(stats.writes > 1);
+  XRAGE_CHECK(stats.max_depth >= 1 && stats.max_depth <= options.depth);
+}
+
+void TestBuffered() { RoundTrip(false); }
+
+// Falls back to buffered writes where the file system has no O_DIRECT
+void TestDirect() { RoundTrip(true); }
+
+void TestEmpty() {
+  xrage::TestDir dir;
+  for (bool direct : {false, true}) {
+    xrage::OutputStreamOptions options;
+    options.direct = direct;
+    const std::string path = dir.File(direct ? "direct.bin" : "buffered.bin");
+    arrow::Result<std::shared_ptr<xrage::AsyncOutputStream>> r =
+        xrage::AsyncOutputStream::Open(path, options);
+    XRAGE_CHECK(r.ok());
+    XRAGE_CHECK((*r)->Close().ok());
+    struct stat st;
+    XRAGE_CHECK(stat(path.c_str(), &st) == 0 && st.st_size == 0);
+  }
+  XRAGE_CHECK(!xrage::AsyncOutputStream::Open(dir.File("no/such/file")).ok());
+}
+
+}  // namespace
+
+int main() {
+  xrage::RunTest("Buffered", TestBuffered);
+  xrage::RunTest("Direct", TestDirect);
+  xrage::RunTest("Empty", TestEmpty);
+  return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "raw_export.h"
+#include "scheduler.h"
+
+#include <arrow/util/compression.h>
+#include <parquet/exception.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xrage {
+
+// Chunked array store output. Every field of a grid is written as a Zarr v2
+// array of 3D chunks under a <name>.zarr directory, so that a plane or a
+// sub-cube can be read by loading only the chunks it intersects. Arrays have
+// shape (nz, ny, nx) in C order. Chunks are compressed with a codec known
+// to numcodecs, and chunks that only hold the fill value 0 are not written.
+struct ChunkStoreOptions {
+  ChunkStoreOptions()
+      : enabled(false),
+        compression(arrow::Compression::ZSTD),
+        level(3) {
+    chunk[0] = chunk[1] = chunk[2] = 64;
+  }
+  bool enabled;
+  int chunk[3];  // Chunk edge lengths along x, y and z
+  arrow::Compression::type compression;
+  int level;
+
+  // Parse a "n" or "nx,ny,nz" chunk shape. Returns false on bad input.
+  bool ParseChunk(const char* spec) {
+    int n[3];
+    char tail;
+    const int r = sscanf(spec, "%d,%d,%d%c", &n[0], &n[1], &n[2], &tail);
+    if (r == 1) {
+      n[1] = n[2] = n[0];
+    } else if (r != 3) {
+      return false;
+    }
+    for (int d = 0; d < 3; d++) {
+      if (n[d] <= 0) {
+        return false;
+      }
+      chunk[d] = n[d];
+    }
+    enabled = true;
+    return true;
+  }
+
+  // Parse "none", "zstd[:level]" or "gzip[:level]". Returns false on bad
+  // input.
+  bool ParseCompression(const char* spec) {
+    const char* colon = strchr(spec, ':');
+    const std::string name =
+        colon ? std::string(spec, colon - spec) : std::string(spec);
+    if (name == "none") {
+      compression = arrow::Compression::UNCOMPRESSED;
+      return colon == nullptr;
+    } else if (name == "zstd") {
+      compression = arrow::Compression::ZSTD;
+      level = 3;
+    } else if (name == "gzip") {
+      compression = arrow::Compression::GZIP;
+      level = 6;
+    } else {
+      return false;
+    }
+    if (colon) {
+      char* end;
+      level = int(strtol(colon + 1, &end, 10));
+      if (*end != '\0' || end == colon + 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The numcodecs compressor config of a .zarray
+  std::string CompressorJson() const {
+    switch (compression) {
+      case arrow::Compression::ZSTD:
+        return "{\"id\": \"zstd\", \"level\": " + std::to_string(level) + "}";
+      case arrow::Compression::GZIP:
+        return "{\"id\": \"gzip\", \"level\": " + std::to_string(level) + "}";
+      default:
+        return "null";
+    }
+  }
+};
+
+inline void MakeDir(const std::string& path) {
+  if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+    throw parquet::ParquetException("Fail to create dir ", path, ": ",
+                                    strerror(errno));
+  }
+}
+
+inline void WriteSmallFile(const std::string& path, const std::string& data) {
+  OutputFile file(path);
+  file.Write(data.data(), data.size());
+  file.Close();
+}
+
+// Remove the chunk files of an array dir left by an earlier write, which may
+// have used another chunk shape
+inline void RemoveChunks(const std::string& adir) {
+  DIR* const dir = opendir(adir.c_str());
+  if (!dir) {
+    throw parquet::ParquetException("Fail to open dir ", adir, ": ",
+                                    strerror(errno));
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    const char* name = entry->d_name;
+    if (name[0] != '.' && strspn(name, "0123456789.") == strlen(name)) {
+      unlink((adir + "/" + name).c_str());
+    }
+  }
+  closedir(dir);
+}
+
+// Writes the fields of a grid as a chunk store
+class ChunkStoreWriter {
+ public:
+  // Chunks are compressed by tasks of scheduler
+  ChunkStoreWriter(const ChunkStoreOptions& options, TaskScheduler* scheduler)
+      : options_(options),
+        scheduler_(scheduler),
+        stored_(0),
+        empty_(0),
+        bytes_(0) {}
+
+  // Write all fields of grid to the store dir, replacing the arrays of any
+  // earlier write. kv becomes the group attributes. Throws
+  // parquet::ParquetException on errors.
+  void Write(const std::string& dir, const RawGrid& grid,
+             const std::unordered_map<std::string, std::string>& kv) {
+    stored_ = empty_ = bytes_ = 0;
+    for (int d = 0; d < 3; d++) {
+      nchunks_[d] = (grid.dims[d] + options_.chunk[d] - 1) / options_.chunk[d];
+    }
+    MakeDir(dir);
+    WriteSmallFile(dir + "/.zgroup", "{\n  \"zarr_format\": 2\n}\n");
+    WriteSmallFile(dir + "/.zattrs", GroupAttrs(grid, kv));
+    for (const auto& field : grid.fields) {
+      const std::string adir = dir + "/" + field.first;
+      MakeDir(adir);
+      RemoveChunks(adir);
+      WriteSmallFile(adir + "/.zarray", ArrayMeta(grid));
+      WriteChunks(adir, grid.dims, field.second);
+    }
+  }
+
+  // Stats of the last Write
+  int64_t stored_chunks() const { return stored_; }
+  int64_t empty_chunks() const { return empty_; }
+  int64_t stored_bytes() const { return bytes_; }
+
+ private:
+  std::string ArrayMeta(const RawGrid& grid) const {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\n"
+             "  \"chunks\": [%d, %d, %d],\n"
+             "  \"compressor\": %s,\n"
+             "  \"dimension_separator\": \".\",\n"
+             "  \"dtype\": \"%s\",\n"
+             "  \"fill_value\": 0.0,\n"
+             "  \"filters\": null,\n"
+             "  \"order\": \"C\",\n"
+             "  \"shape\": [%d, %d, %d],\n"
+             "  \"zarr_format\": 2\n"
+             "}\n",
+             options_.chunk[2], options_.chunk[1], options_.chunk[0],
+             options_.CompressorJson().c_str(), kNpyFloatDescr, grid.dims[2],
+             grid.dims[1], grid.dims[0]);
+    return buf;
+  }
+
+  static std::string GroupAttrs(
+      const RawGrid& grid,
+      const std::unordered_map<std::string, std::string>& kv) {
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+             "{\n"
+             "  \"dims\": [%d, %d, %d],\n"
+             "  \"extent\": [%d, %d, %d, %d, %d, %d],\n"
+             "  \"origin\": [%.17g, %.17g, %.17g],\n"
+             "  \"spacing\": [%.17g, %.17g, %.17g],\n"
+             "  \"cycle_index\": %d,\n"
+             "  \"metadata\": ",
+             grid.dims[0], grid.dims[1], grid.dims[2], grid.extent[0],
+             grid.extent[1], grid.extent[2], grid.extent[3], grid.extent[4],
+             grid.extent[5], grid.origin[0], grid.origin[1], grid.origin[2],
+             grid.spacing[0], grid.spacing[1], grid.spacing[2],
+             grid.cycle_index);
+    return buf + JsonMetadata(kv) + "\n}\n";
+  }
+
+  // Gather, compress and write every chunk of one field. Runs of
+  // consecutive chunks become tasks of the scheduler, a few per worker so
+  // that idle workers have some to steal.
+  void WriteChunks(const std::string& adir, const int dims[3],
+                   const float* values) {
+    const int64_t total = int64_t(nchunks_[0]) * nchunks_[1] * nchunks_[2];
+    const int64_t ntasks = std::min<int64_t>(total, 4 * scheduler_->threads());
+    std::atomic<int64_t> stored(0);
+    std::atomic<int64_t> bytes(0);
+    TaskGroup group;
+    for (int64_t t = 0; t < ntasks; t++) {
+      scheduler_->Spawn(&group, [&, t]() {
+        ChunkBuffers b;
+        if (options_.compression != arrow::Compression::UNCOMPRESSED) {
+          PARQUET_ASSIGN_OR_THROW(
+              b.codec,
+              arrow::util::Codec::Create(options_.compression, options_.level));
+        }
+        const int64_t end = total * (t + 1) / ntasks;
+        for (int64_t c = total * t / ntasks; c < end; c++) {
+          const int64_t n = WriteChunk(adir, dims, values, c, &b);
+          if (n > 0) {
+            stored++;
+            bytes += n;
+          }
+        }
+      });
+    }
+    scheduler_->Wait(&group);
+    stored_ += stored;
+    empty_ += total - stored;
+    bytes_ += bytes;
+  }
+
+  // Per-task scratch space
+  struct ChunkBuffers {
+    std::unique_ptr<arrow::util::Codec> codec;
+    std::vector<float> chunk;
+    std::vector<uint8_t> compressed;
+  };
+
+  // Write chunk c, numbered in C order over (z, y, x) chunk coordinates.
+  // Returns the number of bytes written, 0 for an empty chunk.
+  int64_t WriteChunk(const std::string& adir, const int dims[3],
+                     const float* values, int64_t c, ChunkBuffers* b) const {
+    const int* cs = options_.chunk;
+    int ci[3];
+    ci[0] = int(c % nchunks_[0]);
+    ci[1] = int(c / nchunks_[0] % nchunks_[1]);
+    ci[2] = int(c / nchunks_[0] / nchunks_[1]);
+    int lo[3], n[3];
+    for (int d = 0; d < 3; d++) {
+      lo[d] = ci[d] * cs[d];
+      n[d] = std::min(cs[d], dims[d] - lo[d]);
+    }
+    // Edge chunks are padded to the full chunk shape with the fill value
+    b->chunk.assign(size_t(cs[0]) * cs[1] * cs[2], 0.0f);
+    bool empty = true;
+    for (int k = 0; k < n[2]; k++) {
+      for (int j = 0; j < n[1]; j++) {
+        const float* src =
+            values + (size_t(lo[2] + k) * dims[1] + (lo[1] + j)) * dims[0] +
+            lo[0];
+        float* dst = &b->chunk[(size_t(k) * cs[1] + j) * cs[0]];
+        for (int i = 0; i < n[0]; i++) {
+          empty &= src[i] == 0.0f;
+        }
+        memcpy(dst, src, n[0] * sizeof(float));
+      }
+    }
+    if (empty) {
+      // Missing chunks read back as the fill value
+      return 0;
+    }
+    const std::string path = adir + "/" + std::to_string(ci[2]) + "." +
+                             std::to_string(ci[1]) + "." +
+                             std::to_string(ci[0]);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(b->chunk.data());
+    int64_t size = int64_t(b->chunk.size() * sizeof(float));
+    if (b->codec) {
+      b->compressed.resize(size_t(b->codec->MaxCompressedLen(size, data)));
+      PARQUET_ASSIGN_OR_THROW(
+          size, b->codec->Compress(size, data, int64_t(b->compressed.size()),
+                                   b->compressed.data()));
+      data = b->compressed.data();
+    }
+    OutputFile file(path);
+    file.Write(reinterpret_cast<const char*>(data), size_t(size));
+    file.Close();
+    return size;
+  }
+
+  const ChunkStoreOptions options_;
+  TaskScheduler* const scheduler_;
+  int nchunks_[3];
+  int64_t stored_;
+  int64_t empty_;
+  int64_t bytes_;
+};
+
+}  // namespace xrage
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "column_codecs.h"
+#include "pqtreader.h"
+#include "test_util.h"
+
+#include <arrow/io/file.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+#include <parquet/file_writer.h>
+#include <parquet/metadata.h>
+#include <parquet/properties.h>
+#include <parquet/stream_writer.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+void TestParse() {
+  xrage::ColumnCodecs codecs;
+  XRAGE_CHECK(codecs.empty());
+  XRAGE_CHECK(codecs.ParseCompression("v02=zstd:5"));
+  XRAGE_CHECK(codecs.ParseEncoding("byte_stream_split"));
+  XRAGE_CHECK(codecs.ParseCompression("gzip"));
+  XRAGE_CHECK(!codecs.ParseCompression("brotli"));
+  XRAGE_CHECK(!codecs.ParseCompression("v02=zstd2"));
+  XRAGE_CHECK(!codecs.ParseEncoding("v03=delta"));
+  // Settings for all columns count for every column
+  XRAGE_CHECK(codecs.Has("v02"));
+  XRAGE_CHECK(codecs.Has("v04"));
+  xrage::ColumnCodecs own;
+  XRAGE_CHECK(own.ParseCompression("v02=snappy"));
+  XRAGE_CHECK(own.Has("v02"));
+  XRAGE_CHECK(!own.Has("v03"));
+  XRAGE_CHECK(codecs.UnknownColumn({"v02", "v03"}).empty());
+  XRAGE_CHECK(codecs.ParseCompression("v04=lz4"));
+  XRAGE_CHECK(codecs.UnknownColumn({"v02", "v03"}) == "v04");
+}
+
+// Write n values per column, with the given column settings on top of
+// snappy compression, and check the file's column chunks and values
+void RoundTrip(const xrage::TestDir& dir, const xrage::ColumnCodecs& codecs,
+               const std::vector<std::vector<float>>& values,
+               const std::vector<parquet::Encoding::type>& encodings,
+               const std::vector<parquet::Compression::type>& compressions) {
+  const std::vector<std::string> columns = {"v02", "v03"};
+  parquet::WriterProperties::Builder builder;
+  builder.compression(parquet::Compression::SNAPPY)->data_pagesize(4096);
+  codecs.Apply(columns, &builder);
+
+  parquet::schema::NodeVector fields;
+  for (const std::string& column : columns) {
+    fields.push_back(parquet::schema::PrimitiveNode::Make(
+        column, parquet::Repetition::REQUIRED, parquet::Type::FLOAT,
+        parquet::ConvertedType::NONE));
+  }
+  std::shared_ptr<parquet::schema::GroupNode> schema =
+      std::static_pointer_cast<parquet::schema::GroupNode>(
+          parquet::schema::GroupNode::Make(
+              "schema", parquet::Repetition::REQUIRED, fields));
+  const std::string path = dir.File("codecs.parquet");
+  {
+    std::shared_ptr<arrow::io::FileOutputStream> out;
+    PARQUET_ASSIGN_OR_THROW(out, arrow::io::FileOutputStream::Open(path));
+    parquet::StreamWriter os(
+        parquet::ParquetFileWriter::Open(out, schema, builder.build()));
+    for (size_t i = 0; i < values[0].size(); i++) {
+      os << values[0][i] << values[1][i] << parquet::EndRow;
+    }
+  }
+
+  std::unique_ptr<parquet::ParquetFileReader> reader =
+      parquet::ParquetFileReader::OpenFile(path);
+  for (size_t c = 0; c < columns.size(); c++) {
+    const std::unique_ptr<parquet::ColumnChunkMetaData> chunk =
+        reader->metadata()->RowGroup(0)->ColumnChunk(int(c));
+    XRAGE_CHECK(chunk->compression() == compressions[c]);
+    const std::vector<parquet::Encoding::type> used = chunk->encodings();
+    XRAGE_CHECK(std::find(used.begin(), used.end(), encodings[c]) !=
+                used.end());
+    std::vector<float> read;
+    xrage::ReadColumn(path, columns[c], &read);
+    XRAGE_CHECK(read.size() == values[c].size());
+    XRAGE_CHECK(memcmp(read.data(), values[c].data(),
+                       read.size() * sizeof(float)) == 0);
+  }
+}
+
+// Write every encoding and compression of the -e and -z options through
+// the column settings of the converters and read the values back
+void TestCodecRoundTrip() {
+  xrage::TestDir dir;
+  const size_t n = 5000;
+  std::vector<std::vector<float>> values = {xrage::TestValues(n),
+                                            std::vector<float>(n)};
+  for (size_t i = 0; i < n; i++) {
+    values[1][i] = float(i) * 0.125f;
+  }
+  struct Codec {
+    const char* encoding;
+    const char* compression;
+    parquet::Encoding::type expected_encoding;
+    parquet::Compression::type expected_compression;
+  };
+  const Codec kCodecs[] = {
+      {"plain", "uncompressed", parquet::Encoding::PLAIN,
+       parquet::Compression::UNCOMPRESSED},
+      {"plain", "snappy", parquet::Encoding::PLAIN,
+       parquet::Compression::SNAPPY},
+      {"byte_stream_split", "zstd", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::ZSTD},
+      {"byte_stream_split", "zstd:9", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::ZSTD},
+      {"plain", "lz4", parquet::Encoding::PLAIN, parquet::Compression::LZ4},
+      {"byte_stream_split", "gzip:6", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::GZIP},
+  };
+  for (const Codec& codec : kCodecs) {
+    // Only v02 gets settings, v03 keeps the defaults
+    xrage::ColumnCodecs codecs;
+    XRAGE_CHECK(codecs.ParseEncoding(
+        (std::string("v02=") + codec.encoding).c_str()));
+    XRAGE_CHECK(codecs.ParseCompression(
+        (std::string("v02=") + codec.compression).c_str()));
+    RoundTrip(dir, codecs, values,
+              {codec.expected_encoding, parquet::Encoding::PLAIN},
+              {codec.expected_compression, parquet::Compression::SNAPPY});
+    // Settings without a column apply to all columns
+    xrage::ColumnCodecs all;
+    XRAGE_CHECK(all.ParseEncoding(codec.encoding));
+    XRAGE_CHECK(all.ParseCompression(codec.compression));
+    RoundTrip(dir, all, values,
+              {codec.expected_encoding, codec.expected_encoding},
+              {codec.expected_compression, codec.expected_compression});
+  }
+}
+
+void TestSampleValues() {
+  std::vector<float> v(1 << 20);
+  for (size_t i = 0; i < v.size(); i++) {
+    v[i] = float(i);
+  }
+  std::vector<float> sample;
+  // Short arrays are sampled whole
+  xrage::SampleValues(v.data(), 1000, &sample);
+  XRAGE_CHECK(sample.size() == 1000);
+  XRAGE_CHECK(sample.front() == 0 && sample.back() == 999);
+  // Long ones as 16 runs that span the array
+  xrage::SampleValues(v.data(), v.size(), &sample);
+  XRAGE_CHECK(sample.size() == 16 * 16 * 1024);
+  XRAGE_CHECK(sample.front() == 0);
+  XRAGE_CHECK(sample.back() == float(v.size() - 1));
+  XRAGE_CHECK(sample[16 * 1024 - 1] + 1 < sample[16 * 1024]);
+  // Only the listed cells are sampled, in their order
+  const std::vector<int32_t> cells = {5, 3, 100, 7};
+  xrage::SampleValues(v.data(), cells.size(), &sample, cells.data());
+  XRAGE_CHECK(sample == std::vector<float>({5, 3, 100, 7}));
+}
+
+void TestAutoCodec() {
+  xrage::AutoCodec goal;
+  XRAGE_CHECK(!goal.enabled);
+  XRAGE_CHECK(goal.Parse("within:5"));
+  XRAGE_CHECK(goal.goal == xrage::AutoCodec::kWithin && goal.within == 5);
+  XRAGE_CHECK(!goal.Parse("within:-1"));
+  XRAGE_CHECK(!goal.Parse("smallest"));
+  XRAGE_CHECK(goal.Parse("size") && goal.enabled);
+
+  // The size goal picks the candidate with the smallest output
+  const std::vector<float> sample = xrage::TestValues(20000);
+  xrage::ColumnCodecs codecs;
+  const char* name = xrage::AutoSelectCodec(goal, "v02", sample, &codecs);
+  XRAGE_CHECK(name != nullptr && codecs.Has("v02"));
+  int64_t smallest = INT64_MAX;
+  int64_t chosen = 0;
+  for (const xrage::CodecCandidate& candidate : xrage::CodecCandidates()) {
+    const int64_t bytes =
+        xrage::MeasureCodec(sample.data(), sample.size(), candidate.codec())
+            .bytes;
+    smallest = std::min(smallest, bytes);
+    if (strcmp(candidate.name, name) == 0) {
+      chosen = bytes;
+    }
+  }
+  XRAGE_CHECK(chosen == smallest);
+  // Columns with settings of their own keep them
+  XRAGE_CHECK(codecs.ParseCompression("v03=lz4"));
+  XRAGE_CHECK(xrage::AutoSelectCodec(goal, "v03", sample, &codecs) ==
+              nullptr);
+  // and so do all columns when settings are given for all of them
+  xrage::ColumnCodecs all;
+  XRAGE_CHECK(all.ParseEncoding("byte_stream_split"));
+  XRAGE_CHECK(xrage::AutoSelectCodec(goal, "v02", sample, &all) == nullptr);
+}
+
+// Every candidate of automatic selection writes files that read back
+void TestCandidateRoundTrip() {
+  xrage::TestDir dir;
+  const size_t n = 5000;
+  const std::vector<std::vector<float>> values = {xrage::TestValues(n),
+                                                  xrage::TestValues(n)};
+  for (const xrage::CodecCandidate& candidate : xrage::CodecCandidates()) {
+    xrage::ColumnCodecs codecs;
+    codecs.Set("v03", candidate.codec());
+    RoundTrip(dir, codecs, values,
+              {parquet::Encoding::PLAIN, candidate.encoding},
+              {parquet::Compression::SNAPPY, candidate.compression});
+  }
+}
+
+}  // namespace
+
+int main() {
+  xrage::RunTest("Parse", TestParse);
+  xrage::RunTest("CodecRoundTrip", TestCodecRoundTrip);
+  xrage::RunTest("SampleValues", TestSampleValues);
+  xrage::RunTest("AutoCodec", TestAutoCodec);
+  xrage::RunTest("CandidateRoundTrip", TestCandidateRoundTrip);
+  return 0;
+}
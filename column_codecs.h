@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "kernels.h"
+#include "timing.h"
+
+#include <arrow/io/memory.h>
+#include <arrow/util/key_value_metadata.h>
+#include <parquet/column_reader.h>
+#include <parquet/column_writer.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+#include <parquet/file_writer.h>
+#include <parquet/properties.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace xrage {
+
+// Encoding and compression of one value column
+struct ColumnCodec {
+  ColumnCodec()
+      : has_encoding(false),
+        encoding(parquet::Encoding::PLAIN),
+        has_compression(false),
+        compression(parquet::Compression::UNCOMPRESSED),
+        level(0) {}
+  bool has_encoding;
+  parquet::Encoding::type encoding;
+  bool has_compression;
+  parquet::Compression::type compression;
+  int level;  // 0 means the codec's default level
+};
+
+// Per-column encoding and compression settings given on the command line
+// as "[column=]name". Settings without a column apply to all value columns
+// that have no setting of their own. Columns without any setting keep the
+// tool's defaults.
+class ColumnCodecs {
+ public:
+  // Parse "[column=]plain|byte_stream_split". Returns false on bad input.
+  bool ParseEncoding(const char* spec) {
+    std::string column, name;
+    Split(spec, &column, &name);
+    ColumnCodec& codec = codecs_[column];
+    if (name == "plain") {
+      codec.encoding = parquet::Encoding::PLAIN;
+    } else if (name == "byte_stream_split") {
+      codec.encoding = parquet::Encoding::BYTE_STREAM_SPLIT;
+    } else {
+      return false;
+    }
+    codec.has_encoding = true;
+    return true;
+  }
+
+  // Parse "[column=]uncompressed|snappy|zstd[:level]|lz4|gzip[:level]".
+  // Returns false on bad input.
+  bool ParseCompression(const char* spec) {
+    std::string column, name;
+    Split(spec, &column, &name);
+    ColumnCodec& codec = codecs_[column];
+    codec.level = 0;
+    const size_t colon = name.find(':');
+    if (colon != std::string::npos) {
+      codec.level = atoi(name.c_str() + colon + 1);
+      name.resize(colon);
+    }
+    if (name == "uncompressed") {
+      codec.compression = parquet::Compression::UNCOMPRESSED;
+    } else if (name == "snappy") {
+      codec.compression = parquet::Compression::SNAPPY;
+    } else if (name == "zstd") {
+      codec.compression = parquet::Compression::ZSTD;
+    } else if (name == "lz4") {
+      codec.compression = parquet::Compression::LZ4;
+    } else if (name == "gzip") {
+      codec.compression = parquet::Compression::GZIP;
+    } else {
+      return false;
+    }
+    codec.has_compression = true;
+    return true;
+  }
+
+  // Override the builder's settings for the given value columns
+  void Apply(const std::vector<std::string>& columns,
+             parquet::WriterProperties::Builder* builder) const {
+    for (const std::string& column : columns) {
+      const ColumnCodec codec = Get(column);
+      if (codec.has_encoding) {
+        // Dictionary encoding would otherwise take precedence
+        builder->disable_dictionary(column);
+        builder->encoding(column, codec.encoding);
+      }
+      if (codec.has_compression) {
+        builder->compression(column, codec.compression);
+        if (codec.level != 0) {
+          builder->compression_level(column, codec.level);
+        }
+      }
+    }
+  }
+
+  // Set the codec of a column, replacing its own settings
+  void Set(const std::string& column, const ColumnCodec& codec) {
+    codecs_[column] = codec;
+  }
+
+  // Return true if the column has settings, of its own or given for all
+  // columns
+  bool Has(const std::string& column) const {
+    return codecs_.count(column) != 0 || codecs_.count(std::string()) != 0;
+  }
+
+  // Return the first column with settings of its own that is not one of
+  // columns, or an empty string if there is none
+  std::string UnknownColumn(const std::vector<std::string>& columns) const {
+    for (const auto& entry : codecs_) {
+      if (!entry.first.empty() &&
+          std::find(columns.begin(), columns.end(), entry.first) ==
+              columns.end()) {
+        return entry.first;
+      }
+    }
+    return std::string();
+  }
+
+  bool empty() const { return codecs_.empty(); }
+
+ private:
+  static void Split(const char* spec, std::string* column, std::string* name) {
+    const char* eq = strchr(spec, '=');
+    if (eq) {
+      column->assign(spec, eq - spec);
+      name->assign(eq + 1);
+    } else {
+      column->clear();
+      name->assign(spec);
+    }
+  }
+
+  // Combine a column's own settings with the default settings
+  ColumnCodec Get(const std::string& column) const {
+    ColumnCodec result;
+    std::map<std::string, ColumnCodec>::const_iterator it = codecs_.find("");
+    if (it != codecs_.end()) {
+      result = it->second;
+    }
+    it = codecs_.find(column);
+    if (it != codecs_.end()) {
+      if (it->second.has_encoding) {
+        result.has_encoding = true;
+        result.encoding = it->second.encoding;
+      }
+      if (it->second.has_compression) {
+        result.has_compression = true;
+        result.compression = it->second.compression;
+        result.level = it->second.level;
+      }
+    }
+    return result;
+  }
+
+  std::map<std::string, ColumnCodec> codecs_;
+};
+
+// Number of mantissa bits kept per value column, given on the command line
+// as "[column=]bits". Settings without a column apply to all value columns
+// that have no setting of their own. Columns without any setting are
+// written at the tool's default precision.
+class ColumnPrecision {
+ public:
+  // Parse "[column=]bits" with 0 < bits < 23. Returns false on bad input.
+  bool Parse(const char* spec) {
+    const char* eq = strchr(spec, '=');
+    char* end;
+    const long bits = strtol(eq ? eq + 1 : spec, &end, 10);
+    if (*end != '\0' || bits <= 0 || bits >= 23) {
+      return false;
+    }
+    bits_[eq ? std::string(spec, eq - spec) : std::string()] = int(bits);
+    return true;
+  }
+
+  // Return the number of mantissa bits kept for a column, or 0 if the
+  // column is not groomed
+  int Get(const std::string& column) const {
+    std::map<std::string, int>::const_iterator it = bits_.find(column);
+    if (it == bits_.end()) {
+      it = bits_.find("");
+    }
+    return it != bits_.end() ? it->second : 0;
+  }
+
+  // Groom the n values of a column in place. Returns false if the column is
+  // not groomed.
+  bool Groom(const std::string& column, float* v, size_t n) const {
+    const int bits = Get(column);
+    if (bits == 0) {
+      return false;
+    }
+    GroomMantissa(v, n, bits);
+    return true;
+  }
+
+  // Record "<column>_keep_bits" for the groomed columns
+  void AddMetadata(const std::vector<std::string>& columns,
+                   arrow::KeyValueMetadata* kv) const {
+    for (const std::string& column : columns) {
+      const int bits = Get(column);
+      if (bits != 0) {
+        kv->Append(column + "_keep_bits", std::to_string(bits));
+      }
+    }
+  }
+
+  // Return the first column with settings of its own that is not one of
+  // columns, or an empty string if there is none
+  std::string UnknownColumn(const std::vector<std::string>& columns) const {
+    for (const auto& entry : bits_) {
+      if (!entry.first.empty() &&
+          std::find(columns.begin(), columns.end(), entry.first) ==
+              columns.end()) {
+        return entry.first;
+      }
+    }
+    return std::string();
+  }
+
+  bool empty() const { return bits_.empty(); }
+
+ private:
+  std::map<std::string, int> bits_;
+};
+
+// Exit with an error if codecs or precision have settings for a column that
+// is not one of the value columns of a tool
+inline void CheckColumns(const std::vector<std::string>& columns,
+                         const ColumnCodecs& codecs,
+                         const ColumnPrecision& precision) {
+  std::string column = codecs.UnknownColumn(columns);
+  if (column.empty()) {
+    column = precision.UnknownColumn(columns);
+  }
+  if (!column.empty()) {
+    fprintf(stderr, "Unknown value column %s\n", column.c_str());
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Page index and data page size of all columns. The column index records
+// the min/max of every data page and the offset index where each page
+// starts, so readers can skip pages that fail a predicate (see
+// xrage::QueryCells). Smaller pages make the index finer but cost more
+// page headers.
+struct PageIndex {
+  PageIndex() : enabled(false), page_size(0) {}
+  bool enabled;
+  int64_t page_size;  // Bytes, 0 keeps the parquet default
+
+  // Parse a page size in bytes. Returns false on bad input.
+  bool ParsePageSize(const char* spec) {
+    char* end;
+    page_size = strtoll(spec, &end, 10);
+    return *end == '\0' && page_size > 0;
+  }
+
+  void Apply(parquet::WriterProperties::Builder* builder) const {
+    if (enabled) {
+      builder->enable_write_page_index();
+      builder->enable_statistics();
+    }
+    if (page_size > 0) {
+      builder->data_pagesize(page_size);
+    }
+  }
+};
+
+struct CodecMeasurement {
+  int64_t bytes;  // Size of the encoded parquet file
+  double encode_seconds;
+  double decode_seconds;
+};
+
+// Encode n values as a single column parquet file in memory using codec,
+// then decode it back. Codec settings that are not given default to PLAIN
+// and UNCOMPRESSED. Throws parquet::ParquetException on errors.
+inline CodecMeasurement MeasureCodec(const float* values, int64_t n,
+                                     const ColumnCodec& codec) {
+  parquet::schema::NodeVector fields;
+  fields.push_back(parquet::schema::PrimitiveNode::Make(
+      "v", parquet::Repetition::REQUIRED, parquet::Type::FLOAT,
+      parquet::ConvertedType::NONE));
+  std::shared_ptr<parquet::schema::GroupNode> schema =
+      std::static_pointer_cast<parquet::schema::GroupNode>(
+          parquet::schema::GroupNode::Make(
+              "schema", parquet::Repetition::REQUIRED, fields));
+  parquet::WriterProperties::Builder builder;
+  builder.disable_dictionary();
+  builder.encoding(codec.encoding);
+  builder.compression(codec.compression);
+  if (codec.level != 0) {
+    builder.compression_level(codec.level);
+  }
+  CodecMeasurement m;
+  double start = NowSeconds();
+  std::shared_ptr<arrow::io::BufferOutputStream> sink;
+  PARQUET_ASSIGN_OR_THROW(sink, arrow::io::BufferOutputStream::Create());
+  std::unique_ptr<parquet::ParquetFileWriter> writer =
+      parquet::ParquetFileWriter::Open(sink, schema, builder.build());
+  parquet::RowGroupWriter* rg = writer->AppendRowGroup();
+  parquet::FloatWriter* column =
+      static_cast<parquet::FloatWriter*>(rg->NextColumn());
+  column->WriteBatch(n, nullptr, nullptr, values);
+  writer->Close();
+  std::shared_ptr<arrow::Buffer> buffer;
+  PARQUET_ASSIGN_OR_THROW(buffer, sink->Finish());
+  m.encode_seconds = NowSeconds() - start;
+  m.bytes = buffer->size();
+
+  start = NowSeconds();
+  std::unique_ptr<parquet::ParquetFileReader> reader =
+      parquet::ParquetFileReader::Open(
+          std::make_shared<arrow::io::BufferReader>(buffer));
+  std::vector<float> out(64 * 1024);
+  std::shared_ptr<parquet::FloatReader> column_reader =
+      std::static_pointer_cast<parquet::FloatReader>(
+          reader->RowGroup(0)->Column(0));
+  int64_t total = 0;
+  while (column_reader->HasNext()) {
+    int64_t read = 0;
+    column_reader->ReadBatch(out.size(), nullptr, nullptr, out.data(), &read);
+    total += read;
+  }
+  m.decode_seconds = NowSeconds() - start;
+  if (total != n) {
+    throw parquet::ParquetException("Decoded ", total, " of ", n, " values");
+  }
+  return m;
+}
+
+// An encoding and compression combination tried by pqtbench and by
+// automatic codec selection
+struct CodecCandidate {
+  const char* name;
+  parquet::Encoding::type encoding;
+  parquet::Compression::type compression;
+  int level;
+
+  ColumnCodec codec() const {
+    ColumnCodec c;
+    c.has_encoding = true;
+    c.encoding = encoding;
+    c.has_compression = true;
+    c.compression = compression;
+    c.level = level;
+    return c;
+  }
+};
+
+inline const std::vector<CodecCandidate>& CodecCandidates() {
+  static const std::vector<CodecCandidate> kCandidates = {
+      {"plain", parquet::Encoding::PLAIN, parquet::Compression::UNCOMPRESSED,
+       0},
+      {"plain+snappy", parquet::Encoding::PLAIN, parquet::Compression::SNAPPY,
+       0},
+      {"plain+lz4", parquet::Encoding::PLAIN, parquet::Compression::LZ4, 0},
+      {"plain+zstd:1", parquet::Encoding::PLAIN, parquet::Compression::ZSTD,
+       1},
+      {"plain+zstd:3", parquet::Encoding::PLAIN, parquet::Compression::ZSTD,
+       3},
+      {"bss", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::UNCOMPRESSED, 0},
+      {"bss+snappy", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::SNAPPY, 0},
+      {"bss+lz4", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::LZ4, 0},
+      {"bss+zstd:1", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::ZSTD, 1},
+      {"bss+zstd:3", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::ZSTD, 3},
+      {"bss+zstd:9", parquet::Encoding::BYTE_STREAM_SPLIT,
+       parquet::Compression::ZSTD, 9},
+  };
+  return kCandidates;
+}
+
+// Goal of automatic codec selection, given on the command line as "size"
+// (smallest output), "speed" (fastest encoding) or "within:pct" (fastest
+// encoding whose output is at most pct percent larger than the smallest)
+struct AutoCodec {
+  enum Goal { kSize, kSpeed, kWithin };
+  AutoCodec() : enabled(false), goal(kSize), within(0) {}
+  bool enabled;
+  Goal goal;
+  double within;
+
+  // Returns false on bad input
+  bool Parse(const char* spec) {
+    if (strcmp(spec, "size") == 0) {
+      goal = kSize;
+    } else if (strcmp(spec, "speed") == 0) {
+      goal = kSpeed;
+    } else if (strncmp(spec, "within:", 7) == 0) {
+      char* end;
+      within = strtod(spec + 7, &end);
+      if (*end != '\0' || within < 0) {
+        return false;
+      }
+      goal = kWithin;
+    } else {
+      return false;
+    }
+    enabled = true;
+    return true;
+  }
+};
+
+// Copy up to 256K values of v into sample, taken as 16 equally spaced runs
+// of consecutive values so that the sample compresses like the whole array.
+// If cells is not null, the array is the values of the n cells it lists in
+// that order, like sparse files write them.
+inline void SampleValues(const float* v, int64_t n, std::vector<float>* sample,
+                         const int32_t* cells = nullptr) {
+  const int64_t kRuns = 16;
+  const int64_t kRunLength = 16 * 1024;
+  const int64_t runs = n <= kRuns * kRunLength ? 1 : kRuns;
+  const int64_t length = runs == 1 ? n : kRunLength;
+  sample->clear();
+  for (int64_t r = 0; r < runs; r++) {
+    const int64_t begin = runs == 1 ? 0 : (n - length) * r / (runs - 1);
+    for (int64_t i = begin; i < begin + length; i++) {
+      sample->push_back(cells ? v[cells[i]] : v[i]);
+    }
+  }
+}
+
+// Pick the codec of a column by encoding a sample of its values with every
+// candidate, unless the column has settings, of its own or given for all
+// columns. The choice is stored into codecs and printed. Returns the name
+// of the chosen candidate, or nullptr if the column keeps its settings.
+// Concurrent calls measure their candidates one at a time, so that the
+// timings compared by the speed and within goals are not contended by each
+// other.
+inline const char* AutoSelectCodec(const AutoCodec& goal,
+                                   const std::string& column,
+                                   const std::vector<float>& sample,
+                                   ColumnCodecs* codecs) {
+  if (!goal.enabled || codecs->Has(column) || sample.empty()) {
+    return nullptr;
+  }
+  const std::vector<CodecCandidate>& candidates = CodecCandidates();
+  std::vector<CodecMeasurement> m;
+  int64_t smallest = INT64_MAX;
+  {
+    static std::mutex mu;
+    std::lock_guard<std::mutex> lock(mu);
+    for (const CodecCandidate& candidate : candidates) {
+      m.push_back(
+          MeasureCodec(sample.data(), sample.size(), candidate.codec()));
+      smallest = std::min(smallest, m.back().bytes);
+    }
+  }
+  size_t best = 0;
+  for (size_t i = 1; i < candidates.size(); i++) {
+    bool better;
+    if (goal.goal == AutoCodec::kSize) {
+      better = m[i].bytes < m[best].bytes;
+    } else {
+      const double limit = goal.goal == AutoCodec::kSpeed
+                               ? INFINITY
+                               : smallest * (1 + goal.within / 100);
+      const bool fits = m[i].bytes <= limit;
+      const bool best_fits = m[best].bytes <= limit;
+      better = fits && (!best_fits ||
+                        m[i].encode_seconds < m[best].encode_seconds);
+    }
+    if (better) {
+      best = i;
+    }
+  }
+  codecs->Set(column, candidates[best].codec());
+  const double mb = sample.size() * sizeof(float) / 1e6;
+  printf("  %s: %s (ratio %.2f, %.1f MB/s encode on %zu sampled values)\n",
+         column.c_str(), candidates[best].name,
+         sample.size() * sizeof(float) / double(m[best].bytes),
+         mb / m[best].encode_seconds, sample.size());
+  return candidates[best].name;
+}
+
+// Pick the codecs of value columns that have no -e/-z settings from
+// samples of the n values of every column in values, or of the cells listed
+// in cells if it is not null. Columns that precision does not groom are
+// sampled rounded to 6 decimal places, like they are written. The choices
+// are stored into codecs and recorded as "<column>_codec" in kv.
+inline void AutoSelectCodecs(const AutoCodec& goal,
+                             const ColumnPrecision& precision,
+                             const std::vector<std::string>& columns,
+                             const std::vector<const float*>& values,
+                             int64_t n, const std::vector<int32_t>* cells,
+                             ColumnCodecs* codecs,
+                             arrow::KeyValueMetadata* kv) {
+  std::vector<float> sample;
+  for (size_t c = 0; c < columns.size(); c++) {
+    SampleValues(values[c], cells ? int64_t(cells->size()) : n, &sample,
+                 cells ? cells->data() : nullptr);
+    if (precision.Get(columns[c]) == 0) {
+      RoundValues(sample.data(), sample.size());
+    }
+    const char* codec = AutoSelectCodec(goal, columns[c], sample, codecs);
+    if (codec) {
+      kv->Append(columns[c] + "_codec", codec);
+    }
+  }
+}
+
+}  // namespace xrage
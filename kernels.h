@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+namespace xrage {
+
+// Bulk kernels over the raw float arrays exposed by the converters'
+// iterators. They are written as simple fixed-size loops without
+// data-dependent branches so that the compiler can auto-vectorize them.
+
+// Store into out the indices i in [0, n) for which |a[i]| > threshold or
+// |b[i]| > threshold, in increasing order. Returns the number of indices
+// stored. out must have room for n indices. b may be nullptr.
+inline size_t SelectCells(const float* a, const float* b, size_t n,
+                          float threshold, int32_t* out) {
+  const size_t kBlock = 64;
+  size_t m = 0;
+  size_t i = 0;
+  uint8_t keep[kBlock];
+  for (; i + kBlock <= n; i += kBlock) {
+    uint8_t any = 0;
+    if (b) {
+      for (size_t j = 0; j < kBlock; j++) {
+        keep[j] = (fabsf(a[i + j]) > threshold) | (fabsf(b[i + j]) > threshold);
+        any |= keep[j];
+      }
+    } else {
+      for (size_t j = 0; j < kBlock; j++) {
+        keep[j] = fabsf(a[i + j]) > threshold;
+        any |= keep[j];
+      }
+    }
+    // Most blocks are entirely empty in sparse fields
+    if (any) {
+      for (size_t j = 0; j < kBlock; j++) {
+        out[m] = int32_t(i + j);
+        m += keep[j];
+      }
+    }
+  }
+  for (; i < n; i++) {
+    out[m] = int32_t(i);
+    m += (fabsf(a[i]) > threshold) | (b && fabsf(b[i]) > threshold);
+  }
+  return m;
+}
+
+// Compute the inclusive bounding box of the points of an nx * ny * nz grid
+// (x fastest) where |a| > threshold or |b| > threshold. Returns false if
+// there are no such points. b may be nullptr.
+inline bool NonEmptyBounds(const float* a, const float* b, int nx, int ny,
+                           int nz, float threshold, int lo[3], int hi[3]) {
+  lo[0] = nx;
+  lo[1] = ny;
+  lo[2] = nz;
+  hi[0] = hi[1] = hi[2] = -1;
+  for (int k = 0; k < nz; k++) {
+    for (int j = 0; j < ny; j++) {
+      const size_t row = (size_t(k) * ny + j) * nx;
+      const float* ra = a + row;
+      const float* rb = b ? b + row : nullptr;
+      uint8_t any = 0;
+      if (rb) {
+        for (int i = 0; i < nx; i++) {
+          any |= (fabsf(ra[i]) > threshold) | (fabsf(rb[i]) > threshold);
+        }
+      } else {
+        for (int i = 0; i < nx; i++) {
+          any |= fabsf(ra[i]) > threshold;
+        }
+      }
+      if (!any) {
+        continue;
+      }
+      lo[1] = std::min(lo[1], j);
+      hi[1] = std::max(hi[1], j);
+      lo[2] = std::min(lo[2], k);
+      hi[2] = std::max(hi[2], k);
+      // Only the parts of the row outside of the current x range can
+      // extend it
+      for (int i = 0; i < lo[0]; i++) {
+        if (fabsf(ra[i]) > threshold || (rb && fabsf(rb[i]) > threshold)) {
+          lo[0] = i;
+          break;
+        }
+      }
+      for (int i = nx - 1; i > hi[0]; i--) {
+        if (fabsf(ra[i]) > threshold || (rb && fabsf(rb[i]) > threshold)) {
+          hi[0] = i;
+          break;
+        }
+      }
+    }
+  }
+  return hi[0] >= 0;
+}
+
+// Store into out the indices i in [0, n) for which |a[i] - ra[i]| >
+// threshold or |b[i] - rb[i]| > threshold, in increasing order, and copy
+// the values of those cells into ra and rb. Returns the number of indices
+// stored. out must have room for n indices.
+inline size_t SelectChangedCells(const float* a, const float* b, size_t n,
+                                 float threshold, float* ra, float* rb,
+                                 int32_t* out) {
+  const size_t kBlock = 64;
+  size_t m = 0;
+  size_t i = 0;
+  uint8_t keep[kBlock];
+  for (; i + kBlock <= n; i += kBlock) {
+    uint8_t any = 0;
+    for (size_t j = 0; j < kBlock; j++) {
+      keep[j] = (fabsf(a[i + j] - ra[i + j]) > threshold) |
+                (fabsf(b[i + j] - rb[i + j]) > threshold);
+      any |= keep[j];
+    }
+    // Most of a slowly evolving field is unchanged
+    if (any) {
+      for (size_t j = 0; j < kBlock; j++) {
+        out[m] = int32_t(i + j);
+        m += keep[j];
+        ra[i + j] = keep[j] ? a[i + j] : ra[i + j];
+        rb[i + j] = keep[j] ? b[i + j] : rb[i + j];
+      }
+    }
+  }
+  for (; i < n; i++) {
+    const bool changed =
+        fabsf(a[i] - ra[i]) > threshold || fabsf(b[i] - rb[i]) > threshold;
+    out[m] = int32_t(i);
+    m += changed;
+    ra[i] = changed ? a[i] : ra[i];
+    rb[i] = changed ? b[i] : rb[i];
+  }
+  return m;
+}
+
+// Map the physical interval [lo, hi] along an axis of a grid with the given
+// origin and spacing to the inclusive index range [*ilo, *ihi] of the grid
+// points inside it. *ilo > *ihi if there are none. The indices are left as
+// doubles so that intervals far outside of the grid don't overflow.
+inline void PhysicalToIndex(double lo, double hi, double origin,
+                            double spacing, double* ilo, double* ihi) {
+  // With a negative spacing the high end of the interval has the low index
+  if (spacing < 0) {
+    std::swap(lo, hi);
+  }
+  *ilo = ceil((lo - origin) / spacing);
+  *ihi = floor((hi - origin) / spacing);
+}
+
+// Return the index of the first NaN or infinity among the n values of a, or n
+// if they are all finite
+inline size_t FindNonFinite(const float* a, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (!std::isfinite(a[i])) {
+      return i;
+    }
+  }
+  return n;
+}
+
+// Store the smallest and the largest of the n > 0 values of a into lo and hi.
+// The values must be finite, see FindNonFinite.
+inline void MinMax(const float* a, size_t n, float* lo, float* hi) {
+  float l = a[0];
+  float h = a[0];
+  for (size_t i = 1; i < n; i++) {
+    l = a[i] < l ? a[i] : l;
+    h = a[i] > h ? a[i] : h;
+  }
+  *lo = l;
+  *hi = h;
+}
+
+// Quantize the n values of a to out[i] = round((a[i] - offset) / scale).
+// Every a[i] must be finite and at least offset and the quantized values must
+// fit in 31 bits. Rounding is done in double precision so that offset +
+// out[i] * scale is within scale / 2 of a[i].
+inline void Quantize(const float* a, size_t n, double offset, double scale,
+                     uint32_t* out) {
+  const double inv = 1 / scale;
+  for (size_t i = 0; i < n; i++) {
+    // The argument is non-negative so truncation rounds to nearest
+    out[i] = uint32_t(int32_t((double(a[i]) - offset) * inv + 0.5));
+  }
+}
+
+// Reconstruct out[i] = offset + q[i] * scale from quantized values
+inline void Dequantize(const uint32_t* q, size_t n, double offset,
+                       double scale, float* out) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = float(offset + double(int32_t(q[i])) * scale);
+  }
+}
+
+// Round the n values of a in place to 6 decimal places, the way the
+// converters write values that are neither groomed nor quantized
+inline void RoundValues(float* a, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    a[i] = roundf(a[i] * 1000000) / 1000000;
+  }
+}
+
+// Round the n values of a in place to their bits most significant mantissa
+// bits (0 < bits < 23) and clear the remaining low bits. The relative error
+// is at most 2^-(bits + 1). Infinities and NaNs are left unchanged.
+inline void GroomMantissa(float* a, size_t n, int bits) {
+  const uint32_t half = uint32_t(1) << (22 - bits);
+  const uint32_t mask = ~((half << 1) - 1);
+  for (size_t i = 0; i < n; i++) {
+    uint32_t u;
+    memcpy(&u, &a[i], sizeof(u));
+    const uint32_t r = (u + half) & mask;
+    u = (u & 0x7f800000) == 0x7f800000 ? u : r;
+    memcpy(&a[i], &u, sizeof(u));
+  }
+}
+
+}  // namespace xrage
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "column_codecs.h"
+#include "kernels.h"
+#include "test_util.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace {
+
+void TestQuantize() {
+  std::vector<float> v = xrage::TestValues(4096);
+  // Quantization needs finite values that fit in 31 bits at the scale
+  for (float& x : v) {
+    if (!std::isfinite(x) || fabsf(x) > 2000) {
+      x = 1.5f;
+    }
+  }
+  XRAGE_CHECK(xrage::FindNonFinite(v.data(), v.size()) == v.size());
+  float lo, hi;
+  xrage::MinMax(v.data(), v.size(), &lo, &hi);
+  XRAGE_CHECK(lo == *std::min_element(v.begin(), v.end()));
+  XRAGE_CHECK(hi == *std::max_element(v.begin(), v.end()));
+  for (double scale : {1e-4, 0.01, 0.3, 7.0}) {
+    std::vector<uint32_t> q(v.size());
+    xrage::Quantize(v.data(), v.size(), lo, scale, q.data());
+    std::vector<float> out(v.size());
+    xrage::Dequantize(q.data(), q.size(), lo, scale, out.data());
+    for (size_t i = 0; i < v.size(); i++) {
+      XRAGE_CHECK(q[i] <= uint32_t(INT32_MAX));
+      // Within half a step, plus the rounding of the result to float
+      const double ulp = fabs(v[i]) * std::numeric_limits<float>::epsilon();
+      XRAGE_CHECK(fabs(double(out[i]) - v[i]) <= scale / 2 + ulp);
+    }
+  }
+}
+
+void TestFindNonFinite() {
+  std::vector<float> v(100, 1.0f);
+  XRAGE_CHECK(xrage::FindNonFinite(v.data(), v.size()) == v.size());
+  XRAGE_CHECK(xrage::FindNonFinite(v.data(), 0) == 0);
+  v[0] = NAN;
+  XRAGE_CHECK(xrage::FindNonFinite(v.data(), v.size()) == 0);
+  v[0] = 1.0f;
+  v[57] = -INFINITY;
+  v[80] = NAN;
+  XRAGE_CHECK(xrage::FindNonFinite(v.data(), v.size()) == 57);
+  XRAGE_CHECK(xrage::FindNonFinite(v.data(), 57) == 57);
+}
+
+void TestGroomMantissa() {
+  const std::vector<float> v = xrage::TestValues(4096);
+  for (int bits : {1, 7, 15, 22}) {
+    std::vector<float> g = v;
+    xrage::GroomMantissa(g.data(), g.size(), bits);
+    for (size_t i = 0; i < v.size(); i++) {
+      uint32_t u;
+      memcpy(&u, &g[i], sizeof(u));
+      if (std::isnan(v[i])) {
+        XRAGE_CHECK(std::isnan(g[i]));
+      } else if (std::isinf(v[i])) {
+        XRAGE_CHECK(g[i] == v[i]);
+      } else {
+        XRAGE_CHECK((u & ((uint32_t(1) << (23 - bits)) - 1)) == 0);
+        // Rounding may carry into the exponent, up to infinity for the
+        // largest floats. Denormals have fewer significant bits, so only the
+        // error of normal floats is bounded.
+        if (std::isnormal(v[i]) && std::isfinite(g[i])) {
+          XRAGE_CHECK(fabs(double(g[i]) - v[i]) <=
+                      ldexp(fabs(double(v[i])), -(bits + 1)));
+        }
+      }
+    }
+  }
+  float x = 1.0f + 1.0f / 3;
+  xrage::GroomMantissa(&x, 1, 2);
+  XRAGE_CHECK(x == 1.25f);
+}
+
+void TestPrecision() {
+  xrage::ColumnPrecision precision;
+  XRAGE_CHECK(precision.Parse("10"));
+  XRAGE_CHECK(precision.Parse("v03=7"));
+  XRAGE_CHECK(!precision.Parse("0"));
+  XRAGE_CHECK(!precision.Parse("23"));
+  XRAGE_CHECK(!precision.Parse("v02=7x"));
+  XRAGE_CHECK(precision.Get("v02") == 10);
+  XRAGE_CHECK(precision.Get("v03") == 7);
+  XRAGE_CHECK(precision.UnknownColumn({"v02", "v03"}).empty());
+  XRAGE_CHECK(precision.Parse("prs=3"));
+  XRAGE_CHECK(precision.UnknownColumn({"v02", "v03"}) == "prs");
+}
+
+void TestRoundValues() {
+  float v[] = {1.23456789f, -0.0000004f, 2.5e-7f, 100.0f};
+  xrage::RoundValues(v, 4);
+  XRAGE_CHECK(v[0] == roundf(1.23456789f * 1000000) / 1000000);
+  XRAGE_CHECK(v[1] == 0);
+  XRAGE_CHECK(v[2] == 0.0f || v[2] == 1e-6f);
+  XRAGE_CHECK(v[3] == 100.0f);
+}
+
+}  // namespace
+
+int main() {
+  xrage::RunTest("Quantize", TestQuantize);
+  xrage::RunTest("FindNonFinite", TestFindNonFinite);
+  xrage::RunTest("GroomMantissa", TestGroomMantissa);
+  xrage::RunTest("Precision", TestPrecision);
+  xrage::RunTest("RoundValues", TestRoundValues);
+  return 0;
+}
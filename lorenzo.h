@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace xrage {
+
+// Lossless 3D Lorenzo prediction over a regular grid of floats. Each value
+// is predicted from its 7 already visited neighbors in the previous row,
+// plane and their combinations. The residual of the prediction is stored as
+// an integer computed with wrapping arithmetic on an order-preserving
+// integer image of the float bits, so decoding reproduces the input bit for
+// bit. The grid is cut along k into slabs of a fixed number of planes that
+// are predicted independently, which lets both directions run one slab per
+// thread.
+
+// Map float bits to integers that sort as int32_t in the same order as the
+// floats
+inline void FloatsToOrdered(const float* in, size_t n, uint32_t* out) {
+  for (size_t i = 0; i < n; i++) {
+    uint32_t u;
+    memcpy(&u, &in[i], sizeof(u));
+    out[i] = u ^ ((0 - (u >> 31)) & 0x7fffffffu);
+  }
+}
+
+// Inverse of FloatsToOrdered
+inline void OrderedToFloats(const uint32_t* in, size_t n, float* out) {
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t u = in[i] ^ ((0 - (in[i] >> 31)) & 0x7fffffffu);
+    memcpy(&out[i], &u, sizeof(u));
+  }
+}
+
+// Number of slabs of slab planes that nz planes are cut into
+inline int LorenzoSlabs(int nz, int slab) { return (nz + slab - 1) / slab; }
+
+namespace internal {
+
+// Rows of the neighbors of row (j, k) of a slab, or a row of zeros when the
+// neighbor is outside of the slab
+struct LorenzoRows {
+  const uint32_t* a;  // (j - 1, k)
+  const uint32_t* b;  // (j, k - 1)
+  const uint32_t* c;  // (j - 1, k - 1)
+};
+
+inline LorenzoRows NeighborRows(const uint32_t* slab, const uint32_t* zeros,
+                                int nx, int ny, int j, int k) {
+  const size_t row = size_t(nx);
+  const size_t plane = row * ny;
+  const uint32_t* cur = slab + k * plane + j * row;
+  LorenzoRows r;
+  r.a = j > 0 ? cur - row : zeros;
+  r.b = k > 0 ? cur - plane : zeros;
+  r.c = j > 0 && k > 0 ? cur - plane - row : zeros;
+  return r;
+}
+
+// Residuals of the nz planes of one slab
+inline void LorenzoEncodeSlab(const uint32_t* in, int nx, int ny, int nz,
+                              uint32_t* out) {
+  const std::vector<uint32_t> zeros(nx, 0);
+  for (int k = 0; k < nz; k++) {
+    for (int j = 0; j < ny; j++) {
+      const size_t off = (size_t(k) * ny + j) * nx;
+      const uint32_t* x = in + off;
+      const LorenzoRows r = NeighborRows(in, zeros.data(), nx, ny, j, k);
+      uint32_t* o = out + off;
+      o[0] = x[0] - (r.a[0] + r.b[0] - r.c[0]);
+      for (int i = 1; i < nx; i++) {
+        const uint32_t pred = x[i - 1] + r.a[i] + r.b[i] - r.c[i] -
+                              (r.a[i - 1] + r.b[i - 1] - r.c[i - 1]);
+        o[i] = x[i] - pred;
+      }
+    }
+  }
+}
+
+// Inverse of LorenzoEncodeSlab
+inline void LorenzoDecodeSlab(const uint32_t* in, int nx, int ny, int nz,
+                              uint32_t* out) {
+  const std::vector<uint32_t> zeros(nx, 0);
+  for (int k = 0; k < nz; k++) {
+    for (int j = 0; j < ny; j++) {
+      const size_t off = (size_t(k) * ny + j) * nx;
+      const LorenzoRows r = NeighborRows(out, zeros.data(), nx, ny, j, k);
+      uint32_t* x = out + off;
+      // The part of the prediction that does not depend on the current row
+      // is computed for the whole row first
+      x[0] = in[off] + r.a[0] + r.b[0] - r.c[0];
+      for (int i = 1; i < nx; i++) {
+        x[i] = in[off + i] + r.a[i] + r.b[i] - r.c[i] -
+               (r.a[i - 1] + r.b[i - 1] - r.c[i - 1]);
+      }
+      for (int i = 1; i < nx; i++) {
+        x[i] += x[i - 1];
+      }
+    }
+  }
+}
+
+// Run fn(k0, nz) for every slab using up to threads threads
+template <typename Fn>
+void ForEachSlab(int nz, int slab, int threads, Fn fn) {
+  const int slabs = LorenzoSlabs(nz, slab);
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::max(1, std::min(threads, slabs));
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; t++) {
+    pool.emplace_back([=]() {
+      for (int s = t; s < slabs; s += threads) {
+        fn(s * slab, std::min(slab, nz - s * slab));
+      }
+    });
+  }
+  for (std::thread& th : pool) {
+    th.join();
+  }
+}
+
+}  // namespace internal
+
+// Store into out the Lorenzo residuals of slab s of the nx * ny * nz grid
+// in (i fastest) vtk point order. Only the planes of the slab are read and
+// written, so callers can encode slabs in parallel with their own threads.
+inline void LorenzoEncodeSlab(const float* in, int nx, int ny, int nz,
+                              int slab, int s, int32_t* out) {
+  const size_t plane = size_t(nx) * ny;
+  const int k0 = s * slab;
+  const int n = std::min(slab, nz - k0);
+  std::vector<uint32_t> ordered(plane * n);
+  FloatsToOrdered(in + k0 * plane, n * plane, ordered.data());
+  internal::LorenzoEncodeSlab(ordered.data(), nx, ny, n,
+                              reinterpret_cast<uint32_t*>(out) + k0 * plane);
+}
+
+// Store into out the Lorenzo residuals of the nx * ny * nz grid in (i
+// fastest) vtk point order, predicting slabs of slab planes independently.
+// threads <= 0 means one thread per hardware thread.
+inline void LorenzoEncode(const float* in, int nx, int ny, int nz, int slab,
+                          int threads, int32_t* out) {
+  internal::ForEachSlab(nz, slab, threads, [&](int k0, int) {
+    LorenzoEncodeSlab(in, nx, ny, nz, slab, k0 / slab, out);
+  });
+}
+
+// Inverse of LorenzoEncode
+inline void LorenzoDecode(const int32_t* in, int nx, int ny, int nz, int slab,
+                          int threads, float* out) {
+  const size_t plane = size_t(nx) * ny;
+  std::vector<uint32_t> ordered(plane * nz);
+  internal::ForEachSlab(nz, slab, threads, [&](int k0, int n) {
+    internal::LorenzoDecodeSlab(
+        reinterpret_cast<const uint32_t*>(in) + k0 * plane, nx, ny, n,
+        ordered.data() + k0 * plane);
+    OrderedToFloats(ordered.data() + k0 * plane, n * plane, out + k0 * plane);
+  });
+}
+
+}  // namespace xrage
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "lorenzo.h"
+#include "test_util.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+void TestRoundTrip() {
+  // Odd sizes so that slabs do not divide the grid
+  const int nx = 13, ny = 7, nz = 11;
+  const size_t n = size_t(nx) * ny * nz;
+  const std::vector<float> in = xrage::TestValues(n);
+  for (int slab : {1, 3, 4, 11, 20}) {
+    std::vector<int32_t> residuals(n);
+    xrage::LorenzoEncode(in.data(), nx, ny, nz, slab, 1, residuals.data());
+    // Any number of threads writes the same residuals
+    for (int threads : {3, 0}) {
+      std::vector<int32_t> other(n);
+      xrage::LorenzoEncode(in.data(), nx, ny, nz, slab, threads, other.data());
+      XRAGE_CHECK(other == residuals);
+    }
+    // Slabs can be encoded one at a time, in any order
+    std::vector<int32_t> slabs(n);
+    for (int s = xrage::LorenzoSlabs(nz, slab) - 1; s >= 0; s--) {
+      xrage::LorenzoEncodeSlab(in.data(), nx, ny, nz, slab, s, slabs.data());
+    }
+    XRAGE_CHECK(slabs == residuals);
+    for (int threads : {1, 3, 0}) {
+      std::vector<float> out(n);
+      xrage::LorenzoDecode(residuals.data(), nx, ny, nz, slab, threads,
+                           out.data());
+      XRAGE_CHECK(memcmp(out.data(), in.data(), n * sizeof(float)) == 0);
+    }
+  }
+  XRAGE_CHECK(xrage::LorenzoSlabs(11, 4) == 3);
+  XRAGE_CHECK(xrage::LorenzoSlabs(12, 4) == 3);
+}
+
+// A constant field predicts perfectly away from the first row and plane
+void TestConstant() {
+  const int nx = 8, ny = 6, nz = 5;
+  const std::vector<float> in(size_t(nx) * ny * nz, 3.25f);
+  std::vector<int32_t> residuals(in.size());
+  xrage::LorenzoEncode(in.data(), nx, ny, nz, nz, 1, residuals.data());
+  for (int k = 1; k < nz; k++) {
+    for (int j = 1; j < ny; j++) {
+      for (int i = 1; i < nx; i++) {
+        XRAGE_CHECK(residuals[i + nx * (j + ny * k)] == 0);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  xrage::RunTest("RoundTrip", TestRoundTrip);
+  xrage::RunTest("Constant", TestConstant);
+  return 0;
+}
@@ -32,6 +32,8 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "async_output.h"
+
 #include <arrow/io/file.h>
 #include <parquet/stream_reader.h>
 #include <parquet/stream_writer.h>
@@ -125,8 +127,8 @@ inline bool StringEndWith(const std::string& str, const char* suffix) {
 }
 
 void Rewrite0(parquet::StreamReader* reader, const std::string& dst) {
-  std::shared_ptr<arrow::io::FileOutputStream> file;
-  PARQUET_ASSIGN_OR_THROW(file, arrow::io::FileOutputStream::Open(dst))
+  std::shared_ptr<xrage::AsyncOutputStream> file;
+  PARQUET_ASSIGN_OR_THROW(file, xrage::AsyncOutputStream::Open(dst))
   ParquetWriter writer(ParquetWriterOptions(), file);
   int n = 0;
   int timestep, rowid;
@@ -137,6 +139,8 @@ void Rewrite0(parquet::StreamReader* reader, const std::string& dst) {
     n++;
   }
   writer.Finish();
+  PARQUET_THROW_NOT_OK(file->Close());
+  printf("%s\n", file->Summary().c_str());
 }
 
 void Rewrite(const std::string& src) {
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "column_codecs.h"
+
+#include <parquet/column_reader.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Read up to limit values of a float column from all row groups of a file
+std::vector<float> ReadColumn(parquet::ParquetFileReader* reader, int col,
+                              int64_t limit) {
+  std::vector<float> values;
+  for (int g = 0; g < reader->metadata()->num_row_groups(); g++) {
+    std::shared_ptr<parquet::FloatReader> column_reader =
+        std::static_pointer_cast<parquet::FloatReader>(
+            reader->RowGroup(g)->Column(col));
+    while (column_reader->HasNext() && int64_t(values.size()) < limit) {
+      const size_t size = values.size();
+      values.resize(std::min<int64_t>(size + 64 * 1024, limit));
+      int64_t read = 0;
+      column_reader->ReadBatch(values.size() - size, nullptr, nullptr,
+                               values.data() + size, &read);
+      values.resize(size + read);
+    }
+  }
+  return values;
+}
+
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] file.parquet [column...]\n"
+          "  -n, --rows n\n"
+          "      max number of rows of each column to benchmark\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+// Benchmark the size and encode/decode throughput of the float columns of a
+// converted file under different parquet encodings and compressions.
+int main(int argc, char* argv[]) {
+  static const struct option kLongOpts[] = {
+      {"rows", required_argument, nullptr, 'n'}, {nullptr, 0, nullptr, 0}};
+  static const char kShortOpts[] = "n:";
+  int64_t limit = INT64_MAX;
+  int c;
+  while ((c = getopt_long(argc, argv, kShortOpts, kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'n':
+        limit = atoll(optarg);
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    Usage(argv[0]);
+  }
+  try {
+    std::unique_ptr<parquet::ParquetFileReader> reader =
+        parquet::ParquetFileReader::OpenFile(argv[optind]);
+    const parquet::SchemaDescriptor* schema = reader->metadata()->schema();
+    std::vector<int> columns;
+    for (int i = optind + 1; i < argc; i++) {
+      const int col = schema->ColumnIndex(argv[i]);
+      if (col < 0) {
+        fprintf(stderr, "No column %s in %s\n", argv[i], argv[optind]);
+        exit(EXIT_FAILURE);
+      }
+      columns.push_back(col);
+    }
+    if (columns.empty()) {
+      for (int i = 0; i < schema->num_columns(); i++) {
+        columns.push_back(i);
+      }
+    }
+    printf("%-8s %-14s %12s %8s %12s %12s\n", "column", "config", "bytes",
+           "ratio", "enc MB/s", "dec MB/s");
+    for (int col : columns) {
+      if (schema->Column(col)->physical_type() != parquet::Type::FLOAT) {
+        continue;
+      }
+      const std::vector<float> values = ReadColumn(reader.get(), col, limit);
+      const double mb = values.size() * sizeof(float) / 1e6;
+      for (const xrage::CodecCandidate& candidate : xrage::CodecCandidates()) {
+        const xrage::CodecMeasurement m = xrage::MeasureCodec(
+            values.data(), values.size(), candidate.codec());
+        printf("%-8s %-14s %12lld %8.2f %12.1f %12.1f\n",
+               schema->Column(col)->name().c_str(), candidate.name,
+               static_cast<long long>(m.bytes),
+               values.size() * sizeof(float) / double(m.bytes),
+               mb / m.encode_seconds, mb / m.decode_seconds);
+      }
+    }
+  } catch (const parquet::ParquetException& e) {
+    fprintf(stderr, "Fail to benchmark %s: %s\n", argv[optind], e.what());
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}
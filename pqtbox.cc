@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pqtreader.h"
+#include "query_tool.h"
+
+#include <parquet/exception.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+
+namespace {
+
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] file.parquet|dir x0:x1,y0:y1,z0:z1\n"
+          "  -c, --column name  column to read (repeatable, default v02 and "
+          "v03)\n"
+          "  -t, --timestep t   read the file of dir with this cycle_index\n"
+          "  -b, --bench runs   time the query against a full-file scan\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  static const struct option kLongOpts[] = {
+      {"column", required_argument, nullptr, 'c'},
+      {"timestep", required_argument, nullptr, 't'},
+      {"bench", required_argument, nullptr, 'b'},
+      {nullptr, 0, nullptr, 0}};
+  xrage::BoxQuery query;
+  query.prune = true;
+  bool has_timestep = false;
+  int timestep = 0;
+  int runs = 0;
+  int c;
+  while ((c = getopt_long(argc, argv, "c:t:b:", kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'c':
+        query.columns.push_back(optarg);
+        break;
+      case 't':
+        has_timestep = true;
+        timestep = atoi(optarg);
+        break;
+      case 'b':
+        runs = atoi(optarg);
+        if (runs <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind + 2 != argc ||
+      !xrage::ParsePhysicalBox(argv[optind + 1], &query)) {
+    Usage(argv[0]);
+  }
+  if (query.columns.empty()) {
+    query.columns.push_back("v02");
+    query.columns.push_back("v03");
+  }
+  std::string path = argv[optind];
+  if (has_timestep) {
+    try {
+      path = xrage::FindTimestep(path, timestep);
+    } catch (const parquet::ParquetException& e) {
+      fprintf(stderr, "%s\n", e.what());
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  xrage::BoxQueryResult result;
+  double elapsed = xrage::RunQuery(xrage::QueryBox, path, query, &result);
+  if (runs > 0) {
+    // Best of runs, alternating so that both see the same page cache state
+    xrage::BoxQueryResult full;
+    double full_elapsed = INFINITY;
+    xrage::BoxQuery full_query = query;
+    full_query.prune = false;
+    for (int r = 0; r < runs; r++) {
+      full_elapsed =
+          std::min(full_elapsed,
+                   xrage::RunQuery(xrage::QueryBox, path, full_query, &full));
+      elapsed = std::min(
+          elapsed, xrage::RunQuery(xrage::QueryBox, path, query, &result));
+    }
+    if (full.values != result.values) {
+      fprintf(stderr, "Pruning changes the result of the query\n");
+      exit(EXIT_FAILURE);
+    }
+    printf("Full scan: ");
+    xrage::PrintReads(full, full_elapsed);
+    printf("Box query: ");
+    xrage::PrintReads(result, elapsed);
+    printf("Speedup %.2fx\n", elapsed > 0 ? full_elapsed / elapsed : 0.0);
+  } else {
+    xrage::PrintReads(result, elapsed);
+  }
+  const xrage::Box& box = result.box;
+  if (result.values.empty() || result.values[0].empty()) {
+    printf("%s: box is outside of the grid\n", path.c_str());
+    return 0;
+  }
+  printf("%s: %d:%d,%d:%d,%d:%d\n", path.c_str(), box.lo[0], box.hi[0],
+         box.lo[1], box.hi[1], box.lo[2], box.hi[2]);
+  for (size_t i = 0; i < query.columns.size(); i++) {
+    const std::vector<float>& v = result.values[i];
+    double sum = 0;
+    for (float x : v) {
+      sum += x;
+    }
+    printf("%s: %zu values, min %g, max %g, mean %g\n",
+           query.columns[i].c_str(), v.size(),
+           *std::min_element(v.begin(), v.end()),
+           *std::max_element(v.begin(), v.end()), sum / v.size());
+  }
+  return 0;
+}
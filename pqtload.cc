@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "timing.h"
+
+#include <arrow/array.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/record_batch.h>
+#include <arrow/table.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/exception.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+namespace {
+
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-b runs] file.parquet|file.arrow...\n"
+          "  -b, --bench runs  best of this many loads (default 1)\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+inline bool StringEndWith(const std::string& str, const char* suffix) {
+  const size_t n = strlen(suffix);
+  return str.size() >= n && str.compare(str.size() - n, n, suffix) == 0;
+}
+
+// Sum all float values of a table so that every buffer is touched
+double SumFloats(const arrow::Table& table) {
+  double sum = 0;
+  for (const std::shared_ptr<arrow::ChunkedArray>& column : table.columns()) {
+    if (column->type()->id() != arrow::Type::FLOAT) {
+      continue;
+    }
+    for (const std::shared_ptr<arrow::Array>& chunk : column->chunks()) {
+      const auto& a = static_cast<const arrow::FloatArray&>(*chunk);
+      const float* v = a.raw_values();
+      for (int64_t i = 0; i < a.length(); i++) {
+        sum += v[i];
+      }
+    }
+  }
+  return sum;
+}
+
+// Load all columns of a file written by one of the converters into memory.
+// Parquet pages are decoded into fresh buffers. Arrow IPC record batches are
+// views into a memory map of the file unless their buffers are compressed.
+std::shared_ptr<arrow::Table> Load(const std::string& path) {
+  std::shared_ptr<arrow::io::MemoryMappedFile> file;
+  PARQUET_ASSIGN_OR_THROW(file, arrow::io::MemoryMappedFile::Open(
+                                    path, arrow::io::FileMode::READ));
+  std::shared_ptr<arrow::Table> table;
+  if (StringEndWith(path, ".arrow")) {
+    std::shared_ptr<arrow::ipc::RecordBatchFileReader> reader;
+    PARQUET_ASSIGN_OR_THROW(reader,
+                            arrow::ipc::RecordBatchFileReader::Open(file));
+    arrow::RecordBatchVector batches;
+    for (int i = 0; i < reader->num_record_batches(); i++) {
+      std::shared_ptr<arrow::RecordBatch> batch;
+      PARQUET_ASSIGN_OR_THROW(batch, reader->ReadRecordBatch(i));
+      batches.push_back(batch);
+    }
+    PARQUET_ASSIGN_OR_THROW(
+        table, arrow::Table::FromRecordBatches(reader->schema(), batches));
+  } else {
+    std::unique_ptr<parquet::arrow::FileReader> reader;
+    PARQUET_ASSIGN_OR_THROW(
+        reader, parquet::arrow::OpenFile(file, arrow::default_memory_pool()));
+    PARQUET_ASSIGN_OR_THROW(table, reader->ReadTable());
+  }
+  return table;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  static const struct option kLongOpts[] = {
+      {"bench", required_argument, nullptr, 'b'},
+      {nullptr, 0, nullptr, 0}};
+  int runs = 1;
+  int c;
+  while ((c = getopt_long(argc, argv, "b:", kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'b':
+        runs = atoi(optarg);
+        if (runs <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    Usage(argv[0]);
+  }
+  printf("%-40s %10s %12s %10s %10s\n", "file", "rows", "bytes", "load s",
+         "touch s");
+  for (int i = optind; i < argc; i++) {
+    const std::string path = argv[i];
+    double load = INFINITY;
+    double touch = INFINITY;
+    int64_t rows = 0;
+    int64_t bytes = 0;
+    try {
+      for (int r = 0; r < runs; r++) {
+        const double start = xrage::NowSeconds();
+        std::shared_ptr<arrow::Table> table = Load(path);
+        const double loaded = xrage::NowSeconds();
+        // Keep the sum alive so the loop is not optimized out
+        volatile double sum = SumFloats(*table);
+        (void)sum;
+        load = std::min(load, loaded - start);
+        touch = std::min(touch, xrage::NowSeconds() - start);
+        rows = table->num_rows();
+      }
+      std::shared_ptr<arrow::io::ReadableFile> file;
+      PARQUET_ASSIGN_OR_THROW(file, arrow::io::ReadableFile::Open(path));
+      PARQUET_ASSIGN_OR_THROW(bytes, file->GetSize());
+    } catch (const parquet::ParquetException& e) {
+      fprintf(stderr, "Fail to load %s: %s\n", path.c_str(), e.what());
+      exit(EXIT_FAILURE);
+    }
+    printf("%-40s %10lld %12lld %10.4f %10.4f\n", path.c_str(),
+           static_cast<long long>(rows), static_cast<long long>(bytes), load,
+           touch);
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pqtreader.h"
+#include "query_tool.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+namespace {
+
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-c column] [-t threshold] [-n] [-b runs] file.parquet "
+          "i0:i1,j0:j1,k0:k1\n"
+          "  -n, --no-page-index  scan whole row groups\n"
+          "  -b, --bench runs     time the query with and without the page "
+          "index\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  static const struct option kLongOpts[] = {
+      {"column", required_argument, nullptr, 'c'},
+      {"threshold", required_argument, nullptr, 't'},
+      {"no-page-index", no_argument, nullptr, 'n'},
+      {"bench", required_argument, nullptr, 'b'},
+      {nullptr, 0, nullptr, 0}};
+  xrage::CellQuery query;
+  query.column = "v02";
+  query.threshold = 0;
+  query.page_index = true;
+  int runs = 0;
+  int c;
+  while ((c = getopt_long(argc, argv, "c:t:nb:", kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'c':
+        query.column = optarg;
+        break;
+      case 't':
+        query.threshold = atof(optarg);
+        break;
+      case 'n':
+        query.page_index = false;
+        break;
+      case 'b':
+        runs = atoi(optarg);
+        if (runs <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind + 2 != argc || !xrage::ParseBox(argv[optind + 1], &query.box)) {
+    Usage(argv[0]);
+  }
+  const char* path = argv[optind];
+  xrage::CellQueryResult result;
+  if (runs > 0) {
+    // Best of runs, alternating so that both see the same page cache state
+    double best[2] = {INFINITY, INFINITY};
+    xrage::CellQueryResult results[2];
+    for (int r = 0; r < runs; r++) {
+      for (int i = 0; i < 2; i++) {
+        query.page_index = i == 1;
+        best[i] = std::min(best[i], xrage::RunQuery(xrage::QueryCells, path,
+                                                    query, &results[i]));
+      }
+    }
+    if (results[0].rowids != results[1].rowids) {
+      fprintf(stderr, "Page index changes the result of the query\n");
+      exit(EXIT_FAILURE);
+    }
+    printf("%zu cells with %s > %g\n", results[1].rowids.size(),
+           query.column.c_str(), query.threshold);
+    printf("Without page index: ");
+    xrage::PrintReads(results[0], best[0]);
+    printf("With page index:    ");
+    xrage::PrintReads(results[1], best[1]);
+    printf("Speedup %.2fx\n", best[1] > 0 ? best[0] / best[1] : 0.0);
+    return 0;
+  }
+  const double elapsed =
+      xrage::RunQuery(xrage::QueryCells, path, query, &result);
+  printf("%zu cells with %s > %g\n", result.rowids.size(),
+         query.column.c_str(), query.threshold);
+  xrage::PrintReads(result, elapsed);
+  return 0;
+}
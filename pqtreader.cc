@@ -0,0 +1,1347 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pqtreader.h"
+#include "kernels.h"
+#include "lorenzo.h"
+
+#include <arrow/io/file.h>
+#include <arrow/util/key_value_metadata.h>
+#include <parquet/column_page.h>
+#include <parquet/column_reader.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+#include <parquet/page_index.h>
+#include <parquet/statistics.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace xrage {
+
+bool Box::Intersects(const Box& other) const {
+  for (int d = 0; d < 3; d++) {
+    if (hi[d] < other.lo[d] || other.hi[d] < lo[d]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Box::Contains(int i, int j, int k) const {
+  return i >= lo[0] && i <= hi[0] && j >= lo[1] && j <= hi[1] && k >= lo[2] &&
+         k <= hi[2];
+}
+
+bool ParseBox(const char* str, Box* box) {
+  int n = 0;
+  if (sscanf(str, "%d:%d,%d:%d,%d:%d%n", &box->lo[0], &box->hi[0],
+             &box->lo[1], &box->hi[1], &box->lo[2], &box->hi[2], &n) != 6 ||
+      str[n] != '\0') {
+    return false;
+  }
+  for (int d = 0; d < 3; d++) {
+    if (box->lo[d] > box->hi[d]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int ZoneMap::ColumnIndex(const std::string& name) const {
+  for (size_t i = 0; i < columns.size(); i++) {
+    if (columns[i] == name) {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+namespace {
+
+inline bool StringEndWith(const std::string& str, const char* suffix) {
+  std::size_t lenstr = str.length();
+  std::size_t lensuffix = std::strlen(suffix);
+  if (lensuffix > lenstr) {
+    return false;
+  }
+  return std::strncmp(&str[0] + lenstr - lensuffix, suffix, lensuffix) == 0;
+}
+
+std::vector<std::string> SplitTabs(char* line) {
+  std::vector<std::string> fields;
+  char* save;
+  for (char* tok = strtok_r(line, "\t\n", &save); tok;
+       tok = strtok_r(nullptr, "\t\n", &save)) {
+    fields.push_back(tok);
+  }
+  return fields;
+}
+
+std::string KeyValue(const parquet::FileMetaData& md, const char* key) {
+  const std::shared_ptr<const arrow::KeyValueMetadata>& kv =
+      md.key_value_metadata();
+  const int i = kv ? kv->FindKey(key) : -1;
+  return i >= 0 ? kv->value(i) : std::string();
+}
+
+// Read the extent_* keys of a file written by vti2pqt
+void ReadExtent(const parquet::FileMetaData& md, const std::string& path,
+                int ext[6]) {
+  for (int i = 0; i < 6; i++) {
+    const std::string key = "extent_" + std::to_string(i);
+    const std::string v = KeyValue(md, key.c_str());
+    if (v.empty()) {
+      throw parquet::ParquetException("Missing ", key, " in ", path);
+    }
+    ext[i] = atoi(v.c_str());
+  }
+}
+
+// Read a column of Lorenzo residuals (see the -p option of vti2pqt) and
+// reconstruct its values
+void ReadPredictedColumn(parquet::ParquetFileReader* reader,
+                         const std::string& path, const std::string& column,
+                         std::vector<float>* values) {
+  const std::shared_ptr<parquet::FileMetaData> md = reader->metadata();
+  const std::string predictor = KeyValue(*md, "predictor");
+  if (predictor != "lorenzo") {
+    throw parquet::ParquetException("Unknown predictor ", predictor, " in ",
+                                    path);
+  }
+  const int slab = atoi(KeyValue(*md, "predictor_slab").c_str());
+  int ext[6];
+  ReadExtent(*md, path, ext);
+  const int nx = ext[1] - ext[0] + 1;
+  const int ny = ext[3] - ext[2] + 1;
+  const int nz = ext[5] - ext[4] + 1;
+  const int col = md->schema()->ColumnIndex(column);
+  if (col < 0) {
+    throw parquet::ParquetException("Missing column ", column, " in ", path);
+  }
+  if (slab <= 0 || md->num_rows() != int64_t(nx) * ny * nz) {
+    throw parquet::ParquetException("Malformed predicted file ", path);
+  }
+  std::vector<int32_t> residuals(md->num_rows());
+  int64_t r = 0;
+  for (int g = 0; g < md->num_row_groups(); g++) {
+    std::shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(g);
+    std::shared_ptr<parquet::Int32Reader> col_reader =
+        std::static_pointer_cast<parquet::Int32Reader>(rg->Column(col));
+    while (col_reader->HasNext() && r < md->num_rows()) {
+      int64_t m = 0;
+      col_reader->ReadBatch(md->num_rows() - r, nullptr, nullptr,
+                            residuals.data() + r, &m);
+      r += m;
+    }
+  }
+  if (r != md->num_rows()) {
+    throw parquet::ParquetException("Short column ", column, " in ", path);
+  }
+  values->resize(residuals.size());
+  LorenzoDecode(residuals.data(), nx, ny, nz, slab, 0, values->data());
+}
+
+// Reads a value column one row group at a time, converting quantized
+// integer columns back to floats
+class ValueReader {
+ public:
+  ValueReader(const parquet::FileMetaData& md, const std::string& column)
+      : col_(md.schema()->ColumnIndex(column)),
+        quantized_(false),
+        offset_(0),
+        scale_(1) {
+    if (col_ < 0) {
+      throw parquet::ParquetException("Missing column ", column);
+    }
+    if (md.schema()->Column(col_)->physical_type() == parquet::Type::INT32) {
+      if (!KeyValue(md, "predictor").empty()) {
+        throw parquet::ParquetException("Column ", column,
+                                        " stores prediction residuals");
+      }
+      const std::string offset = KeyValue(md, (column + "_offset").c_str());
+      const std::string scale = KeyValue(md, (column + "_scale").c_str());
+      if (offset.empty() || scale.empty()) {
+        throw parquet::ParquetException("Missing quantization of ", column);
+      }
+      quantized_ = true;
+      offset_ = strtod(offset.c_str(), nullptr);
+      scale_ = strtod(scale.c_str(), nullptr);
+    }
+  }
+
+  void Open(parquet::RowGroupReader* rg) { reader_ = rg->Column(col_); }
+  void Open(std::shared_ptr<parquet::ColumnReader> reader) {
+    reader_ = std::move(reader);
+  }
+
+  int column() const { return col_; }
+
+  // Convert a value as stored in the file, e.g. a page min/max, to the
+  // float that Read returns for it
+  float Value(double stored) const {
+    if (!quantized_) {
+      return float(stored);
+    }
+    const uint32_t q = uint32_t(stored);
+    float v;
+    Dequantize(&q, 1, offset_, scale_, &v);
+    return v;
+  }
+
+  // Skip n values. Returns the number of values skipped, which is less than
+  // n only at the end of the row group.
+  int64_t Skip(int64_t n) {
+    if (!quantized_) {
+      return static_cast<parquet::FloatReader*>(reader_.get())->Skip(n);
+    }
+    return static_cast<parquet::Int32Reader*>(reader_.get())->Skip(n);
+  }
+
+  // Read up to n values into out. Returns the number of values read, which
+  // is less than n only at the end of the row group.
+  int64_t Read(int64_t n, float* out) {
+    int64_t r = 0;
+    // ReadBatch stops at page boundaries
+    while (r < n && reader_->HasNext()) {
+      int64_t m = 0;
+      if (!quantized_) {
+        static_cast<parquet::FloatReader*>(reader_.get())
+            ->ReadBatch(n - r, nullptr, nullptr, out + r, &m);
+      } else {
+        buf_.resize(n - r);
+        static_cast<parquet::Int32Reader*>(reader_.get())
+            ->ReadBatch(n - r, nullptr, nullptr, buf_.data(), &m);
+        Dequantize(reinterpret_cast<const uint32_t*>(buf_.data()), m,
+                   offset_, scale_, out + r);
+      }
+      r += m;
+    }
+    return r;
+  }
+
+ private:
+  int col_;
+  bool quantized_;
+  double offset_;
+  double scale_;
+  std::shared_ptr<parquet::ColumnReader> reader_;
+  std::vector<int32_t> buf_;
+};
+
+// A [begin, end) range of rows of a row group
+typedef std::pair<int64_t, int64_t> RowRange;
+
+// Return the row ranges of the data pages of a column chunk whose [min, max]
+// as converted by value intersects [lo, hi], using the page index. Returns
+// false if the column chunk has no page index.
+template <typename ValueFn>
+bool SelectPages(parquet::RowGroupPageIndexReader* index, int col,
+                 int64_t rows, double lo, double hi, ValueFn value,
+                 std::vector<RowRange>* ranges) {
+  const std::shared_ptr<parquet::ColumnIndex> ci = index->GetColumnIndex(col);
+  const std::shared_ptr<parquet::OffsetIndex> oi = index->GetOffsetIndex(col);
+  if (!ci || !oi) {
+    return false;
+  }
+  std::vector<double> min;
+  std::vector<double> max;
+  if (const parquet::FloatColumnIndex* f =
+          dynamic_cast<const parquet::FloatColumnIndex*>(ci.get())) {
+    min.assign(f->min_values().begin(), f->min_values().end());
+    max.assign(f->max_values().begin(), f->max_values().end());
+  } else if (const parquet::Int32ColumnIndex* i =
+                 dynamic_cast<const parquet::Int32ColumnIndex*>(ci.get())) {
+    min.assign(i->min_values().begin(), i->min_values().end());
+    max.assign(i->max_values().begin(), i->max_values().end());
+  } else {
+    return false;
+  }
+  const std::vector<parquet::PageLocation>& pages = oi->page_locations();
+  const std::vector<bool>& null_pages = ci->null_pages();
+  if (min.size() != pages.size() || null_pages.size() != pages.size()) {
+    return false;
+  }
+  ranges->clear();
+  for (size_t p = 0; p < pages.size(); p++) {
+    if (null_pages[p] || value(max[p]) < lo || value(min[p]) > hi) {
+      continue;
+    }
+    const int64_t begin = pages[p].first_row_index;
+    const int64_t end =
+        p + 1 < pages.size() ? pages[p + 1].first_row_index : rows;
+    if (!ranges->empty() && ranges->back().second == begin) {
+      ranges->back().second = end;
+    } else {
+      ranges->push_back(RowRange(begin, end));
+    }
+  }
+  return true;
+}
+
+// Return true if the data pages of a column chunk hold the values as is
+bool IsPlainUncompressed(const parquet::ColumnChunkMetaData& cc) {
+  if (cc.compression() != parquet::Compression::UNCOMPRESSED ||
+      cc.has_dictionary_page()) {
+    return false;
+  }
+  for (parquet::Encoding::type e : cc.encodings()) {
+    // RLE and BIT_PACKED are only listed for the (empty) levels
+    if (e != parquet::Encoding::PLAIN && e != parquet::Encoding::RLE &&
+        e != parquet::Encoding::BIT_PACKED) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Load the zone map referenced by a file. Returns false if there is none.
+bool LoadZoneMap(const parquet::FileMetaData& md, const std::string& path,
+                 ZoneMap* zm) {
+  const std::string zmfile = KeyValue(md, "zonemap");
+  if (zmfile.empty()) {
+    return false;
+  }
+  const size_t slash = path.rfind('/');
+  ReadZoneMap(
+      slash == std::string::npos ? zmfile : path.substr(0, slash + 1) + zmfile,
+      zm);
+  return true;
+}
+
+// The data pages of a column chunk that overlap some row ranges, as listed by
+// the offset index. All pages are selected without offset index.
+class PageSelection {
+ public:
+  // ranges is a sorted list of disjoint row ranges of a row group of rows rows
+  PageSelection(const parquet::OffsetIndex* oi, int64_t rows,
+                const std::vector<RowRange>& ranges)
+      : pages_(0), rows_(0) {
+    if (!oi) {
+      selected_.push_back(RowRange(0, rows));
+      rows_ = rows;
+      return;
+    }
+    const std::vector<parquet::PageLocation>& pages = oi->page_locations();
+    size_t r = 0;
+    for (size_t p = 0; p < pages.size(); p++) {
+      const int64_t begin = pages[p].first_row_index;
+      const int64_t end =
+          p + 1 < pages.size() ? pages[p + 1].first_row_index : rows;
+      while (r < ranges.size() && ranges[r].second <= begin) {
+        r++;
+      }
+      const bool keep = r < ranges.size() && ranges[r].first < end;
+      skip_.push_back(!keep);
+      if (!keep) {
+        continue;
+      }
+      if (!selected_.empty() && selected_.back().second == begin) {
+        selected_.back().second = end;
+      } else {
+        selected_.push_back(RowRange(begin, end));
+      }
+      pages_++;
+      rows_ += end - begin;
+    }
+  }
+
+  // Number of selected pages out of all the pages, which are 0 without
+  // offset index, and number of rows of the selected pages
+  int pages() const { return pages_; }
+  int pages_total() const { return int(skip_.size()); }
+  int64_t rows() const { return rows_; }
+
+  // Number of values of the selected pages before row, which is where a
+  // reader opened by Open is at row
+  int64_t Position(int64_t row) const {
+    int64_t n = 0;
+    for (const RowRange& range : selected_) {
+      if (range.first >= row) {
+        break;
+      }
+      n += std::min(range.second, row) - range.first;
+    }
+    return n;
+  }
+
+  // Open a reader of column col of a row group that returns the values of
+  // the selected pages only. Other data pages are passed over before they
+  // are decompressed or decoded.
+  std::shared_ptr<parquet::ColumnReader> Open(parquet::RowGroupReader* rg,
+                                              int col) const {
+    std::unique_ptr<parquet::PageReader> pager = rg->GetColumnPageReader(col);
+    if (pages_ < pages_total()) {
+      pager->set_data_page_filter(
+          [skip = skip_, page = size_t(0)](
+              const parquet::DataPageStats&) mutable {
+            const bool s = page < skip.size() && skip[page];
+            page++;
+            return s;
+          });
+    }
+    return parquet::ColumnReader::Make(rg->metadata()->schema()->Column(col),
+                                       std::move(pager));
+  }
+
+ private:
+  std::vector<bool> skip_;
+  std::vector<RowRange> selected_;
+  int pages_;
+  int64_t rows_;
+};
+
+// Add the pages and rows decoded through some page selections of a row
+// group to stats. Rows are counted in the column that decodes the most.
+void AddReads(const std::vector<PageSelection>& selections,
+              ReadStats* stats) {
+  int64_t rows = 0;
+  for (const PageSelection& s : selections) {
+    stats->pages_read += s.pages();
+    stats->pages_total += s.pages_total();
+    rows = std::max(rows, s.rows());
+  }
+  stats->rows_read += rows;
+}
+
+// Intersect two sorted lists of disjoint row ranges
+std::vector<RowRange> Intersect(const std::vector<RowRange>& a,
+                                const std::vector<RowRange>& b) {
+  std::vector<RowRange> out;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < a.size() && j < b.size()) {
+    const int64_t begin = std::max(a[i].first, b[j].first);
+    const int64_t end = std::min(a[i].second, b[j].second);
+    if (begin < end) {
+      out.push_back(RowRange(begin, end));
+    }
+    if (a[i].second < b[j].second) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+void ReadZoneMap(const std::string& path, ZoneMap* zm) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    throw parquet::ParquetException("Fail to open zone map ", path, ": ",
+                                    strerror(errno));
+  }
+  zm->columns.clear();
+  zm->entries.clear();
+  char* line = nullptr;
+  size_t cap = 0;
+  // Header: rowgroup i0 i1 j0 j1 k0 k1 <col>_min <col>_max ...
+  if (getline(&line, &cap, f) == -1) {
+    free(line);
+    fclose(f);
+    throw parquet::ParquetException("Empty zone map ", path);
+  }
+  const std::vector<std::string> header = SplitTabs(line);
+  for (size_t i = 7; i + 1 < header.size(); i += 2) {
+    if (!StringEndWith(header[i], "_min")) {
+      break;
+    }
+    zm->columns.push_back(header[i].substr(0, header[i].size() - 4));
+  }
+  while (getline(&line, &cap, f) != -1) {
+    const std::vector<std::string> fields = SplitTabs(line);
+    if (fields.size() != 7 + 2 * zm->columns.size()) {
+      free(line);
+      fclose(f);
+      throw parquet::ParquetException("Malformed zone map ", path);
+    }
+    ZoneMapEntry e;
+    e.rowgroup = atoi(fields[0].c_str());
+    for (int d = 0; d < 3; d++) {
+      e.box.lo[d] = atoi(fields[1 + 2 * d].c_str());
+      e.box.hi[d] = atoi(fields[2 + 2 * d].c_str());
+    }
+    for (size_t c = 0; c < zm->columns.size(); c++) {
+      e.min.push_back(strtod(fields[7 + 2 * c].c_str(), nullptr));
+      e.max.push_back(strtod(fields[8 + 2 * c].c_str(), nullptr));
+    }
+    zm->entries.push_back(e);
+  }
+  free(line);
+  fclose(f);
+}
+
+void QueryCells(const std::string& path, const CellQuery& query,
+                CellQueryResult* result) {
+  std::unique_ptr<parquet::ParquetFileReader> reader =
+      parquet::ParquetFileReader::OpenFile(path);
+  const std::shared_ptr<parquet::FileMetaData> md = reader->metadata();
+  int ext[6];
+  ReadExtent(*md, path, ext);
+  const int nx = ext[1] - ext[0] + 1;
+  const int ny = ext[3] - ext[2] + 1;
+  const int rowid_col = md->schema()->ColumnIndex("rowid");
+  if (rowid_col < 0) {
+    throw parquet::ParquetException("Missing column rowid in ", path);
+  }
+
+  result->rowids.clear();
+  result->values.clear();
+  result->rowgroups_read = 0;
+  result->rowgroups_total = md->num_row_groups();
+  result->rows_read = 0;
+  result->rows_total = md->num_rows();
+  result->pages_read = 0;
+  result->pages_total = 0;
+
+  // Predicted columns can only be decoded as a whole. Such files are always
+  // dense and in natural order.
+  if (!KeyValue(*md, "predictor").empty()) {
+    std::vector<float> values;
+    ReadPredictedColumn(reader.get(), path, query.column, &values);
+    for (int id = 0; id < int(values.size()); id++) {
+      if (values[id] > query.threshold &&
+          query.box.Contains(ext[0] + id % nx, ext[2] + id / nx % ny,
+                             ext[4] + id / nx / ny)) {
+        result->rowids.push_back(id);
+        result->values.push_back(values[id]);
+      }
+    }
+    result->rowgroups_read = result->rowgroups_total;
+    result->rows_read = result->rows_total;
+    return;
+  }
+
+  ValueReader value_reader(*md, query.column);
+
+  std::vector<int> rowgroups;
+  ZoneMap zm;
+  if (LoadZoneMap(*md, path, &zm)) {
+    const int c = zm.ColumnIndex(query.column);
+    for (const ZoneMapEntry& e : zm.entries) {
+      if (e.box.Intersects(query.box) &&
+          (c < 0 || e.max[c] > query.threshold)) {
+        rowgroups.push_back(e.rowgroup);
+      }
+    }
+  } else {
+    for (int g = 0; g < md->num_row_groups(); g++) {
+      rowgroups.push_back(g);
+    }
+  }
+
+  // Rowids of the cells of the box, clamped to the extent, span the
+  // interval [idlo, idhi] in natural order
+  int lo[3];
+  int hi[3];
+  for (int d = 0; d < 3; d++) {
+    lo[d] = std::max(query.box.lo[d], ext[2 * d]) - ext[2 * d];
+    hi[d] = std::min(query.box.hi[d], ext[2 * d + 1]) - ext[2 * d];
+  }
+  const double idlo = lo[0] + double(nx) * (lo[1] + double(ny) * lo[2]);
+  const double idhi = hi[0] + double(nx) * (hi[1] + double(ny) * hi[2]);
+  // Pages are kept when their max is above the threshold
+  const double vlo = std::nextafter(query.threshold, INFINITY);
+  std::shared_ptr<parquet::PageIndexReader> page_index;
+  if (query.page_index) {
+    page_index = reader->GetPageIndexReader();
+  }
+
+  const int64_t kBatchSize = 64 * 1024;
+  std::vector<int32_t> rowids(kBatchSize);
+  std::vector<float> values(kBatchSize);
+  for (int g : rowgroups) {
+    const int64_t rows = md->RowGroup(g)->num_rows();
+    std::vector<RowRange> ranges(1, RowRange(0, rows));
+    std::shared_ptr<parquet::RowGroupPageIndexReader> index =
+        page_index ? page_index->RowGroup(g) : nullptr;
+    if (index) {
+      std::vector<RowRange> by_value;
+      std::vector<RowRange> by_rowid;
+      if (SelectPages(
+              index.get(), value_reader.column(), rows, vlo, INFINITY,
+              [&](double v) { return value_reader.Value(v); }, &by_value)) {
+        ranges = Intersect(ranges, by_value);
+      }
+      if (SelectPages(
+              index.get(), rowid_col, rows, idlo, idhi,
+              [](double v) { return v; }, &by_rowid)) {
+        ranges = Intersect(ranges, by_rowid);
+      }
+    }
+    if (ranges.empty()) {
+      continue;
+    }
+    // Only the pages overlapping the ranges are read. Skips within them are
+    // counted in values of these pages.
+    std::vector<PageSelection> pages;
+    for (int col : {rowid_col, value_reader.column()}) {
+      pages.push_back(PageSelection(
+          index ? index->GetOffsetIndex(col).get() : nullptr, rows, ranges));
+    }
+    std::shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(g);
+    std::shared_ptr<parquet::Int32Reader> rowid_reader =
+        std::static_pointer_cast<parquet::Int32Reader>(
+            pages[0].Open(rg.get(), rowid_col));
+    value_reader.Open(pages[1].Open(rg.get(), value_reader.column()));
+    int64_t pos = 0;
+    for (const RowRange& range : ranges) {
+      const int64_t rowid_skip =
+          pages[0].Position(range.first) - pages[0].Position(pos);
+      const int64_t value_skip =
+          pages[1].Position(range.first) - pages[1].Position(pos);
+      if (rowid_reader->Skip(rowid_skip) != rowid_skip ||
+          value_reader.Skip(value_skip) != value_skip) {
+        throw parquet::ParquetException("Column length mismatch in ", path);
+      }
+      pos = range.first;
+      while (pos < range.second) {
+        int64_t n = 0;
+        rowid_reader->ReadBatch(std::min(kBatchSize, range.second - pos),
+                                nullptr, nullptr, rowids.data(), &n);
+        if (n == 0 || value_reader.Read(n, values.data()) != n) {
+          throw parquet::ParquetException("Column length mismatch in ", path);
+        }
+        for (int64_t r = 0; r < n; r++) {
+          const int32_t id = rowids[r];
+          if (values[r] > query.threshold &&
+              query.box.Contains(ext[0] + id % nx, ext[2] + id / nx % ny,
+                                 ext[4] + id / nx / ny)) {
+            result->rowids.push_back(id);
+            result->values.push_back(values[r]);
+          }
+        }
+        pos += n;
+      }
+    }
+    AddReads(pages, result);
+    result->rowgroups_read++;
+  }
+}
+
+void ReadColumn(const std::string& path, const std::string& column,
+                std::vector<float>* values) {
+  std::unique_ptr<parquet::ParquetFileReader> reader =
+      parquet::ParquetFileReader::OpenFile(path);
+  const std::shared_ptr<parquet::FileMetaData> md = reader->metadata();
+  if (!KeyValue(*md, "predictor").empty()) {
+    ReadPredictedColumn(reader.get(), path, column, values);
+    return;
+  }
+  ValueReader value_reader(*md, column);
+  values->resize(md->num_rows());
+  int64_t r = 0;
+  for (int g = 0; g < md->num_row_groups(); g++) {
+    std::shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(g);
+    value_reader.Open(rg.get());
+    const int64_t n = md->RowGroup(g)->num_rows();
+    if (r + n > int64_t(values->size()) ||
+        value_reader.Read(n, values->data() + r) != n) {
+      throw parquet::ParquetException("Short column ", column, " in ", path);
+    }
+    r += n;
+  }
+}
+
+void ReadTimestep(const std::string& path, int timestep,
+                  const std::string& column, std::vector<float>* values) {
+  std::unique_ptr<parquet::ParquetFileReader> reader =
+      parquet::ParquetFileReader::OpenFile(path);
+  const std::shared_ptr<parquet::FileMetaData> md = reader->metadata();
+  const int timestep_col = md->schema()->ColumnIndex("timestep");
+  const int rowid_col = md->schema()->ColumnIndex("rowid");
+  if (timestep_col < 0 || rowid_col < 0) {
+    throw parquet::ParquetException("Missing timestep or rowid in ", path);
+  }
+  // Replay all timesteps from the keyframe on
+  int first = timestep;
+  const std::string interval = KeyValue(*md, "keyframe_interval");
+  if (!interval.empty()) {
+    const int k = atoi(interval.c_str());
+    std::vector<int> timesteps;
+    std::string list = KeyValue(*md, "timesteps");
+    char* save;
+    for (char* tok = strtok_r(&list[0], ",", &save); tok;
+         tok = strtok_r(nullptr, ",", &save)) {
+      timesteps.push_back(atoi(tok));
+    }
+    const std::vector<int>::const_iterator it =
+        std::find(timesteps.begin(), timesteps.end(), timestep);
+    if (k <= 0 || it == timesteps.end()) {
+      throw parquet::ParquetException("No timestep ", timestep, " in ", path);
+    }
+    const int i = int(it - timesteps.begin());
+    first = timesteps[i - i % k];
+  }
+
+  // One value per cell of the grid or of the region of interest of the
+  // timestep. Files written before the cell count was recorded are sized
+  // by the largest rowid read.
+  int64_t cells = 0;
+  const std::string roi_extent =
+      KeyValue(*md, ("roi_extent_" + std::to_string(timestep)).c_str());
+  Box box;
+  if (!roi_extent.empty() && ParseBox(roi_extent.c_str(), &box)) {
+    cells = int64_t(box.hi[0] - box.lo[0] + 1) * (box.hi[1] - box.lo[1] + 1) *
+            (box.hi[2] - box.lo[2] + 1);
+  } else {
+    cells = atoll(KeyValue(*md, "cells").c_str());
+  }
+  values->assign(cells, 0);
+  ValueReader value_reader(*md, column);
+  const int64_t kBatchSize = 64 * 1024;
+  std::vector<int32_t> steps(kBatchSize);
+  std::vector<int32_t> rowids(kBatchSize);
+  std::vector<float> batch(kBatchSize);
+  for (int g = 0; g < md->num_row_groups(); g++) {
+    // Every timestep is written as its own row group
+    std::shared_ptr<parquet::Statistics> stats =
+        md->RowGroup(g)->ColumnChunk(timestep_col)->statistics();
+    if (stats && stats->HasMinMax()) {
+      const parquet::Int32Statistics* s =
+          static_cast<const parquet::Int32Statistics*>(stats.get());
+      if (s->max() < first || s->min() > timestep) {
+        continue;
+      }
+    }
+    std::shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(g);
+    std::shared_ptr<parquet::Int32Reader> step_reader =
+        std::static_pointer_cast<parquet::Int32Reader>(
+            rg->Column(timestep_col));
+    std::shared_ptr<parquet::Int32Reader> rowid_reader =
+        std::static_pointer_cast<parquet::Int32Reader>(rg->Column(rowid_col));
+    value_reader.Open(rg.get());
+    while (rowid_reader->HasNext()) {
+      int64_t n = 0;
+      int64_t m = 0;
+      rowid_reader->ReadBatch(kBatchSize, nullptr, nullptr, rowids.data(), &n);
+      while (m < n && step_reader->HasNext()) {
+        int64_t k = 0;
+        step_reader->ReadBatch(n - m, nullptr, nullptr, steps.data() + m, &k);
+        m += k;
+      }
+      if (m != n || value_reader.Read(n, batch.data()) != n) {
+        throw parquet::ParquetException("Column length mismatch in ", path);
+      }
+      for (int64_t r = 0; r < n; r++) {
+        if (steps[r] < first || steps[r] > timestep) {
+          continue;
+        }
+        if (rowids[r] >= int32_t(values->size())) {
+          values->resize(rowids[r] + 1, 0);
+        }
+        (*values)[rowids[r]] = batch[r];
+      }
+    }
+  }
+}
+
+bool ParsePhysicalBox(const char* str, BoxQuery* query) {
+  int n = 0;
+  if (sscanf(str, "%lf:%lf,%lf:%lf,%lf:%lf%n", &query->lo[0], &query->hi[0],
+             &query->lo[1], &query->hi[1], &query->lo[2], &query->hi[2],
+             &n) != 6 ||
+      str[n] != '\0') {
+    return false;
+  }
+  for (int d = 0; d < 3; d++) {
+    if (query->lo[d] > query->hi[d]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void QueryBox(const std::string& path, const BoxQuery& query,
+              BoxQueryResult* result) {
+  std::unique_ptr<parquet::ParquetFileReader> reader =
+      parquet::ParquetFileReader::OpenFile(path);
+  const std::shared_ptr<parquet::FileMetaData> md = reader->metadata();
+  int ext[6];
+  ReadExtent(*md, path, ext);
+  const int nx = ext[1] - ext[0] + 1;
+  const int ny = ext[3] - ext[2] + 1;
+  const int rowid_col = md->schema()->ColumnIndex("rowid");
+  if (rowid_col < 0) {
+    throw parquet::ParquetException("Missing column rowid in ", path);
+  }
+
+  result->values.assign(query.columns.size(), std::vector<float>());
+  result->rowgroups_read = 0;
+  result->rowgroups_total = md->num_row_groups();
+  result->rows_read = 0;
+  result->rows_total = md->num_rows();
+  result->pages_read = 0;
+  result->pages_total = 0;
+  // Select all points inside the box, like xrage::RoiToExtent
+  Box& box = result->box;
+  for (int d = 0; d < 3; d++) {
+    const std::string suffix = std::to_string(d);
+    const std::string o = KeyValue(*md, ("origin_" + suffix).c_str());
+    const std::string h = KeyValue(*md, ("spacing_" + suffix).c_str());
+    if (o.empty() || h.empty()) {
+      throw parquet::ParquetException("Missing origin or spacing in ", path);
+    }
+    const double origin = strtod(o.c_str(), nullptr);
+    const double spacing = strtod(h.c_str(), nullptr);
+    double lo, hi;
+    PhysicalToIndex(query.lo[d], query.hi[d], origin, spacing, &lo, &hi);
+    box.lo[d] = int(std::max<double>(lo, ext[2 * d]));
+    box.hi[d] = int(std::min<double>(hi, ext[2 * d + 1]));
+    if (box.lo[d] > box.hi[d]) {
+      return;
+    }
+  }
+  const int bx = box.hi[0] - box.lo[0] + 1;
+  const int by = box.hi[1] - box.lo[1] + 1;
+  const int bz = box.hi[2] - box.lo[2] + 1;
+  for (std::vector<float>& v : result->values) {
+    v.assign(int64_t(bx) * by * bz, 0);
+  }
+  // Rowid of the first point of line (j, k) of the box
+  auto line_start = [&](int j, int k) {
+    return (box.lo[0] - ext[0]) +
+           int64_t(nx) * ((j - ext[2]) + int64_t(ny) * (k - ext[4]));
+  };
+  // Position of a rowid in the result buffers, or -1 if outside of the box
+  auto slot = [&](int64_t id) -> int64_t {
+    const int i = ext[0] + int(id % nx);
+    const int j = ext[2] + int(id / nx % ny);
+    const int k = ext[4] + int(id / nx / ny);
+    if (!box.Contains(i, j, k)) {
+      return -1;
+    }
+    return (i - box.lo[0]) +
+           int64_t(bx) * ((j - box.lo[1]) + int64_t(by) * (k - box.lo[2]));
+  };
+
+  // Predicted columns can only be decoded as a whole. Such files are always
+  // dense and in natural order.
+  if (!KeyValue(*md, "predictor").empty()) {
+    std::vector<float> values;
+    for (size_t c = 0; c < query.columns.size(); c++) {
+      ReadPredictedColumn(reader.get(), path, query.columns[c], &values);
+      float* out = result->values[c].data();
+      for (int k = box.lo[2]; k <= box.hi[2]; k++) {
+        for (int j = box.lo[1]; j <= box.hi[1]; j++) {
+          out = std::copy_n(values.data() + line_start(j, k), bx, out);
+        }
+      }
+    }
+    result->rowgroups_read = result->rowgroups_total;
+    result->rows_read = result->rows_total;
+    return;
+  }
+
+  std::vector<ValueReader> value_readers;
+  for (const std::string& column : query.columns) {
+    value_readers.push_back(ValueReader(*md, column));
+  }
+  // In dense files in natural order the rowid of a cell is its row
+  const bool natural =
+      KeyValue(*md, "layout").empty() && KeyValue(*md, "sparse").empty();
+  const double idlo = double(line_start(box.lo[1], box.lo[2]));
+  const double idhi = double(line_start(box.hi[1], box.hi[2]) + bx - 1);
+
+  std::vector<int> rowgroups;
+  ZoneMap zm;
+  if (!query.prune) {
+    for (int g = 0; g < md->num_row_groups(); g++) {
+      rowgroups.push_back(g);
+    }
+  } else if (LoadZoneMap(*md, path, &zm)) {
+    for (const ZoneMapEntry& e : zm.entries) {
+      if (e.box.Intersects(box)) {
+        rowgroups.push_back(e.rowgroup);
+      }
+    }
+    std::sort(rowgroups.begin(), rowgroups.end());
+  } else {
+    for (int g = 0; g < md->num_row_groups(); g++) {
+      std::shared_ptr<parquet::Statistics> stats =
+          md->RowGroup(g)->ColumnChunk(rowid_col)->statistics();
+      if (stats && stats->HasMinMax()) {
+        const parquet::Int32Statistics* s =
+            static_cast<const parquet::Int32Statistics*>(stats.get());
+        if (s->max() < idlo || s->min() > idhi) {
+          continue;
+        }
+      }
+      rowgroups.push_back(g);
+    }
+  }
+  std::vector<int64_t> first_rows(md->num_row_groups() + 1, 0);
+  for (int g = 0; g < md->num_row_groups(); g++) {
+    first_rows[g + 1] = first_rows[g] + md->RowGroup(g)->num_rows();
+  }
+  std::shared_ptr<parquet::PageIndexReader> page_index =
+      reader->GetPageIndexReader();
+
+  const int64_t kBatchSize = 64 * 1024;
+  std::vector<int32_t> rowids(kBatchSize);
+  std::vector<float> values(kBatchSize);
+  for (int g : rowgroups) {
+    const int64_t start = first_rows[g];
+    const int64_t rows = first_rows[g + 1] - start;
+    std::vector<RowRange> ranges;
+    std::shared_ptr<parquet::RowGroupPageIndexReader> index =
+        page_index ? page_index->RowGroup(g) : nullptr;
+    if (!query.prune) {
+      ranges.push_back(RowRange(0, rows));
+    } else if (natural) {
+      // One range per line of the box, merged when lines are adjacent
+      for (int k = box.lo[2]; k <= box.hi[2]; k++) {
+        for (int j = box.lo[1]; j <= box.hi[1]; j++) {
+          const int64_t begin = std::max(line_start(j, k) - start, int64_t(0));
+          const int64_t end = std::min(line_start(j, k) + bx - start, rows);
+          if (begin >= end) {
+            continue;
+          }
+          if (!ranges.empty() && ranges.back().second == begin) {
+            ranges.back().second = end;
+          } else {
+            ranges.push_back(RowRange(begin, end));
+          }
+        }
+      }
+    } else {
+      ranges.push_back(RowRange(0, rows));
+      std::vector<RowRange> by_rowid;
+      if (index && SelectPages(
+                       index.get(), rowid_col, rows, idlo, idhi,
+                       [](double v) { return v; }, &by_rowid)) {
+        ranges = Intersect(ranges, by_rowid);
+      }
+    }
+    if (ranges.empty()) {
+      continue;
+    }
+    // Only the pages overlapping the ranges are read, the rowid ones last.
+    // Skips within them are counted in values of these pages.
+    std::vector<PageSelection> pages;
+    for (const ValueReader& value_reader : value_readers) {
+      const int col = value_reader.column();
+      pages.push_back(PageSelection(
+          index ? index->GetOffsetIndex(col).get() : nullptr, rows, ranges));
+    }
+    if (!natural) {
+      pages.push_back(PageSelection(
+          index ? index->GetOffsetIndex(rowid_col).get() : nullptr, rows,
+          ranges));
+    }
+    std::shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(g);
+    std::shared_ptr<parquet::Int32Reader> rowid_reader;
+    if (!natural) {
+      rowid_reader = std::static_pointer_cast<parquet::Int32Reader>(
+          pages.back().Open(rg.get(), rowid_col));
+    }
+    for (size_t c = 0; c < value_readers.size(); c++) {
+      value_readers[c].Open(
+          pages[c].Open(rg.get(), value_readers[c].column()));
+    }
+    int64_t pos = 0;
+    for (const RowRange& range : ranges) {
+      bool ok = true;
+      for (size_t c = 0; c < pages.size(); c++) {
+        const int64_t skip =
+            pages[c].Position(range.first) - pages[c].Position(pos);
+        ok = ok && (c < value_readers.size()
+                        ? value_readers[c].Skip(skip)
+                        : rowid_reader->Skip(skip)) == skip;
+      }
+      if (!ok) {
+        throw parquet::ParquetException("Column length mismatch in ", path);
+      }
+      pos = range.first;
+      while (pos < range.second) {
+        int64_t n = std::min(kBatchSize, range.second - pos);
+        if (rowid_reader) {
+          rowid_reader->ReadBatch(n, nullptr, nullptr, rowids.data(), &n);
+        } else {
+          for (int64_t r = 0; r < n; r++) {
+            rowids[r] = int32_t(start + pos + r);
+          }
+        }
+        if (n == 0) {
+          throw parquet::ParquetException("Column length mismatch in ", path);
+        }
+        for (size_t c = 0; c < value_readers.size(); c++) {
+          if (value_readers[c].Read(n, values.data()) != n) {
+            throw parquet::ParquetException("Column length mismatch in ",
+                                            path);
+          }
+          float* out = result->values[c].data();
+          for (int64_t r = 0; r < n; r++) {
+            const int64_t s = slot(rowids[r]);
+            if (s >= 0) {
+              out[s] = values[r];
+            }
+          }
+        }
+        pos += n;
+      }
+    }
+    AddReads(pages, result);
+    result->rowgroups_read++;
+  }
+}
+
+std::string FindTimestep(const std::string& dir, int timestep) {
+  DIR* const d = opendir(dir.c_str());
+  if (!d) {
+    throw parquet::ParquetException("Fail to open dir ", dir, ": ",
+                                    strerror(errno));
+  }
+  std::string found;
+  const std::string cycle = std::to_string(timestep);
+  for (struct dirent* entry = readdir(d); entry && found.empty();
+       entry = readdir(d)) {
+    const std::string f = entry->d_name;
+    if ((entry->d_type != DT_REG && entry->d_type != DT_LNK) ||
+        !StringEndWith(f, ".parquet")) {
+      continue;
+    }
+    const std::string path = dir + '/' + f;
+    std::unique_ptr<parquet::ParquetFileReader> reader =
+        parquet::ParquetFileReader::OpenFile(path);
+    if (KeyValue(*reader->metadata(), "cycle_index") == cycle) {
+      found = path;
+    }
+  }
+  closedir(d);
+  if (found.empty()) {
+    throw parquet::ParquetException("No timestep ", timestep, " in ", dir);
+  }
+  return found;
+}
+
+class ColumnScanner::Impl {
+ public:
+  Impl(const std::string& path, const std::string& column, bool zero_copy)
+      : path_(path),
+        column_(column),
+        zero_copy_(zero_copy),
+        next_rowgroup_(0),
+        remaining_(0),
+        mapped_(0),
+        copied_(0),
+        decoded_(0) {
+    std::shared_ptr<arrow::io::MemoryMappedFile> file;
+    PARQUET_ASSIGN_OR_THROW(file, arrow::io::MemoryMappedFile::Open(
+                                      path, arrow::io::FileMode::READ));
+    // Uncompressed pages read from a memory-mapped file are slices of the
+    // map
+    reader_ = parquet::ParquetFileReader::Open(file);
+    md_ = reader_->metadata();
+    col_ = md_->schema()->ColumnIndex(column);
+    if (col_ < 0) {
+      throw parquet::ParquetException("Missing column ", column, " in ", path);
+    }
+    predicted_ = !KeyValue(*md_, "predictor").empty();
+    if (!predicted_) {
+      value_reader_.reset(new ValueReader(*md_, column));
+    }
+  }
+
+  FloatSpan Next() {
+    const int64_t kBatchSize = 64 * 1024;
+    for (;;) {
+      if (pages_) {
+        page_ = pages_->NextPage();
+        if (!page_) {
+          pages_.reset();
+          continue;
+        }
+        if (page_->type() != parquet::PageType::DATA_PAGE &&
+            page_->type() != parquet::PageType::DATA_PAGE_V2) {
+          continue;
+        }
+        const parquet::DataPage* page =
+            static_cast<const parquet::DataPage*>(page_.get());
+        const int64_t n = page->num_values();
+        const int64_t bytes = n * int64_t(sizeof(float));
+        if (page->encoding() != parquet::Encoding::PLAIN ||
+            page->size() < bytes) {
+          throw parquet::ParquetException("Unexpected page of ", column_,
+                                          " in ", path_);
+        }
+        if (n == 0) {
+          continue;
+        }
+        // Values follow the (empty) levels
+        const uint8_t* data = page->data() + page->size() - bytes;
+        if (reinterpret_cast<uintptr_t>(data) % alignof(float) != 0) {
+          // Page data follows a variable-length page header, so it is often
+          // misaligned and has to be copied to be read as floats
+          buf_.resize(n);
+          memcpy(buf_.data(), data, bytes);
+          copied_ += n;
+          return FloatSpan(buf_.data(), n);
+        }
+        mapped_ += n;
+        return FloatSpan(reinterpret_cast<const float*>(data), n);
+      }
+      if (remaining_ > 0) {
+        buf_.resize(std::min(kBatchSize, remaining_));
+        if (value_reader_->Read(buf_.size(), buf_.data()) !=
+            int64_t(buf_.size())) {
+          throw parquet::ParquetException("Short column ", column_, " in ",
+                                          path_);
+        }
+        remaining_ -= buf_.size();
+        decoded_ += buf_.size();
+        return FloatSpan(buf_.data(), buf_.size());
+      }
+      if (next_rowgroup_ >= md_->num_row_groups()) {
+        return FloatSpan();
+      }
+      if (predicted_) {
+        // Predicted columns can only be decoded as a whole
+        next_rowgroup_ = md_->num_row_groups();
+        ReadPredictedColumn(reader_.get(), path_, column_, &buf_);
+        decoded_ += buf_.size();
+        return FloatSpan(buf_.data(), buf_.size());
+      }
+      const int g = next_rowgroup_++;
+      std::shared_ptr<parquet::RowGroupReader> rg = reader_->RowGroup(g);
+      const parquet::ColumnDescriptor* descr = md_->schema()->Column(col_);
+      if (zero_copy_ && descr->physical_type() == parquet::Type::FLOAT &&
+          descr->max_definition_level() == 0 &&
+          descr->max_repetition_level() == 0 &&
+          IsPlainUncompressed(*md_->RowGroup(g)->ColumnChunk(col_))) {
+        pages_ = rg->GetColumnPageReader(col_);
+      } else {
+        value_reader_->Open(rg.get());
+        remaining_ = md_->RowGroup(g)->num_rows();
+      }
+    }
+  }
+
+  int64_t mapped() const { return mapped_; }
+  int64_t copied() const { return copied_; }
+  int64_t decoded() const { return decoded_; }
+
+ private:
+  std::string path_;
+  std::string column_;
+  bool zero_copy_;
+  bool predicted_;
+  std::unique_ptr<parquet::ParquetFileReader> reader_;
+  std::shared_ptr<parquet::FileMetaData> md_;
+  int col_;
+  int next_rowgroup_;
+  // Pages of the current row group if it is mapped
+  std::unique_ptr<parquet::PageReader> pages_;
+  std::shared_ptr<parquet::Page> page_;
+  // Values left to decode of the current row group otherwise
+  std::unique_ptr<ValueReader> value_reader_;
+  int64_t remaining_;
+  std::vector<float> buf_;
+  int64_t mapped_;
+  int64_t copied_;
+  int64_t decoded_;
+};
+
+ColumnScanner::ColumnScanner(const std::string& path,
+                             const std::string& column, bool zero_copy)
+    : impl_(new Impl(path, column, zero_copy)) {}
+
+ColumnScanner::~ColumnScanner() {}
+
+FloatSpan ColumnScanner::Next() { return impl_->Next(); }
+
+int64_t ColumnScanner::mapped_values() const { return impl_->mapped(); }
+
+int64_t ColumnScanner::copied_values() const { return impl_->copied(); }
+
+int64_t ColumnScanner::decoded_values() const { return impl_->decoded(); }
+
+CellLookup::CellLookup(const std::string& path, const std::string& column)
+    : map_(nullptr), size_(0), rows_(0), rows_per_page_(0) {
+  {
+    std::unique_ptr<parquet::ParquetFileReader> reader =
+        parquet::ParquetFileReader::OpenFile(path);
+    const std::shared_ptr<parquet::FileMetaData> md = reader->metadata();
+    // Only the random-access profile guarantees that row r holds rowid r.
+    // Other files, e.g. the .N files of vti2pqtv2b or time series, may
+    // start at another rowid or repeat rowids.
+    if (KeyValue(*md, "random_access").empty() ||
+        !KeyValue(*md, "layout").empty() || !KeyValue(*md, "sparse").empty() ||
+        !KeyValue(*md, "predictor").empty()) {
+      throw parquet::ParquetException(
+          path, " is not written with the random-access profile");
+    }
+    const int rowid_col = md->schema()->ColumnIndex("rowid");
+    if (rowid_col < 0) {
+      throw parquet::ParquetException("Missing column rowid in ", path);
+    }
+    const int col = md->schema()->ColumnIndex(column);
+    if (col < 0) {
+      throw parquet::ParquetException("Missing column ", column, " in ", path);
+    }
+    const parquet::ColumnDescriptor* descr = md->schema()->Column(col);
+    if (descr->physical_type() != parquet::Type::FLOAT ||
+        descr->max_definition_level() != 0 ||
+        descr->max_repetition_level() != 0) {
+      throw parquet::ParquetException("Column ", column,
+                                      " does not store required floats");
+    }
+    std::shared_ptr<parquet::PageIndexReader> page_index =
+        reader->GetPageIndexReader();
+    for (int g = 0; g < md->num_row_groups(); g++) {
+      const std::unique_ptr<parquet::ColumnChunkMetaData> cc =
+          md->RowGroup(g)->ColumnChunk(col);
+      if (!IsPlainUncompressed(*cc)) {
+        throw parquet::ParquetException(
+            "Column ", column, " is not stored as uncompressed PLAIN pages");
+      }
+      std::shared_ptr<parquet::RowGroupPageIndexReader> index =
+          page_index ? page_index->RowGroup(g) : nullptr;
+      std::shared_ptr<parquet::OffsetIndex> oi =
+          index ? index->GetOffsetIndex(col) : nullptr;
+      if (!oi) {
+        throw parquet::ParquetException("Missing offset index of ", column,
+                                        " in ", path);
+      }
+      const int64_t rows = md->RowGroup(g)->num_rows();
+      // The rowids of a row group must be the positions of its rows
+      std::shared_ptr<parquet::Statistics> stats =
+          md->RowGroup(g)->ColumnChunk(rowid_col)->statistics();
+      if (rows > 0 && stats && stats->HasMinMax()) {
+        const parquet::Int32Statistics* s =
+            static_cast<const parquet::Int32Statistics*>(stats.get());
+        if (s->min() != rows_ || s->max() != rows_ + rows - 1) {
+          throw parquet::ParquetException("Rowids of row group ", g, " in ",
+                                          path, " are not row positions");
+        }
+      }
+      const std::vector<parquet::PageLocation>& pages = oi->page_locations();
+      for (size_t p = 0; p < pages.size(); p++) {
+        const int64_t end =
+            p + 1 < pages.size() ? pages[p + 1].first_row_index : rows;
+        // The values are the tail of the page, after the page header
+        first_rows_.push_back(rows_ + pages[p].first_row_index);
+        offsets_.push_back(pages[p].offset + pages[p].compressed_page_size -
+                           (end - pages[p].first_row_index) *
+                               int64_t(sizeof(float)));
+      }
+      rows_ += rows;
+    }
+  }
+  if (first_rows_.size() > 1) {
+    rows_per_page_ = first_rows_[1];
+    for (size_t p = 0; p < first_rows_.size(); p++) {
+      if (first_rows_[p] != int64_t(p) * rows_per_page_) {
+        rows_per_page_ = 0;
+        break;
+      }
+    }
+  } else if (first_rows_.size() == 1) {
+    rows_per_page_ = std::max<int64_t>(rows_, 1);
+  }
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    const int err = errno;
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw parquet::ParquetException("Fail to open ", path, ": ",
+                                    strerror(err));
+  }
+  size_ = st.st_size;
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw parquet::ParquetException("Fail to map ", path, ": ",
+                                    strerror(errno));
+  }
+  map_ = static_cast<const char*>(map);
+  for (size_t p = 0; p < offsets_.size(); p++) {
+    const int64_t end = p + 1 < first_rows_.size() ? first_rows_[p + 1] : rows_;
+    if (offsets_[p] < 0 ||
+        offsets_[p] + (end - first_rows_[p]) * int64_t(sizeof(float)) >
+            int64_t(size_)) {
+      munmap(const_cast<char*>(map_), size_);
+      throw parquet::ParquetException("Bad offset index of ", column, " in ",
+                                      path);
+    }
+  }
+}
+
+CellLookup::~CellLookup() {
+  if (map_) {
+    munmap(const_cast<char*>(map_), size_);
+  }
+}
+
+float CellLookup::Lookup(int64_t rowid) const {
+  if (rowid < 0 || rowid >= rows_) {
+    throw parquet::ParquetException("Rowid ", rowid, " out of range");
+  }
+  size_t p;
+  if (rows_per_page_ > 0) {
+    p = std::min<size_t>(rowid / rows_per_page_, first_rows_.size() - 1);
+  } else {
+    p = std::upper_bound(first_rows_.begin(), first_rows_.end(), rowid) -
+        first_rows_.begin() - 1;
+  }
+  float v;
+  memcpy(&v, map_ + offsets_[p] + (rowid - first_rows_[p]) * sizeof(float),
+         sizeof(float));
+  return v;
+}
+
+void CellLookup::LookupBatch(const int64_t* rowids, size_t n,
+                             float* out) const {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = Lookup(rowids[i]);
+  }
+}
+
+}  // namespace xrage
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace xrage {
+
+// An inclusive (i,j,k) index range expressed in extent coordinates
+struct Box {
+  int lo[3];
+  int hi[3];
+
+  bool Intersects(const Box& other) const;
+  bool Contains(int i, int j, int k) const;
+};
+
+// Parse a box in "i0:i1,j0:j1,k0:k1" form. Returns false on malformed input.
+bool ParseBox(const char* str, Box* box);
+
+// The bounding box and the min/max of every column of one row group
+struct ZoneMapEntry {
+  int rowgroup;
+  Box box;
+  std::vector<double> min;  // In ZoneMap::columns order
+  std::vector<double> max;
+};
+
+// Sidecar index written next to files that use a spatial layout (see the -l
+// option of vti2pqt). The file is referenced by the "zonemap" key of the
+// parquet key-value metadata.
+struct ZoneMap {
+  std::vector<std::string> columns;
+  std::vector<ZoneMapEntry> entries;
+
+  // Return the index of a column in columns, or -1 if not found
+  int ColumnIndex(const std::string& name) const;
+};
+
+// Load a zone map from its sidecar file. Throws parquet::ParquetException
+// on errors.
+void ReadZoneMap(const std::string& path, ZoneMap* zm);
+
+// How much of a file a query read. Pages are the data pages decoded out of
+// the data pages of the row groups read, and are only counted in row groups
+// with an offset index. Rows are the rows of the pages decoded, in the column
+// that decodes the most.
+struct ReadStats {
+  int rowgroups_read;
+  int rowgroups_total;
+  int64_t pages_read;
+  int64_t pages_total;
+  int64_t rows_read;
+  int64_t rows_total;
+};
+
+// Select all cells within box whose column value is greater than threshold.
+struct CellQuery {
+  Box box;
+  std::string column;
+  float threshold;
+  // Skip data pages using the page index when the file has one (see the -P
+  // option of the converters)
+  bool page_index;
+};
+
+struct CellQueryResult : ReadStats {
+  std::vector<int32_t> rowids;
+  std::vector<float> values;
+};
+
+// Run a cell query against a parquet file written by vti2pqt. Row groups are
+// pruned using the zone map referenced by the file when one exists.
+// Otherwise all row groups are scanned. Within a row group, pages whose
+// value max is not above the threshold or whose rowids lie outside of the
+// box are skipped without being decompressed or decoded when the file has a
+// page index. Throws parquet::ParquetException on errors.
+void QueryCells(const std::string& path, const CellQuery& query,
+                CellQueryResult* result);
+
+// Read all values of a value column of a parquet file written by vti2pqt,
+// in file order. Columns stored as quantized integers (see the -q option of
+// vti2pqt) are converted back to floats using the scale and offset recorded
+// in the file metadata. Columns stored as prediction residuals (see the -p
+// option of vti2pqt) are decoded. Throws parquet::ParquetException on
+// errors.
+void ReadColumn(const std::string& path, const std::string& column,
+                std::vector<float>* values);
+
+// Reconstruct the values of a column at one timestep of a merged time
+// series written by vti2pqtv2a, indexed by rowid. There is one value per
+// cell of the grid, or of the region of interest of the timestep, as
+// recorded in the file. Cells missing from the file are 0. Files written
+// with keyframes (see the -K option of vti2pqtv2a) are replayed from the
+// nearest keyframe at or before the timestep. Throws
+// parquet::ParquetException on errors.
+void ReadTimestep(const std::string& path, int timestep,
+                  const std::string& column, std::vector<float>* values);
+
+// Select the values of some columns at all grid points inside a box given
+// in physical coordinates
+struct BoxQuery {
+  double lo[3];
+  double hi[3];
+  std::vector<std::string> columns;
+  // Read only the row groups, pages and rows that can hold points of the
+  // box. Otherwise the whole file is scanned.
+  bool prune;
+};
+
+struct BoxQueryResult : ReadStats {
+  // Index box of the selected points, clipped to the grid. lo > hi if the
+  // query box misses the grid.
+  Box box;
+  // One buffer per column in BoxQuery::columns order, holding the values of
+  // all points of box with i varying fastest, then j, then k. Points absent
+  // from sparse files are 0.
+  std::vector<std::vector<float>> values;
+};
+
+// Parse a physical box in "x0:x1,y0:y1,z0:z1" form. Returns false on
+// malformed input.
+bool ParsePhysicalBox(const char* str, BoxQuery* query);
+
+// Run a box query against a parquet file written by vti2pqt. The box is
+// mapped to grid indices using the origin_* and spacing_* metadata, the
+// same way as the -R option of vti2pqt does. Row groups are pruned with
+// the zone map or the rowid statistics. In natural order dense files only
+// the rows of the box are read, otherwise only the pages whose rowids
+// overlap the box when the file has a page index. With a page index, the
+// pages holding none of these rows are not decompressed or decoded. Throws
+// parquet::ParquetException on errors.
+void QueryBox(const std::string& path, const BoxQuery& query,
+              BoxQueryResult* result);
+
+// Return the path of the file of a directory of files written by vti2pqt
+// whose cycle_index is timestep. Throws parquet::ParquetException if there
+// is none.
+std::string FindTimestep(const std::string& dir, int timestep);
+
+// A read-only view of contiguous floats, like C++20 std::span<const float>
+class FloatSpan {
+ public:
+  FloatSpan() : data_(nullptr), size_(0) {}
+  FloatSpan(const float* data, size_t size) : data_(data), size_(size) {}
+
+  const float* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const float* begin() const { return data_; }
+  const float* end() const { return data_ + size_; }
+  float operator[](size_t i) const { return data_[i]; }
+
+ private:
+  const float* data_;
+  size_t size_;
+};
+
+// Scan all values of a value column of a parquet file written by vti2pqt
+// (or the v2 variants), in file order. The file is memory-mapped and the
+// data pages of column chunks stored as uncompressed PLAIN floats are
+// returned as views into the map, one page at a time, without decoding.
+// Page data follows variable-length page headers, so the values of such a
+// page are only viewed in place when they are aligned to 4 bytes, and are
+// copied into a buffer owned by the scanner otherwise. Other column chunks
+// (compressed, BYTE_STREAM_SPLIT, quantized or predicted) are decoded into
+// that buffer.
+class ColumnScanner {
+ public:
+  // Decode all pages, even the ones that could be mapped, if zero_copy is
+  // false. Throws parquet::ParquetException on errors.
+  ColumnScanner(const std::string& path, const std::string& column,
+                bool zero_copy = true);
+  ~ColumnScanner();
+
+  // Return the next values, or an empty span at the end of the column. The
+  // span is valid until the next call. Throws parquet::ParquetException on
+  // errors.
+  FloatSpan Next();
+
+  // Number of values returned as views into the map, copied out of
+  // misaligned pages and decoded so far
+  int64_t mapped_values() const;
+  int64_t copied_values() const;
+  int64_t decoded_values() const;
+
+ private:
+  // No copying allowed
+  ColumnScanner(const ColumnScanner&);
+  void operator=(const ColumnScanner& other);
+
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+// Look up values of a column by rowid without decoding pages. The file must
+// be written with the random-access profile (the -a option of vti2pqt,
+// recorded as the random_access key), which stores the column as
+// uncompressed PLAIN floats with an offset index, one row per rowid in
+// rowid order. The rowid statistics of every row group are checked against
+// its row positions. The offset of every value is then computed from the
+// offset index and the value is copied out of a read-only memory map of the
+// file.
+class CellLookup {
+ public:
+  // Throws parquet::ParquetException if the file cannot be looked up
+  CellLookup(const std::string& path, const std::string& column);
+  ~CellLookup();
+
+  int64_t rows() const { return rows_; }
+
+  // Throws parquet::ParquetException if rowid is out of range
+  float Lookup(int64_t rowid) const;
+  void LookupBatch(const int64_t* rowids, size_t n, float* out) const;
+
+ private:
+  // No copying allowed
+  CellLookup(const CellLookup&);
+  void operator=(const CellLookup& other);
+
+  const char* map_;
+  size_t size_;
+  int64_t rows_;
+  // First rowid and file offset of the values of every data page
+  std::vector<int64_t> first_rows_;
+  std::vector<int64_t> offsets_;
+  // Rows of every data page if all pages but the last have the same number
+  // of rows, in which case pages are found by division. Otherwise 0.
+  int64_t rows_per_page_;
+};
+
+}  // namespace xrage
@@ -0,0 +1,621 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "kernels.h"
+#include "lorenzo.h"
+#include "pqtreader.h"
+#include "test_util.h"
+
+#include <arrow/io/file.h>
+#include <arrow/util/key_value_metadata.h>
+#include <parquet/exception.h>
+#include <parquet/file_writer.h>
+#include <parquet/properties.h>
+#include <parquet/stream_writer.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// A 16 x 12 x 10 grid whose extent does not start at 0, with a negative
+// spacing along y
+const int kExtent[6] = {2, 17, 0, 11, 1, 10};
+const double kOrigin[3] = {-10, 20, -30};
+const double kSpacing[3] = {0.5, -0.25, 1};
+const int kNx = 16;
+const int kNy = 12;
+const int kNz = 10;
+const int kCells = kNx * kNy * kNz;
+
+// Quantization of v03 in the brick file
+const double kOffset03 = -0.5 * (kCells - 1);
+const double kScale03 = 0.3;
+
+// Directory of the files written by WriteFiles
+const xrage::TestDir* test_dir = nullptr;
+
+float V02(int id) { return float(id % 37) * 0.25f; }
+float V03(int id) { return float(id) * -0.5f; }
+
+// v03 as read back from the brick file, where it is quantized
+float QuantizedV03(int id) {
+  const float v = V03(id);
+  uint32_t q;
+  xrage::Quantize(&v, 1, kOffset03, kScale03, &q);
+  float out;
+  xrage::Dequantize(&q, 1, kOffset03, kScale03, &out);
+  return out;
+}
+
+void CellIndex(int id, int* i, int* j, int* k) {
+  *i = kExtent[0] + id % kNx;
+  *j = kExtent[2] + id / kNx % kNy;
+  *k = kExtent[4] + id / kNx / kNy;
+}
+
+int CellId(int i, int j, int k) {
+  return (i - kExtent[0]) + kNx * ((j - kExtent[2]) + kNy * (k - kExtent[4]));
+}
+
+// A file to write: its rows and row groups, and how values are stored
+struct TestFile {
+  TestFile() : sparse(false), quantized(false), predicted(false) {}
+  std::string name;
+  std::vector<int32_t> rowids;     // In file order
+  std::vector<size_t> group_ends;  // Row that ends every row group
+  bool sparse;     // Only cells whose rowid is not 1 mod 3 are stored
+  bool quantized;  // v03 is stored quantized
+  bool predicted;  // Both columns are stored as Lorenzo residuals
+  std::vector<std::pair<std::string, std::string>> kv;
+
+  // Value of a cell as read back from the file
+  float Value(const std::string& column, int id) const {
+    if (column == "v02") {
+      return V02(id);
+    }
+    return quantized ? QuantizedV03(id) : V03(id);
+  }
+
+  bool Has(int id) const { return !sparse || id % 3 != 1; }
+};
+
+std::string KeyString(double v) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", v);
+  return buf;
+}
+
+// Write a file like vti2pqt would, through parquet::StreamWriter
+void WriteFile(const TestFile& f, parquet::WriterProperties::Builder* b) {
+  parquet::schema::NodeVector fields;
+  fields.push_back(parquet::schema::PrimitiveNode::Make(
+      "rowid", parquet::Repetition::REQUIRED, parquet::Type::INT32,
+      parquet::ConvertedType::INT_32));
+  for (const char* column : {"v02", "v03"}) {
+    const bool quantized = f.quantized && std::string(column) == "v03";
+    if (f.predicted || quantized) {
+      fields.push_back(parquet::schema::PrimitiveNode::Make(
+          column, parquet::Repetition::REQUIRED, parquet::Type::INT32,
+          f.predicted ? parquet::ConvertedType::INT_32
+                      : parquet::ConvertedType::UINT_32));
+    } else {
+      fields.push_back(parquet::schema::PrimitiveNode::Make(
+          column, parquet::Repetition::REQUIRED, parquet::Type::FLOAT,
+          parquet::ConvertedType::NONE));
+    }
+  }
+  std::shared_ptr<parquet::schema::GroupNode> schema =
+      std::static_pointer_cast<parquet::schema::GroupNode>(
+          parquet::schema::GroupNode::Make(
+              "schema", parquet::Repetition::REQUIRED, fields));
+
+  std::shared_ptr<arrow::KeyValueMetadata> kv =
+      std::make_shared<arrow::KeyValueMetadata>();
+  for (int i = 0; i < 6; i++) {
+    kv->Append("extent_" + std::to_string(i), std::to_string(kExtent[i]));
+  }
+  for (int d = 0; d < 3; d++) {
+    kv->Append("origin_" + std::to_string(d), KeyString(kOrigin[d]));
+    kv->Append("spacing_" + std::to_string(d), KeyString(kSpacing[d]));
+  }
+  if (f.quantized) {
+    kv->Append("v03_offset", KeyString(kOffset03));
+    kv->Append("v03_scale", KeyString(kScale03));
+  }
+  for (const auto& entry : f.kv) {
+    kv->Append(entry.first, entry.second);
+  }
+
+  // Residuals of the whole grid, which predicted files store in natural
+  // order
+  std::vector<int32_t> r02, r03;
+  if (f.predicted) {
+    std::vector<float> v02(kCells), v03(kCells);
+    for (int id = 0; id < kCells; id++) {
+      v02[id] = V02(id);
+      v03[id] = V03(id);
+    }
+    r02.resize(kCells);
+    r03.resize(kCells);
+    xrage::LorenzoEncode(v02.data(), kNx, kNy, kNz, 4, 2, r02.data());
+    xrage::LorenzoEncode(v03.data(), kNx, kNy, kNz, 4, 2, r03.data());
+  }
+
+  std::shared_ptr<arrow::io::FileOutputStream> out;
+  PARQUET_ASSIGN_OR_THROW(
+      out, arrow::io::FileOutputStream::Open(test_dir->File(f.name)));
+  parquet::StreamWriter os(
+      parquet::ParquetFileWriter::Open(out, schema, b->build(), kv));
+  os.SetMaxRowGroupSize(0);
+  size_t group = 0;
+  for (size_t r = 0; r < f.rowids.size(); r++) {
+    const int id = f.rowids[r];
+    os << id;
+    if (f.predicted) {
+      os << r02[id] << r03[id];
+    } else if (f.quantized) {
+      const float v = V03(id);
+      uint32_t q;
+      xrage::Quantize(&v, 1, kOffset03, kScale03, &q);
+      os << V02(id) << q;
+    } else {
+      os << V02(id) << V03(id);
+    }
+    os << parquet::EndRow;
+    // The last row group is ended by closing the file, as ending it would
+    // start an empty one
+    if (r + 1 == f.group_ends[group] && r + 1 < f.rowids.size()) {
+      os << parquet::EndRowGroup;
+      group++;
+    }
+  }
+}
+
+// Split rows into row groups of size rows, the last one possibly shorter
+std::vector<size_t> GroupEnds(size_t rows, size_t size) {
+  std::vector<size_t> ends;
+  for (size_t end = size; end < rows + size; end += size) {
+    ends.push_back(std::min(end, rows));
+  }
+  return ends;
+}
+
+std::vector<TestFile> files;
+
+const TestFile& FindFile(const std::string& name) {
+  for (const TestFile& f : files) {
+    if (f.name == name) {
+      return f;
+    }
+  }
+  fprintf(stderr, "No test file %s\n", name.c_str());
+  exit(EXIT_FAILURE);
+}
+
+void WriteFiles() {
+  std::vector<int32_t> natural(kCells);
+  for (int id = 0; id < kCells; id++) {
+    natural[id] = id;
+  }
+
+  // Dense in natural order, compressed, with small pages and a page index
+  TestFile dense;
+  dense.name = "dense.parquet";
+  dense.rowids = natural;
+  dense.group_ends = GroupEnds(kCells, 400);
+  parquet::WriterProperties::Builder dense_builder;
+  dense_builder.compression(parquet::Compression::ZSTD)
+      ->data_pagesize(256)
+      ->enable_write_page_index();
+  WriteFile(dense, &dense_builder);
+  files.push_back(dense);
+
+  // Sparse, one row group per 8 x 6 x 5 brick, with a zone map and a page
+  // index
+  TestFile brick;
+  brick.name = "brick.parquet";
+  brick.sparse = true;
+  brick.quantized = true;
+  brick.kv = {{"layout", "brick"},
+              {"sparse", "true"},
+              {"zonemap", "brick.zonemap"}};
+  FILE* zm = fopen(test_dir->File("brick.zonemap").c_str(), "w");
+  XRAGE_CHECK(zm != nullptr);
+  fprintf(zm,
+          "rowgroup\ti0\ti1\tj0\tj1\tk0\tk1\tv02_min\tv02_max\tv03_min\t"
+          "v03_max\n");
+  for (int bk = 0; bk < 2; bk++) {
+    for (int bj = 0; bj < 2; bj++) {
+      for (int bi = 0; bi < 2; bi++) {
+        float lo02 = INFINITY, hi02 = -INFINITY;
+        float lo03 = INFINITY, hi03 = -INFINITY;
+        for (int k = bk * 5; k < bk * 5 + 5; k++) {
+          for (int j = bj * 6; j < bj * 6 + 6; j++) {
+            for (int i = bi * 8; i < bi * 8 + 8; i++) {
+              const int id = i + kNx * (j + kNy * k);
+              if (!brick.Has(id)) {
+                continue;
+              }
+              brick.rowids.push_back(id);
+              lo02 = std::min(lo02, brick.Value("v02", id));
+              hi02 = std::max(hi02, brick.Value("v02", id));
+              lo03 = std::min(lo03, brick.Value("v03", id));
+              hi03 = std::max(hi03, brick.Value("v03", id));
+            }
+          }
+        }
+        fprintf(zm, "%zu\t%d\t%d\t%d\t%d\t%d\t%d\t%.9g\t%.9g\t%.9g\t%.9g\n",
+                brick.group_ends.size(), kExtent[0] + bi * 8,
+                kExtent[0] + bi * 8 + 7, kExtent[2] + bj * 6,
+                kExtent[2] + bj * 6 + 5, kExtent[4] + bk * 5,
+                kExtent[4] + bk * 5 + 4, lo02, hi02, lo03, hi03);
+        brick.group_ends.push_back(brick.rowids.size());
+      }
+    }
+  }
+  XRAGE_CHECK(fclose(zm) == 0);
+  parquet::WriterProperties::Builder brick_builder;
+  brick_builder.compression(parquet::Compression::SNAPPY)
+      ->data_pagesize(128)
+      ->enable_write_page_index();
+  WriteFile(brick, &brick_builder);
+  files.push_back(brick);
+
+  // Lorenzo residuals in natural order
+  TestFile lorenzo;
+  lorenzo.name = "lorenzo.parquet";
+  lorenzo.rowids = natural;
+  lorenzo.group_ends = GroupEnds(kCells, 1000);
+  lorenzo.predicted = true;
+  lorenzo.kv = {{"predictor", "lorenzo"}, {"predictor_slab", "4"}};
+  parquet::WriterProperties::Builder lorenzo_builder;
+  lorenzo_builder.compression(parquet::Compression::ZSTD);
+  WriteFile(lorenzo, &lorenzo_builder);
+  files.push_back(lorenzo);
+
+  // The random-access profile: uncompressed PLAIN floats with an offset
+  // index. The row groups do not hold a whole number of pages.
+  TestFile random;
+  random.name = "random.parquet";
+  random.rowids = natural;
+  random.group_ends = GroupEnds(kCells, 500);
+  random.kv = {{"random_access", std::to_string(kCells)}};
+  parquet::WriterProperties::Builder random_builder;
+  random_builder.disable_dictionary()
+      ->encoding(parquet::Encoding::PLAIN)
+      ->data_pagesize(64 * sizeof(float))
+      ->enable_write_page_index();
+  WriteFile(random, &random_builder);
+  files.push_back(random);
+}
+
+// Index boxes to query, inside, across and outside of the grid
+std::vector<xrage::Box> TestBoxes() {
+  return {{{2, 0, 1}, {17, 11, 10}},   {{5, 3, 2}, {9, 7, 4}},
+          {{11, 6, 6}, {11, 6, 6}},    {{-5, 10, 8}, {3, 30, 40}},
+          {{2, 0, 1}, {17, 0, 1}},     {{18, 0, 1}, {30, 11, 10}},
+          {{9, -20, 1}, {12, -1, 10}}};
+}
+
+// The physical box that selects the grid points of an index box
+xrage::BoxQuery PhysicalBox(const xrage::Box& box) {
+  xrage::BoxQuery query;
+  for (int d = 0; d < 3; d++) {
+    const double a = kOrigin[d] + (box.lo[d] - 0.25) * kSpacing[d];
+    const double b = kOrigin[d] + (box.hi[d] + 0.25) * kSpacing[d];
+    query.lo[d] = std::min(a, b);
+    query.hi[d] = std::max(a, b);
+  }
+  return query;
+}
+
+void TestReadColumn() {
+  for (const TestFile& f : files) {
+    for (const char* column : {"v02", "v03"}) {
+      std::vector<float> values;
+      xrage::ReadColumn(test_dir->File(f.name), column, &values);
+      XRAGE_CHECK(values.size() == f.rowids.size());
+      for (size_t r = 0; r < values.size(); r++) {
+        XRAGE_CHECK(values[r] == f.Value(column, f.rowids[r]));
+      }
+    }
+  }
+  std::vector<float> values;
+  XRAGE_CHECK(xrage::Throws([&] {
+    xrage::ReadColumn(test_dir->File("dense.parquet"), "v04", &values);
+  }));
+}
+
+void TestQueryCells() {
+  struct Filter {
+    const char* column;
+    float threshold;
+  };
+  const Filter filters[] = {
+      {"v02", -1}, {"v02", 4.5f}, {"v02", 100}, {"v03", -300}};
+  for (const TestFile& f : files) {
+    for (const xrage::Box& box : TestBoxes()) {
+      for (const Filter& filter : filters) {
+        std::vector<std::pair<int32_t, float>> expected;
+        for (int id = 0; id < kCells; id++) {
+          int i, j, k;
+          CellIndex(id, &i, &j, &k);
+          const float v = f.Value(filter.column, id);
+          if (f.Has(id) && box.Contains(i, j, k) && v > filter.threshold) {
+            expected.push_back(std::make_pair(id, v));
+          }
+        }
+        for (bool page_index : {false, true}) {
+          xrage::CellQuery query;
+          query.box = box;
+          query.column = filter.column;
+          query.threshold = filter.threshold;
+          query.page_index = page_index;
+          xrage::CellQueryResult result;
+          xrage::QueryCells(test_dir->File(f.name), query, &result);
+          XRAGE_CHECK(result.rowids.size() == result.values.size());
+          std::vector<std::pair<int32_t, float>> found;
+          for (size_t r = 0; r < result.rowids.size(); r++) {
+            found.push_back(std::make_pair(result.rowids[r], result.values[r]));
+          }
+          std::sort(found.begin(), found.end());
+          XRAGE_CHECK(found == expected);
+          XRAGE_CHECK(result.rowgroups_read <= result.rowgroups_total);
+          XRAGE_CHECK(result.pages_read <= result.pages_total);
+          XRAGE_CHECK(result.rows_read <= result.rows_total);
+          XRAGE_CHECK(result.rows_total == int64_t(f.rowids.size()));
+        }
+      }
+    }
+  }
+
+  // A single cell only needs some of the pages of the dense file and some
+  // of the bricks
+  xrage::CellQuery query;
+  query.box = {{11, 6, 6}, {11, 6, 6}};
+  query.column = "v02";
+  query.threshold = -1;
+  query.page_index = true;
+  xrage::CellQueryResult result;
+  xrage::QueryCells(test_dir->File("dense.parquet"), query, &result);
+  XRAGE_CHECK(result.pages_total > 0);
+  XRAGE_CHECK(result.pages_read < result.pages_total);
+  xrage::QueryCells(test_dir->File("brick.parquet"), query, &result);
+  XRAGE_CHECK(result.rowgroups_read == 1);
+  XRAGE_CHECK(result.rowgroups_total == 8);
+}
+
+void TestQueryBox() {
+  for (const TestFile& f : files) {
+    for (const xrage::Box& box : TestBoxes()) {
+      xrage::Box clipped;
+      bool empty = false;
+      for (int d = 0; d < 3; d++) {
+        clipped.lo[d] = std::max(box.lo[d], kExtent[2 * d]);
+        clipped.hi[d] = std::min(box.hi[d], kExtent[2 * d + 1]);
+        empty = empty || clipped.lo[d] > clipped.hi[d];
+      }
+      xrage::BoxQuery query = PhysicalBox(box);
+      query.columns = {"v03", "v02"};
+      for (bool prune : {false, true}) {
+        query.prune = prune;
+        xrage::BoxQueryResult result;
+        xrage::QueryBox(test_dir->File(f.name), query, &result);
+        XRAGE_CHECK(result.values.size() == 2);
+        if (empty) {
+          XRAGE_CHECK(result.values[0].empty() && result.values[1].empty());
+          continue;
+        }
+        for (int d = 0; d < 3; d++) {
+          XRAGE_CHECK(result.box.lo[d] == clipped.lo[d]);
+          XRAGE_CHECK(result.box.hi[d] == clipped.hi[d]);
+        }
+        for (size_t c = 0; c < query.columns.size(); c++) {
+          std::vector<float> expected;
+          for (int k = clipped.lo[2]; k <= clipped.hi[2]; k++) {
+            for (int j = clipped.lo[1]; j <= clipped.hi[1]; j++) {
+              for (int i = clipped.lo[0]; i <= clipped.hi[0]; i++) {
+                const int id = CellId(i, j, k);
+                expected.push_back(f.Has(id) ? f.Value(query.columns[c], id)
+                                             : 0);
+              }
+            }
+          }
+          XRAGE_CHECK(result.values[c] == expected);
+        }
+      }
+    }
+  }
+
+  // Pruning reads only part of the dense file and of the bricks
+  xrage::BoxQuery query = PhysicalBox({{5, 3, 2}, {9, 7, 4}});
+  query.columns = {"v02"};
+  query.prune = true;
+  xrage::BoxQueryResult result;
+  xrage::QueryBox(test_dir->File("dense.parquet"), query, &result);
+  XRAGE_CHECK(result.rows_read < result.rows_total);
+  XRAGE_CHECK(result.pages_read < result.pages_total);
+  xrage::QueryBox(test_dir->File("brick.parquet"), query, &result);
+  XRAGE_CHECK(result.rowgroups_read < result.rowgroups_total);
+}
+
+void TestColumnScanner() {
+  for (const TestFile& f : files) {
+    for (bool zero_copy : {true, false}) {
+      xrage::ColumnScanner scanner(test_dir->File(f.name), "v02", zero_copy);
+      std::vector<float> values;
+      for (xrage::FloatSpan span = scanner.Next(); !span.empty();
+           span = scanner.Next()) {
+        values.insert(values.end(), span.begin(), span.end());
+      }
+      XRAGE_CHECK(values.size() == f.rowids.size());
+      for (size_t r = 0; r < values.size(); r++) {
+        XRAGE_CHECK(values[r] == f.Value("v02", f.rowids[r]));
+      }
+      const int64_t rows = int64_t(values.size());
+      XRAGE_CHECK(scanner.mapped_values() + scanner.copied_values() +
+                      scanner.decoded_values() ==
+                  rows);
+      // Only the uncompressed PLAIN pages of the random-access file can be
+      // returned without decoding
+      if (zero_copy && f.name == "random.parquet") {
+        XRAGE_CHECK(scanner.decoded_values() == 0);
+      } else {
+        XRAGE_CHECK(scanner.decoded_values() == rows);
+      }
+    }
+  }
+  // Quantized values are converted back to floats
+  const TestFile& brick = FindFile("brick.parquet");
+  xrage::ColumnScanner scanner(test_dir->File(brick.name), "v03");
+  size_t r = 0;
+  for (xrage::FloatSpan span = scanner.Next(); !span.empty();
+       span = scanner.Next()) {
+    for (float v : span) {
+      XRAGE_CHECK(r < brick.rowids.size());
+      XRAGE_CHECK(v == QuantizedV03(brick.rowids[r++]));
+    }
+  }
+  XRAGE_CHECK(r == brick.rowids.size());
+  XRAGE_CHECK(xrage::Throws([&] {
+    xrage::ColumnScanner bad(test_dir->File(brick.name), "v04");
+  }));
+}
+
+void TestCellLookup() {
+  const std::string path = test_dir->File("random.parquet");
+  for (const char* column : {"v02", "v03"}) {
+    xrage::CellLookup lookup(path, column);
+    XRAGE_CHECK(lookup.rows() == kCells);
+    for (int id = 0; id < kCells; id++) {
+      const float expected = std::string(column) == "v02" ? V02(id) : V03(id);
+      XRAGE_CHECK(lookup.Lookup(id) == expected);
+    }
+    std::vector<int64_t> rowids;
+    for (int id = kCells - 1; id >= 0; id -= 7) {
+      rowids.push_back(id);
+    }
+    std::vector<float> values(rowids.size());
+    lookup.LookupBatch(rowids.data(), rowids.size(), values.data());
+    for (size_t r = 0; r < rowids.size(); r++) {
+      XRAGE_CHECK(values[r] == lookup.Lookup(rowids[r]));
+    }
+    XRAGE_CHECK(xrage::Throws([&] { lookup.Lookup(-1); }));
+    XRAGE_CHECK(xrage::Throws([&] { lookup.Lookup(kCells); }));
+  }
+  // Files without the random-access profile are rejected
+  for (const char* name : {"dense.parquet", "brick.parquet"}) {
+    XRAGE_CHECK(xrage::Throws(
+        [&] { xrage::CellLookup lookup(test_dir->File(name), "v02"); }));
+  }
+}
+
+// A time series like vti2pqtv2a writes with -K 2: timestep 0 is a keyframe
+// that stores the first half of the cells and timestep 1 stores one
+// changed cell
+void TestReadTimestep() {
+  const int kSeriesCells = 100;
+  parquet::schema::NodeVector fields;
+  for (const char* name : {"timestep", "rowid"}) {
+    fields.push_back(parquet::schema::PrimitiveNode::Make(
+        name, parquet::Repetition::REQUIRED, parquet::Type::INT32,
+        parquet::ConvertedType::INT_32));
+  }
+  for (const char* name : {"v02", "v03"}) {
+    fields.push_back(parquet::schema::PrimitiveNode::Make(
+        name, parquet::Repetition::REQUIRED, parquet::Type::FLOAT,
+        parquet::ConvertedType::NONE));
+  }
+  std::shared_ptr<parquet::schema::GroupNode> schema =
+      std::static_pointer_cast<parquet::schema::GroupNode>(
+          parquet::schema::GroupNode::Make(
+              "schema", parquet::Repetition::REQUIRED, fields));
+  std::shared_ptr<arrow::KeyValueMetadata> kv =
+      std::make_shared<arrow::KeyValueMetadata>();
+  kv->Append("cells", std::to_string(kSeriesCells));
+  kv->Append("timesteps", "0,1");
+  kv->Append("keyframe_interval", "2");
+  const std::string path = test_dir->File("series.parquet");
+  {
+    std::shared_ptr<arrow::io::FileOutputStream> out;
+    PARQUET_ASSIGN_OR_THROW(out, arrow::io::FileOutputStream::Open(path));
+    parquet::StreamWriter os(parquet::ParquetFileWriter::Open(
+        out, schema, parquet::default_writer_properties(), kv));
+    for (int id = 0; id < kSeriesCells / 2; id++) {
+      os << int32_t(0) << int32_t(id) << V02(id) << V03(id)
+         << parquet::EndRow;
+    }
+    os << parquet::EndRowGroup;
+    os << int32_t(1) << int32_t(3) << 42.0f << -42.0f << parquet::EndRow;
+  }
+
+  for (int timestep : {0, 1}) {
+    std::vector<float> values;
+    xrage::ReadTimestep(path, timestep, "v02", &values);
+    // Cells never written read as 0, up to the recorded cell count
+    XRAGE_CHECK(values.size() == size_t(kSeriesCells));
+    for (int id = 0; id < kSeriesCells; id++) {
+      const float expected = timestep == 1 && id == 3 ? 42.0f
+                             : id < kSeriesCells / 2  ? V02(id)
+                                                      : 0.0f;
+      XRAGE_CHECK(values[id] == expected);
+    }
+  }
+  std::vector<float> values;
+  XRAGE_CHECK(
+      xrage::Throws([&] { xrage::ReadTimestep(path, 2, "v02", &values); }));
+}
+
+}  // namespace
+
+int main() {
+  xrage::TestDir dir;
+  test_dir = &dir;
+  WriteFiles();
+  xrage::RunTest("ReadColumn", TestReadColumn);
+  xrage::RunTest("QueryCells", TestQueryCells);
+  xrage::RunTest("QueryBox", TestQueryBox);
+  xrage::RunTest("ColumnScanner", TestColumnScanner);
+  xrage::RunTest("CellLookup", TestCellLookup);
+  xrage::RunTest("ReadTimestep", TestReadTimestep);
+  return 0;
+}
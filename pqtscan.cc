@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pqtreader.h"
+#include "timing.h"
+
+#include <parquet/exception.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] file.parquet [column...]\n"
+          "  -d, --decode      decode all pages instead of mapping them\n"
+          "  -b, --bench runs  time mapped against decoded scans\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+struct Reduction {
+  int64_t n;
+  double sum;
+  float min;
+  float max;
+  int64_t mapped;
+  int64_t copied;
+};
+
+// Reduce a whole column. Exits on errors.
+Reduction Scan(const char* path, const std::string& column, bool zero_copy) {
+  Reduction r = {0, 0, INFINITY, -INFINITY, 0, 0};
+  try {
+    xrage::ColumnScanner scanner(path, column, zero_copy);
+    for (xrage::FloatSpan span = scanner.Next(); !span.empty();
+         span = scanner.Next()) {
+      double sum = 0;
+      float min = r.min;
+      float max = r.max;
+      for (float v : span) {
+        sum += v;
+        min = std::min(min, v);
+        max = std::max(max, v);
+      }
+      r.n += span.size();
+      r.sum += sum;
+      r.min = min;
+      r.max = max;
+    }
+    r.mapped = scanner.mapped_values();
+    r.copied = scanner.copied_values();
+  } catch (const parquet::ParquetException& e) {
+    fprintf(stderr, "Fail to scan %s of %s: %s\n", column.c_str(), path,
+            e.what());
+    exit(EXIT_FAILURE);
+  }
+  return r;
+}
+
+double TimeScan(const char* path, const std::string& column, bool zero_copy,
+                Reduction* r) {
+  const double start = xrage::NowSeconds();
+  *r = Scan(path, column, zero_copy);
+  return xrage::NowSeconds() - start;
+}
+
+void PrintScan(const char* name, const Reduction& r, double elapsed) {
+  printf("%-8s %lld values (%lld mapped, %lld copied) in %.4f s, %.2f GB/s\n",
+         name, static_cast<long long>(r.n), static_cast<long long>(r.mapped),
+         static_cast<long long>(r.copied), elapsed,
+         elapsed > 0 ? r.n * sizeof(float) / elapsed * 1e-9 : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  static const struct option kLongOpts[] = {
+      {"decode", no_argument, nullptr, 'd'},
+      {"bench", required_argument, nullptr, 'b'},
+      {nullptr, 0, nullptr, 0}};
+  bool zero_copy = true;
+  int runs = 0;
+  int c;
+  while ((c = getopt_long(argc, argv, "db:", kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'd':
+        zero_copy = false;
+        break;
+      case 'b':
+        runs = atoi(optarg);
+        if (runs <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    Usage(argv[0]);
+  }
+  const char* path = argv[optind];
+  std::vector<std::string> columns(argv + optind + 1, argv + argc);
+  if (columns.empty()) {
+    columns.push_back("v02");
+    columns.push_back("v03");
+  }
+  for (const std::string& column : columns) {
+    Reduction r;
+    double elapsed = TimeScan(path, column, zero_copy, &r);
+    printf("%s: sum %g, min %g, max %g\n", column.c_str(), r.sum, r.min,
+           r.max);
+    if (runs == 0) {
+      PrintScan(zero_copy ? "mapped" : "decoded", r, elapsed);
+      continue;
+    }
+    // Best of runs, alternating so that both see the same page cache state
+    Reduction decoded;
+    double best[2] = {INFINITY, INFINITY};
+    for (int i = 0; i < runs; i++) {
+      best[0] = std::min(best[0], TimeScan(path, column, true, &r));
+      best[1] = std::min(best[1], TimeScan(path, column, false, &decoded));
+    }
+    // Partial sums follow page or batch boundaries
+    if (r.n != decoded.n || r.min != decoded.min || r.max != decoded.max ||
+        fabs(r.sum - decoded.sum) > 1e-6 * std::max(1.0, fabs(r.sum))) {
+      fprintf(stderr, "Mapped and decoded scans of %s differ\n",
+              column.c_str());
+      exit(EXIT_FAILURE);
+    }
+    PrintScan("mapped", r, best[0]);
+    PrintScan("decoded", decoded, best[1]);
+  }
+  return 0;
+}
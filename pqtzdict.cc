@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pqtreader.h"
+#include "timing.h"
+#include "zstd_dict.h"
+
+#include <parquet/exception.h>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <zstd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] dict_out train.parquet...\n"
+          "  -c, --column <name>      Column to train on (repeatable, "
+          "default v02 and v03)\n"
+          "  -s, --dict-size <bytes>  Dictionary capacity (default 112640)\n"
+          "  -p, --page-size <bytes>  Sample and page size (default 8192)\n"
+          "  -z, --level <n>          ZSTD level (default 3)\n"
+          "  -t, --test <file>        Evaluate on file (repeatable, default "
+          "the last\n"
+          "                           quarter of the files, which are then "
+          "not trained on)\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+// Append the raw bytes of the given columns of a file to out, cut into
+// page-sized chunks whose sizes are appended to sizes.
+void ReadPages(const std::string& path, const std::vector<std::string>& columns,
+               size_t page_size, std::string* out, std::vector<size_t>* sizes) {
+  std::vector<float> values;
+  for (const std::string& column : columns) {
+    try {
+      xrage::ReadColumn(path, column, &values);
+    } catch (const parquet::ParquetException& e) {
+      fprintf(stderr, "Fail to read %s from %s: %s\n", column.c_str(),
+              path.c_str(), e.what());
+      exit(EXIT_FAILURE);
+    }
+    const char* p = reinterpret_cast<const char*>(values.data());
+    const size_t n = values.size() * sizeof(float);
+    for (size_t off = 0; off < n; off += page_size) {
+      const size_t len = std::min(page_size, n - off);
+      out->append(p + off, len);
+      sizes->push_back(len);
+    }
+  }
+}
+
+// Return whether two paths name the same file
+bool SameFile(const std::string& a, const std::string& b) {
+  struct stat sa, sb;
+  if (stat(a.c_str(), &sa) != 0 || stat(b.c_str(), &sb) != 0) {
+    return a == b;
+  }
+  return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+struct Result {
+  size_t bytes;
+  double compress_seconds;
+  double decompress_seconds;
+};
+
+// Compress and decompress each page on its own, with dict or without if it
+// is null, and verify the round trip.
+Result Evaluate(const std::string& pages, const std::vector<size_t>& sizes,
+                const xrage::ZstdDictionary* dict, int level) {
+  ZSTD_CCtx* cctx = ZSTD_createCCtx();
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  std::vector<std::string> compressed(sizes.size());
+  Result r = {0, 0, 0};
+  double start = xrage::NowSeconds();
+  size_t off = 0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    std::string& c = compressed[i];
+    c.resize(ZSTD_compressBound(sizes[i]));
+    const size_t n =
+        dict ? ZSTD_compress_usingCDict(cctx, &c[0], c.size(),
+                                        pages.data() + off, sizes[i],
+                                        dict->cdict())
+             : ZSTD_compressCCtx(cctx, &c[0], c.size(), pages.data() + off,
+                                 sizes[i], level);
+    if (ZSTD_isError(n)) {
+      fprintf(stderr, "Fail to compress page: %s\n", ZSTD_getErrorName(n));
+      exit(EXIT_FAILURE);
+    }
+    c.resize(n);
+    r.bytes += n;
+    off += sizes[i];
+  }
+  r.compress_seconds = xrage::NowSeconds() - start;
+  std::string page;
+  start = xrage::NowSeconds();
+  off = 0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    const std::string& c = compressed[i];
+    page.resize(sizes[i]);
+    const size_t n =
+        dict ? ZSTD_decompress_usingDDict(dctx, &page[0], page.size(),
+                                          c.data(), c.size(), dict->ddict())
+             : ZSTD_decompressDCtx(dctx, &page[0], page.size(), c.data(),
+                                   c.size());
+    if (ZSTD_isError(n) || n != sizes[i] ||
+        page.compare(0, n, pages, off, n) != 0) {
+      fprintf(stderr, "Fail to decompress page %zu\n", i);
+      exit(EXIT_FAILURE);
+    }
+    off += sizes[i];
+  }
+  r.decompress_seconds = xrage::NowSeconds() - start;
+  ZSTD_freeCCtx(cctx);
+  ZSTD_freeDCtx(dctx);
+  return r;
+}
+
+void Print(const char* name, size_t raw, const Result& r) {
+  const double mb = raw / 1048576.0;
+  printf("%-12s %12zu bytes %8.2fx %10.1f MB/s %10.1f MB/s\n", name, r.bytes,
+         r.bytes ? double(raw) / r.bytes : 0.0,
+         r.compress_seconds > 0 ? mb / r.compress_seconds : 0.0,
+         r.decompress_seconds > 0 ? mb / r.decompress_seconds : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  static const struct option kLongOpts[] = {
+      {"column", required_argument, nullptr, 'c'},
+      {"dict-size", required_argument, nullptr, 's'},
+      {"page-size", required_argument, nullptr, 'p'},
+      {"level", required_argument, nullptr, 'z'},
+      {"test", required_argument, nullptr, 't'},
+      {nullptr, 0, nullptr, 0}};
+  std::vector<std::string> columns;
+  std::vector<std::string> tests;
+  size_t dict_size = 112640;
+  size_t page_size = 8192;
+  int level = 3;
+  int c;
+  while ((c = getopt_long(argc, argv, "c:s:p:z:t:", kLongOpts, nullptr)) !=
+         -1) {
+    switch (c) {
+      case 'c':
+        columns.push_back(optarg);
+        break;
+      case 's':
+        dict_size = strtoul(optarg, nullptr, 10);
+        break;
+      case 'p':
+        page_size = strtoul(optarg, nullptr, 10);
+        break;
+      case 'z':
+        level = atoi(optarg);
+        break;
+      case 't':
+        tests.push_back(optarg);
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind + 2 > argc || dict_size < 1024 || page_size == 0) {
+    Usage(argv[0]);
+  }
+  if (columns.empty()) {
+    columns.push_back("v02");
+    columns.push_back("v03");
+  }
+  const std::string dict_out = argv[optind];
+  std::vector<std::string> trains(argv + optind + 1, argv + argc);
+  if (tests.empty()) {
+    // Hold out the later timesteps. File names of converted time series
+    // sort in timestep order.
+    if (trains.size() < 2) {
+      fprintf(stderr, "Need at least two files or a --test file\n");
+      exit(EXIT_FAILURE);
+    }
+    std::sort(trains.begin(), trains.end());
+    const size_t held = (trains.size() + 3) / 4;
+    tests.assign(trains.end() - held, trains.end());
+    trains.resize(trains.size() - held);
+  }
+  for (const std::string& test : tests) {
+    for (const std::string& train : trains) {
+      if (SameFile(test, train)) {
+        fprintf(stderr, "%s is both a training and a test file\n",
+                test.c_str());
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  printf("Training on %zu files, evaluating on %zu files\n", trains.size(),
+         tests.size());
+
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  for (const std::string& path : trains) {
+    ReadPages(path, columns, page_size, &samples, &sample_sizes);
+  }
+  xrage::ZstdDictionary dict;
+  double start = xrage::NowSeconds();
+  try {
+    dict.Train(samples, sample_sizes, dict_size, level);
+    dict.Save(dict_out);
+  } catch (const parquet::ParquetException& e) {
+    fprintf(stderr, "Fail to build %s: %s\n", dict_out.c_str(), e.what());
+    exit(EXIT_FAILURE);
+  }
+  printf("Trained %zu byte dictionary from %zu pages in %.3f s\n",
+         dict.size(), sample_sizes.size(), xrage::NowSeconds() - start);
+  samples.clear();
+  sample_sizes.clear();
+
+  std::string pages;
+  std::vector<size_t> sizes;
+  for (const std::string& path : tests) {
+    ReadPages(path, columns, page_size, &pages, &sizes);
+  }
+  printf("Evaluating %zu pages of %zu bytes (%zu bytes)\n", sizes.size(),
+         page_size, pages.size());
+  printf("%-12s %18s %9s %15s %15s\n", "codec", "compressed", "ratio",
+         "compress", "decompress");
+  Print("zstd", pages.size(), Evaluate(pages, sizes, nullptr, level));
+  Print("zstd+dict", pages.size(), Evaluate(pages, sizes, &dict, level));
+  return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace xrage {
+
+struct PrefetchOptions {
+  PrefetchOptions() : files(2), budget(size_t(1) << 30) {}
+  // Number of upcoming input files to prefetch, 0 to disable
+  int files;
+  // Most bytes of prefetched input that is not converted yet. The last
+  // file that fits is only prefetched in part.
+  size_t budget;
+
+  // Parse a budget in MiB. Returns false on bad input.
+  bool ParseBudget(const char* str) {
+    char* end;
+    const long long mib = strtoll(str, &end, 10);
+    if (*end != '\0' || mib <= 0) {
+      return false;
+    }
+    budget = size_t(mib) << 20;
+    return true;
+  }
+};
+
+// Asks the kernel to read the next input files of a work list ahead while
+// the current one is being converted, so that their open and first reads
+// don't start cold. Hints are issued with posix_fadvise(WILLNEED) from a
+// background thread, which also takes the open latency of slow parallel
+// file systems off the converting thread.
+class Prefetcher {
+ public:
+  Prefetcher(const PrefetchOptions& options,
+             const std::vector<std::string>& files)
+      : options_(options),
+        files_(files),
+        hinted_(files.size(), 0),
+        current_(0),
+        released_(0),
+        next_(0),
+        outstanding_(0),
+        stop_(false) {
+    if (options_.files > 0) {
+      thread_ = std::thread(&Prefetcher::Run, this);
+    }
+  }
+
+  ~Prefetcher() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  // Note that files[i] is about to be converted. Prefetched bytes of the
+  // files before it are returned to the budget. Concurrent workers may
+  // start files slightly out of order, so this only moves forward.
+  void Start(size_t i) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      current_ = std::max(current_, i);
+      for (; released_ < std::min(current_, files_.size()); released_++) {
+        outstanding_ -= hinted_[released_];
+      }
+      next_ = std::max(next_, current_ + 1);
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  bool Pending() const {
+    return next_ < files_.size() &&
+           next_ <= current_ + size_t(options_.files) &&
+           outstanding_ < options_.budget;
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+      cv_.wait(lock, [this] { return stop_ || Pending(); });
+      if (stop_) {
+        return;
+      }
+      const size_t k = next_++;
+      const size_t room = options_.budget - outstanding_;
+      lock.unlock();
+      const size_t len = Hint(files_[k], room);
+      lock.lock();
+      if (k >= released_) {
+        hinted_[k] = len;
+        outstanding_ += len;
+      }
+    }
+  }
+
+  // Start reading up to room bytes of a file. Returns the number of bytes
+  // hinted.
+  static size_t Hint(const std::string& path, size_t room) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return 0;  // The converter reports the error when it gets there
+    }
+    struct stat st;
+    size_t len = 0;
+    if (fstat(fd, &st) == 0) {
+      len = std::min(size_t(st.st_size), room);
+    }
+    // Linux caps each WILLNEED request to the readahead window, so the
+    // range is hinted in pieces
+    for (size_t off = 0; off < len; off += kHintSize) {
+      if (posix_fadvise(fd, off_t(off), off_t(std::min(kHintSize, len - off)),
+                        POSIX_FADV_WILLNEED) != 0) {
+        len = off;
+        break;
+      }
+    }
+    close(fd);
+    return len;
+  }
+
+  static constexpr size_t kHintSize = size_t(2) << 20;
+
+  const PrefetchOptions options_;
+  const std::vector<std::string> files_;
+  std::vector<size_t> hinted_;  // Bytes hinted per file
+  size_t current_;              // File being converted
+  size_t released_;             // Files before this are off the budget
+  size_t next_;                 // Next file to hint
+  size_t outstanding_;          // Bytes hinted and not released
+  bool stop_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::thread thread_;
+};
+
+}  // namespace xrage
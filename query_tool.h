@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "pqtreader.h"
+#include "timing.h"
+
+#include <parquet/exception.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+namespace xrage {
+
+// Run one of the queries of pqtreader.h and return the elapsed seconds.
+// Exits on errors.
+template <typename Query, typename Result>
+double RunQuery(void (*query_fn)(const std::string&, const Query&, Result*),
+                const std::string& path, const Query& query, Result* result) {
+  const double start = NowSeconds();
+  try {
+    query_fn(path, query, result);
+  } catch (const parquet::ParquetException& e) {
+    fprintf(stderr, "Fail to query %s: %s\n", path.c_str(), e.what());
+    exit(EXIT_FAILURE);
+  }
+  return NowSeconds() - start;
+}
+
+inline void PrintReads(const ReadStats& stats, double elapsed) {
+  printf("Read %d/%d row groups, ", stats.rowgroups_read,
+         stats.rowgroups_total);
+  if (stats.pages_total > 0) {
+    printf("%lld/%lld pages, ", static_cast<long long>(stats.pages_read),
+           static_cast<long long>(stats.pages_total));
+  }
+  printf("%lld/%lld rows (%.2f%%) in %.3f s\n",
+         static_cast<long long>(stats.rows_read),
+         static_cast<long long>(stats.rows_total),
+         stats.rows_total ? 100.0 * stats.rows_read / stats.rows_total : 0.0,
+         elapsed);
+}
+
+}  // namespace xrage
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <parquet/exception.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xrage {
+
+// Raw export of grid fields for consumers that want to mmap a field as a
+// dense 3D array instead of decoding parquet. Every field is written as a
+// NumPy .npy file holding float32 values in vtk point order (x fastest),
+// i.e. a C-order array of shape (nz, ny, nx). The .npy header is padded so
+// that the values start at kRawAlign, which keeps the mapped array page
+// aligned. A JSON sidecar carries the grid geometry and file metadata.
+constexpr size_t kRawAlign = 4096;
+// Values are written straight from the caller's buffer in writes of this
+// many bytes
+constexpr size_t kRawWriteSize = size_t(16) << 20;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr char kNpyFloatDescr[] = ">f4";
+#else
+constexpr char kNpyFloatDescr[] = "<f4";
+#endif
+
+// A file opened for writing that is closed when it goes out of scope, so
+// that errors thrown while writing it do not leak its descriptor
+class OutputFile {
+ public:
+  // Throws parquet::ParquetException on errors
+  explicit OutputFile(const std::string& path)
+      : path_(path),
+        fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) {
+    if (fd_ == -1) {
+      throw parquet::ParquetException("Fail to open file ", path_, ": ",
+                                      strerror(errno));
+    }
+  }
+
+  ~OutputFile() {
+    if (fd_ != -1) {
+      close(fd_);
+    }
+  }
+
+  int fd() const { return fd_; }
+
+  // Write all of buf. Throws parquet::ParquetException on errors.
+  void Write(const char* buf, size_t n) {
+    while (n > 0) {
+      const ssize_t r = write(fd_, buf, std::min(n, kRawWriteSize));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw parquet::ParquetException("Fail to write file ", path_, ": ",
+                                        strerror(errno));
+      }
+      buf += r;
+      n -= size_t(r);
+    }
+  }
+
+  // Throws parquet::ParquetException on errors
+  void Close() {
+    const int fd = fd_;
+    fd_ = -1;
+    if (close(fd) != 0) {
+      throw parquet::ParquetException("Fail to close file ", path_, ": ",
+                                      strerror(errno));
+    }
+  }
+
+ private:
+  // No copying allowed
+  OutputFile(const OutputFile&);
+  void operator=(const OutputFile& other);
+
+  const std::string path_;
+  int fd_;
+};
+
+// Write n = dims[0] * dims[1] * dims[2] floats as an .npy file. Throws
+// parquet::ParquetException on errors.
+inline void WriteNpy(const std::string& path, const float* values,
+                     const int dims[3]) {
+  std::string header = "\x93NUMPY";
+  header += char(1);  // Format version 1.0
+  header += char(0);
+  header += "  ";  // Header length, filled in below
+  header += "{'descr': '";
+  header += kNpyFloatDescr;
+  header += "', 'fortran_order': False, 'shape': (";
+  header += std::to_string(dims[2]) + ", " + std::to_string(dims[1]) + ", " +
+            std::to_string(dims[0]) + "), }";
+  // The dict is padded with spaces and terminated by a newline
+  header.resize(kRawAlign - 1, ' ');
+  header += '\n';
+  const size_t len = kRawAlign - 10;
+  header[8] = char(len & 0xff);
+  header[9] = char(len >> 8);
+  const size_t bytes =
+      size_t(dims[0]) * size_t(dims[1]) * size_t(dims[2]) * sizeof(float);
+  OutputFile file(path);
+  // Reserve the whole file upfront so the large writes below don't extend
+  // it piecemeal. Not all file systems support this.
+  posix_fallocate(file.fd(), 0, off_t(kRawAlign + bytes));
+  file.Write(header.data(), header.size());
+  file.Write(reinterpret_cast<const char*>(values), bytes);
+  file.Close();
+}
+
+// Grid geometry and metadata of a raw export
+struct RawGrid {
+  int dims[3];       // Points along x, y and z
+  int extent[6];     // Vtk extent of the exported points
+  double origin[3];  // Physical position of the first exported point
+  double spacing[3];
+  int cycle_index;
+  // Field name to values in vtk point order
+  std::map<std::string, const float*> fields;
+};
+
+inline std::string JsonString(const std::string& str) {
+  std::string out = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+  return out;
+}
+
+// Return kv as the JSON object of the "metadata" member of a sidecar, one
+// entry per line sorted by key for stable output
+inline std::string JsonMetadata(
+    const std::unordered_map<std::string, std::string>& kv) {
+  const std::map<std::string, std::string> sorted(kv.begin(), kv.end());
+  std::string json = "{";
+  const char* sep = "\n";
+  for (const auto& entry : sorted) {
+    json += sep;
+    json += "    " + JsonString(entry.first) + ": " + JsonString(entry.second);
+    sep = ",\n";
+  }
+  json += "\n  }";
+  return json;
+}
+
+// Export every field of grid to base.<field>.npy and describe them in
+// base.json. kv is copied into the "metadata" object of the sidecar.
+// Throws parquet::ParquetException on errors.
+inline void WriteRawExport(
+    const std::string& base, const RawGrid& grid,
+    const std::unordered_map<std::string, std::string>& kv) {
+  const std::string dir_prefix = base.substr(0, base.rfind('/') + 1);
+  std::string json = "{\n";
+  char buf[1024];
+  snprintf(buf, sizeof(buf),
+           "  \"dims\": [%d, %d, %d],\n"
+           "  \"shape\": [%d, %d, %d],\n"
+           "  \"extent\": [%d, %d, %d, %d, %d, %d],\n"
+           "  \"origin\": [%.17g, %.17g, %.17g],\n"
+           "  \"spacing\": [%.17g, %.17g, %.17g],\n"
+           "  \"cycle_index\": %d,\n",
+           grid.dims[0], grid.dims[1], grid.dims[2], grid.dims[2],
+           grid.dims[1], grid.dims[0], grid.extent[0], grid.extent[1],
+           grid.extent[2], grid.extent[3], grid.extent[4], grid.extent[5],
+           grid.origin[0], grid.origin[1], grid.origin[2], grid.spacing[0],
+           grid.spacing[1], grid.spacing[2], grid.cycle_index);
+  json += buf;
+  json += "  \"dtype\": \"";
+  json += kNpyFloatDescr;
+  json += "\",\n  \"data_offset\": " + std::to_string(kRawAlign) + ",\n";
+  json += "  \"fields\": {";
+  const char* sep = "\n";
+  for (const auto& field : grid.fields) {
+    const std::string path = base + "." + field.first + ".npy";
+    WriteNpy(path, field.second, grid.dims);
+    json += sep;
+    json += "    " + JsonString(field.first) + ": " +
+            JsonString(path.substr(dir_prefix.size()));
+    sep = ",\n";
+  }
+  json += "\n  },\n  \"metadata\": " + JsonMetadata(kv) + "\n}\n";
+  OutputFile file(base + ".json");
+  file.Write(json.data(), json.size());
+  file.Close();
+}
+
+}  // namespace xrage
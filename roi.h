@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "kernels.h"
+
+#include <vtkDataObject.h>
+#include <vtkInformation.h>
+#include <vtkNew.h>
+#include <vtkStreamingDemandDrivenPipeline.h>
+#include <vtkXMLImageDataReader.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+
+namespace xrage {
+
+// A region of interest of a vti grid given either as an inclusive index
+// range ("i0:i1,j0:j1,k0:k1") or as a physical coordinate range
+// ("x0:x1,y0:y1,z0:z1") that is mapped to indices using the origin and
+// spacing of each input file.
+struct Roi {
+  Roi() : enabled(false), physical(false) {}
+  bool enabled;
+  bool physical;
+  double lo[3];
+  double hi[3];
+  std::string spec;  // As given by the user
+};
+
+// Parse a region of interest. Returns false on malformed input.
+inline bool ParseRoi(const char* str, bool physical, Roi* roi) {
+  int n = 0;
+  if (sscanf(str, "%lf:%lf,%lf:%lf,%lf:%lf%n", &roi->lo[0], &roi->hi[0],
+             &roi->lo[1], &roi->hi[1], &roi->lo[2], &roi->hi[2], &n) != 6 ||
+      str[n] != '\0') {
+    return false;
+  }
+  for (int d = 0; d < 3; d++) {
+    if (roi->lo[d] > roi->hi[d]) {
+      return false;
+    }
+  }
+  roi->enabled = true;
+  roi->physical = physical;
+  roi->spec = str;
+  return true;
+}
+
+// Map a region of interest to an index extent clipped to whole_extent.
+// Physical coordinates select all points inside the box. Returns false if
+// the result is empty.
+inline bool RoiToExtent(const Roi& roi, const int whole_extent[6],
+                        const double origin[3], const double spacing[3],
+                        int extent[6]) {
+  for (int d = 0; d < 3; d++) {
+    double lo = roi.lo[d];
+    double hi = roi.hi[d];
+    if (roi.physical) {
+      PhysicalToIndex(roi.lo[d], roi.hi[d], origin[d], spacing[d], &lo, &hi);
+    }
+    extent[2 * d] = int(std::max<double>(lo, whole_extent[2 * d]));
+    extent[2 * d + 1] = int(std::min<double>(hi, whole_extent[2 * d + 1]));
+    if (extent[2 * d] > extent[2 * d + 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Return the number of points of an inclusive index extent
+inline int64_t ExtentCells(const int extent[6]) {
+  return int64_t(extent[1] - extent[0] + 1) * (extent[3] - extent[2] + 1) *
+         (extent[5] - extent[4] + 1);
+}
+
+// Format an extent in the "i0:i1,j0:j1,k0:k1" form of the -r option
+inline std::string ExtentString(const int extent[6]) {
+  char buf[96];
+  snprintf(buf, sizeof(buf), "%d:%d,%d:%d,%d:%d", extent[0], extent[1],
+           extent[2], extent[3], extent[4], extent[5]);
+  return buf;
+}
+
+// Map a region of interest to the extent it selects from the grid of a
+// reader whose information has already been updated. A disabled region
+// selects the whole grid. Exits the program if the region does not
+// intersect the grid.
+inline void ResolveRoi(const Roi& roi, vtkXMLImageDataReader* reader,
+                       int extent[6]) {
+  vtkInformation* info = reader->GetOutputInformation(0);
+  int whole_extent[6];
+  double origin[3];
+  double spacing[3];
+  info->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), whole_extent);
+  if (!roi.enabled) {
+    std::copy_n(whole_extent, 6, extent);
+    return;
+  }
+  info->Get(vtkDataObject::ORIGIN(), origin);
+  info->Get(vtkDataObject::SPACING(), spacing);
+  if (!RoiToExtent(roi, whole_extent, origin, spacing, extent)) {
+    fprintf(stderr, "Region of interest %s is outside of the grid of %s\n",
+            roi.spec.c_str(), reader->GetFileName());
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Map a region of interest to the extent it selects from the grid of a vti
+// file, reading only the file header
+inline void ResolveRoi(const Roi& roi, const std::string& path,
+                       int extent[6]) {
+  vtkNew<vtkXMLImageDataReader> reader;
+  reader->SetFileName(path.c_str());
+  reader->UpdateInformation();
+  ResolveRoi(roi, reader.Get(), extent);
+}
+
+// Execute a reader whose information has already been updated, decoding
+// only the region of interest when one is given. Exits the program if the
+// region does not intersect the grid.
+inline void UpdateReader(const Roi& roi, vtkXMLImageDataReader* reader) {
+  if (!roi.enabled) {
+    reader->Update();
+    return;
+  }
+  int extent[6];
+  ResolveRoi(roi, reader, extent);
+  reader->UpdateExtent(extent);
+}
+
+}  // namespace xrage
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <arrow/array/builder_primitive.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/ipc/writer.h>
+#include <arrow/record_batch.h>
+#include <arrow/type.h>
+#include <arrow/util/compression.h>
+#include <arrow/util/key_value_metadata.h>
+#include <parquet/exception.h>
+#include <parquet/file_writer.h>
+#include <parquet/properties.h>
+#include <parquet/schema.h>
+#include <parquet/stream_writer.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace xrage {
+
+// Output file format of the converters, given on the command line as
+// "parquet" or "arrow[:lz4|:zstd]". Arrow IPC files can be memory-mapped
+// and used without any decoding. Their record batch buffers can optionally
+// be compressed.
+struct OutputFormat {
+  OutputFormat() : ipc(false), compression(arrow::Compression::UNCOMPRESSED) {}
+  bool ipc;
+  arrow::Compression::type compression;
+
+  // Returns false on bad input
+  bool Parse(const char* spec) {
+    if (strcmp(spec, "parquet") == 0) {
+      ipc = false;
+    } else if (strcmp(spec, "arrow") == 0) {
+      ipc = true;
+      compression = arrow::Compression::UNCOMPRESSED;
+    } else if (strcmp(spec, "arrow:lz4") == 0) {
+      ipc = true;
+      compression = arrow::Compression::LZ4_FRAME;
+    } else if (strcmp(spec, "arrow:zstd") == 0) {
+      ipc = true;
+      compression = arrow::Compression::ZSTD;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  const char* extension() const { return ipc ? ".arrow" : ".parquet"; }
+};
+
+// A slab of consecutive values of one column, see RowWriter::WriteRows
+struct ColumnSlab {
+  ColumnSlab(const int32_t* v) : type(arrow::Type::INT32), data(v) {}
+  ColumnSlab(const uint16_t* v) : type(arrow::Type::UINT16), data(v) {}
+  ColumnSlab(const uint32_t* v) : type(arrow::Type::UINT32), data(v) {}
+  ColumnSlab(const float* v) : type(arrow::Type::FLOAT), data(v) {}
+  arrow::Type::type type;
+  const void* data;
+};
+
+// Writes rows of a flat schema of required INT32 and FLOAT columns one value
+// at a time, like parquet::StreamWriter, whose row and row group markers it
+// accepts. Close must be called to complete the file.
+class RowWriter {
+ public:
+  virtual ~RowWriter() {}
+
+  RowWriter& operator<<(int32_t v) {
+    WriteInt32(v);
+    return *this;
+  }
+  RowWriter& operator<<(uint16_t v) {
+    WriteUInt16(v);
+    return *this;
+  }
+  RowWriter& operator<<(uint32_t v) {
+    WriteUInt32(v);
+    return *this;
+  }
+  RowWriter& operator<<(float v) {
+    WriteFloat(v);
+    return *this;
+  }
+  RowWriter& operator<<(parquet::EndRowType) {
+    EndRow();
+    return *this;
+  }
+  RowWriter& operator<<(parquet::EndRowGroupType) {
+    EndRowGroup();
+    return *this;
+  }
+
+  // Write n rows given as one slab per column, in schema order. Formats
+  // without a columnar path write them one value at a time.
+  virtual void WriteRows(const std::vector<ColumnSlab>& columns, int64_t n) {
+    for (int64_t r = 0; r < n; r++) {
+      for (const ColumnSlab& c : columns) {
+        switch (c.type) {
+          case arrow::Type::INT32:
+            WriteInt32(static_cast<const int32_t*>(c.data)[r]);
+            break;
+          case arrow::Type::UINT16:
+            WriteUInt16(static_cast<const uint16_t*>(c.data)[r]);
+            break;
+          case arrow::Type::UINT32:
+            WriteUInt32(static_cast<const uint32_t*>(c.data)[r]);
+            break;
+          default:
+            WriteFloat(static_cast<const float*>(c.data)[r]);
+        }
+      }
+      EndRow();
+    }
+  }
+
+  // Throws parquet::ParquetException on errors
+  virtual void Close() = 0;
+
+  // End row groups once they hold about max_size bytes, or only at
+  // parquet::EndRowGroup if 0, like parquet::StreamWriter. Ignored by
+  // formats without row groups.
+  virtual void SetMaxRowGroupSize(int64_t max_size) {}
+
+ protected:
+  virtual void WriteInt32(int32_t v) = 0;
+  virtual void WriteUInt16(uint16_t v) = 0;
+  virtual void WriteUInt32(uint32_t v) = 0;
+  virtual void WriteFloat(float v) = 0;
+  virtual void EndRow() = 0;
+  virtual void EndRowGroup() = 0;
+};
+
+class ParquetRowWriter : public RowWriter {
+ public:
+  explicit ParquetRowWriter(std::unique_ptr<parquet::ParquetFileWriter> writer)
+      : writer_(new parquet::StreamWriter(std::move(writer))) {}
+
+  // The file is completed when the stream writer is destroyed
+  void Close() override { writer_.reset(); }
+
+  void SetMaxRowGroupSize(int64_t max_size) override {
+    writer_->SetMaxRowGroupSize(max_size);
+  }
+
+ protected:
+  void WriteInt32(int32_t v) override { *writer_ << v; }
+  void WriteUInt16(uint16_t v) override { *writer_ << v; }
+  void WriteUInt32(uint32_t v) override { *writer_ << v; }
+  void WriteFloat(float v) override { *writer_ << v; }
+  void EndRow() override { *writer_ << parquet::EndRow; }
+  void EndRowGroup() override { *writer_ << parquet::EndRowGroup; }
+
+ private:
+  std::unique_ptr<parquet::StreamWriter> writer_;
+};
+
+// Buffers rows into columns and writes them as record batches of an Arrow
+// IPC file with the arrow equivalent of the parquet schema. Every row group
+// becomes at least one record batch. The key-value metadata is attached to
+// the arrow schema.
+class IpcRowWriter : public RowWriter {
+ public:
+  static const int64_t kBatchRows = 1 << 20;
+
+  // Throws parquet::ParquetException on errors
+  IpcRowWriter(std::shared_ptr<arrow::io::OutputStream> file,
+               const parquet::schema::GroupNode& schema,
+               std::shared_ptr<const arrow::KeyValueMetadata> kv,
+               arrow::Compression::type compression)
+      : file_(std::move(file)), col_(0), rows_(0) {
+    arrow::FieldVector fields;
+    for (int i = 0; i < schema.field_count(); i++) {
+      const parquet::schema::Node& node = *schema.field(i);
+      const parquet::schema::PrimitiveNode* p =
+          node.is_primitive()
+              ? static_cast<const parquet::schema::PrimitiveNode*>(&node)
+              : nullptr;
+      std::shared_ptr<arrow::DataType> type;
+      if (p && p->physical_type() == parquet::Type::FLOAT) {
+        type = arrow::float32();
+      } else if (p && p->physical_type() == parquet::Type::INT32) {
+        if (p->converted_type() == parquet::ConvertedType::UINT_16) {
+          type = arrow::uint16();
+        } else if (p->converted_type() == parquet::ConvertedType::UINT_32) {
+          type = arrow::uint32();
+        } else {
+          type = arrow::int32();
+        }
+      } else {
+        throw parquet::ParquetException("Unsupported column ", node.name());
+      }
+      fields.push_back(arrow::field(node.name(), type, false));
+      std::unique_ptr<arrow::ArrayBuilder> builder;
+      PARQUET_THROW_NOT_OK(
+          arrow::MakeBuilder(arrow::default_memory_pool(), type, &builder));
+      builders_.push_back(std::move(builder));
+      types_.push_back(type->id());
+    }
+    schema_ = arrow::schema(fields, std::move(kv));
+    arrow::ipc::IpcWriteOptions options =
+        arrow::ipc::IpcWriteOptions::Defaults();
+    if (compression != arrow::Compression::UNCOMPRESSED) {
+      PARQUET_ASSIGN_OR_THROW(options.codec,
+                              arrow::util::Codec::Create(compression));
+    }
+    PARQUET_ASSIGN_OR_THROW(
+        writer_, arrow::ipc::MakeFileWriter(file_, schema_, options));
+    Reserve();
+  }
+
+  void Close() override {
+    if (!writer_) {
+      return;
+    }
+    Flush();
+    PARQUET_THROW_NOT_OK(writer_->Close());
+    PARQUET_THROW_NOT_OK(file_->Close());
+    writer_.reset();
+  }
+
+ protected:
+  void WriteInt32(int32_t v) override {
+    Next<arrow::Int32Builder>(arrow::Type::INT32)->UnsafeAppend(v);
+  }
+  void WriteUInt16(uint16_t v) override {
+    Next<arrow::UInt16Builder>(arrow::Type::UINT16)->UnsafeAppend(v);
+  }
+  void WriteUInt32(uint32_t v) override {
+    Next<arrow::UInt32Builder>(arrow::Type::UINT32)->UnsafeAppend(v);
+  }
+  void WriteFloat(float v) override {
+    Next<arrow::FloatBuilder>(arrow::Type::FLOAT)->UnsafeAppend(v);
+  }
+
+  void EndRow() override {
+    if (col_ != int(builders_.size())) {
+      throw parquet::ParquetException("Short row");
+    }
+    col_ = 0;
+    if (++rows_ == kBatchRows) {
+      Flush();
+    }
+  }
+
+  void EndRowGroup() override { Flush(); }
+
+  // Slabs are appended to the builders whole, split only at batch ends
+  void WriteRows(const std::vector<ColumnSlab>& columns, int64_t n) override {
+    if (col_ != 0 || columns.size() != builders_.size()) {
+      throw parquet::ParquetException("Partial row");
+    }
+    for (size_t c = 0; c < columns.size(); c++) {
+      if (columns[c].type != types_[c]) {
+        throw parquet::ParquetException("Column type mismatch at column ", c);
+      }
+    }
+    for (int64_t done = 0; done < n;) {
+      const int64_t m = std::min(n - done, kBatchRows - rows_);
+      for (size_t c = 0; c < columns.size(); c++) {
+        switch (types_[c]) {
+          case arrow::Type::INT32:
+            AppendSlab<arrow::Int32Builder>(c, columns[c], done, m);
+            break;
+          case arrow::Type::UINT16:
+            AppendSlab<arrow::UInt16Builder>(c, columns[c], done, m);
+            break;
+          case arrow::Type::UINT32:
+            AppendSlab<arrow::UInt32Builder>(c, columns[c], done, m);
+            break;
+          default:
+            AppendSlab<arrow::FloatBuilder>(c, columns[c], done, m);
+        }
+      }
+      done += m;
+      rows_ += m;
+      if (rows_ == kBatchRows) {
+        Flush();
+      }
+    }
+  }
+
+ private:
+  // Append values [offset, offset + n) of a slab to the builder of column c
+  template <typename Builder>
+  void AppendSlab(size_t c, const ColumnSlab& slab, int64_t offset,
+                  int64_t n) {
+    typedef typename Builder::value_type T;
+    PARQUET_THROW_NOT_OK(static_cast<Builder*>(builders_[c].get())
+                             ->AppendValues(
+                                 static_cast<const T*>(slab.data) + offset, n));
+  }
+
+  // Return the builder of the next column of the row, which must be of the
+  // given type
+  template <typename Builder>
+  Builder* Next(arrow::Type::type type) {
+    if (col_ >= int(builders_.size()) || types_[col_] != type) {
+      throw parquet::ParquetException("Column type mismatch at column ", col_);
+    }
+    return static_cast<Builder*>(builders_[col_++].get());
+  }
+
+  void Reserve() {
+    for (const std::unique_ptr<arrow::ArrayBuilder>& builder : builders_) {
+      PARQUET_THROW_NOT_OK(builder->Reserve(kBatchRows));
+    }
+  }
+
+  void Flush() {
+    if (rows_ == 0) {
+      return;
+    }
+    arrow::ArrayVector columns(builders_.size());
+    for (size_t i = 0; i < builders_.size(); i++) {
+      PARQUET_THROW_NOT_OK(builders_[i]->Finish(&columns[i]));
+    }
+    PARQUET_THROW_NOT_OK(writer_->WriteRecordBatch(
+        *arrow::RecordBatch::Make(schema_, rows_, columns)));
+    rows_ = 0;
+    Reserve();
+  }
+
+  std::shared_ptr<arrow::io::OutputStream> file_;
+  std::shared_ptr<arrow::Schema> schema_;
+  std::shared_ptr<arrow::ipc::RecordBatchWriter> writer_;
+  std::vector<std::unique_ptr<arrow::ArrayBuilder>> builders_;
+  std::vector<arrow::Type::type> types_;
+  int col_;
+  int64_t rows_;
+};
+
+// Open a writer of the given format for rows of schema. Writer properties
+// only apply to parquet files. Throws parquet::ParquetException on errors.
+inline std::unique_ptr<RowWriter> OpenRowWriter(
+    const OutputFormat& format, std::shared_ptr<arrow::io::OutputStream> file,
+    std::shared_ptr<parquet::schema::GroupNode> schema,
+    std::shared_ptr<parquet::WriterProperties> properties,
+    std::shared_ptr<const arrow::KeyValueMetadata> kv) {
+  if (format.ipc) {
+    return std::unique_ptr<RowWriter>(
+        new IpcRowWriter(std::move(file), *schema, std::move(kv),
+                         format.compression));
+  }
+  return std::unique_ptr<RowWriter>(
+      new ParquetRowWriter(parquet::ParquetFileWriter::Open(
+          std::move(file), std::move(schema), std::move(properties),
+          std::move(kv))));
+}
+
+}  // namespace xrage
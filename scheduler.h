@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "timing.h"
+
+#include <parquet/exception.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace xrage {
+
+// A set of tasks that can be waited for together
+class TaskGroup {
+ public:
+  TaskGroup() : pending_(0) {}
+
+ private:
+  friend class TaskScheduler;
+  std::atomic<int> pending_;
+  std::mutex mu_;
+  std::string error_;  // First error of a task
+};
+
+// A work-stealing scheduler shared by the files of a conversion and the
+// slabs each file is split into. Every worker has a deque of tasks. It
+// runs its own tasks newest first and, when it has none, steals the oldest
+// task of another worker. Waiting for a task group runs queued tasks in the
+// meantime, so a file task that waits for its slabs helps with them and
+// idle workers steal the rest. The thread that creates the scheduler takes
+// part as worker 0 whenever it waits.
+class TaskScheduler {
+ public:
+  // threads <= 0 means one per hardware thread
+  explicit TaskScheduler(int threads) : queued_(0), stop_(false) {
+    if (threads <= 0) {
+      threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < threads; i++) {
+      workers_.emplace_back(new Worker);
+    }
+    for (int i = 1; i < threads; i++) {
+      threads_.emplace_back(&TaskScheduler::Run, this, i);
+    }
+  }
+
+  ~TaskScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& t : threads_) {
+      t.join();
+    }
+  }
+
+  int threads() const { return int(workers_.size()); }
+
+  // Queue fn as part of group on the calling worker
+  void Spawn(TaskGroup* group, std::function<void()> fn) {
+    group->pending_++;
+    Worker& w = *workers_[CurrentSlot()];
+    {
+      std::lock_guard<std::mutex> lock(w.mu);
+      w.tasks.push_back(Task{group, std::move(fn)});
+    }
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      queued_++;
+    }
+    cv_.notify_one();
+  }
+
+  // Block until every task of group has run, running queued tasks in the
+  // meantime. Throws parquet::ParquetException with the first error of a
+  // task of group.
+  void Wait(TaskGroup* group) {
+    SlotScope scope(this);
+    const int slot = CurrentSlot();
+    while (group->pending_ > 0) {
+      Task task;
+      if (FindTask(slot, &task)) {
+        Execute(slot, &task);
+        continue;
+      }
+      BeginIdle(slot);
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [&] { return queued_ > 0 || group->pending_ == 0; });
+      }
+      EndIdle(slot);
+    }
+    std::lock_guard<std::mutex> lock(group->mu_);
+    if (!group->error_.empty()) {
+      throw parquet::ParquetException(group->error_);
+    }
+  }
+
+  // One line of scheduling statistics. Idle time includes workers waiting
+  // right now.
+  std::string Summary() const {
+    const int64_t now = int64_t(NowSeconds() * 1e9);
+    int64_t tasks = 0;
+    int64_t steals = 0;
+    int64_t idle_ns = 0;
+    for (const std::unique_ptr<Worker>& w : workers_) {
+      tasks += w->tasks_run;
+      steals += w->steals;
+      idle_ns += w->idle_ns;
+      const int64_t since = w->idle_since_ns;
+      if (since > 0) {
+        idle_ns += now - since;
+      }
+    }
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "Scheduled %lld tasks on %d workers: %lld steals, %.3f s idle",
+             static_cast<long long>(tasks), threads(),
+             static_cast<long long>(steals), idle_ns * 1e-9);
+    return buf;
+  }
+
+ private:
+  struct Task {
+    TaskGroup* group;
+    std::function<void()> fn;
+  };
+
+  struct Worker {
+    Worker() : tasks_run(0), steals(0), idle_ns(0), idle_since_ns(0) {}
+    std::mutex mu;
+    std::deque<Task> tasks;
+    std::atomic<int64_t> tasks_run;
+    std::atomic<int64_t> steals;
+    std::atomic<int64_t> idle_ns;
+    std::atomic<int64_t> idle_since_ns;  // Start of the current wait, or 0
+  };
+
+  // The worker slot of the current thread
+  struct Slot {
+    const TaskScheduler* scheduler;
+    int index;
+  };
+
+  static Slot& ThreadSlot() {
+    static thread_local Slot slot = {nullptr, 0};
+    return slot;
+  }
+
+  // Threads outside of the scheduler act as worker 0
+  int CurrentSlot() const {
+    const Slot& slot = ThreadSlot();
+    return slot.scheduler == this ? slot.index : 0;
+  }
+
+  // Makes an outside thread worker 0 while it waits
+  class SlotScope {
+   public:
+    explicit SlotScope(const TaskScheduler* scheduler)
+        : saved_(ThreadSlot()) {
+      if (saved_.scheduler != scheduler) {
+        ThreadSlot() = Slot{scheduler, 0};
+      }
+    }
+    ~SlotScope() { ThreadSlot() = saved_; }
+
+   private:
+    const Slot saved_;
+  };
+
+  void BeginIdle(int slot) {
+    workers_[slot]->idle_since_ns = int64_t(NowSeconds() * 1e9);
+  }
+
+  void EndIdle(int slot) {
+    Worker& w = *workers_[slot];
+    w.idle_ns += int64_t(NowSeconds() * 1e9) - w.idle_since_ns.exchange(0);
+  }
+
+  // Take the newest task of worker slot, or steal the oldest task of
+  // another worker
+  bool FindTask(int slot, Task* task) {
+    const int n = threads();
+    for (int k = 0; k < n; k++) {
+      Worker& w = *workers_[(slot + k) % n];
+      std::lock_guard<std::mutex> lock(w.mu);
+      if (w.tasks.empty()) {
+        continue;
+      }
+      if (k == 0) {
+        *task = std::move(w.tasks.back());
+        w.tasks.pop_back();
+      } else {
+        *task = std::move(w.tasks.front());
+        w.tasks.pop_front();
+        workers_[slot]->steals++;
+      }
+      queued_--;
+      return true;
+    }
+    return false;
+  }
+
+  void Execute(int slot, Task* task) {
+    TaskGroup* const group = task->group;
+    try {
+      task->fn();
+    } catch (const std::exception& e) {
+      std::lock_guard<std::mutex> lock(group->mu_);
+      if (group->error_.empty()) {
+        group->error_ = e.what();
+      }
+    }
+    task->fn = nullptr;
+    workers_[slot]->tasks_run++;
+    if (--group->pending_ == 0) {
+      // Wake the thread waiting for the group. Taking the lock orders this
+      // with the check in Wait.
+      { std::lock_guard<std::mutex> lock(mu_); }
+      cv_.notify_all();
+    }
+  }
+
+  void Run(int slot) {
+    ThreadSlot() = Slot{this, slot};
+    for (;;) {
+      Task task;
+      if (FindTask(slot, &task)) {
+        Execute(slot, &task);
+        continue;
+      }
+      BeginIdle(slot);
+      bool stop;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        stop = stop_ && queued_ <= 0;
+      }
+      EndIdle(slot);
+      if (stop) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::atomic<int64_t> queued_;  // Tasks in all deques
+  bool stop_;
+};
+
+// Values per task when a converter splits the arrays of a file into slabs
+constexpr int64_t kSlabValues = 1 << 20;
+
+// Run fn(begin, end) over [0, n) in consecutive pieces of up to grain as
+// tasks of scheduler and wait for all of them. Throws
+// parquet::ParquetException with the first error of a piece.
+template <typename Fn>
+void ParallelFor(TaskScheduler* scheduler, int64_t n, int64_t grain, Fn fn) {
+  if (n <= grain) {
+    if (n > 0) {
+      fn(int64_t(0), n);
+    }
+    return;
+  }
+  TaskGroup group;
+  for (int64_t begin = 0; begin < n; begin += grain) {
+    const int64_t end = std::min(n, begin + grain);
+    scheduler->Spawn(&group, [&fn, begin, end]() { fn(begin, end); });
+  }
+  scheduler->Wait(&group);
+}
+
+}  // namespace xrage
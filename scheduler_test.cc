@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "scheduler.h"
+#include "test_util.h"
+
+#include <parquet/exception.h>
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void TestParallelFor() {
+  xrage::TaskScheduler scheduler(4);
+  XRAGE_CHECK(scheduler.threads() == 4);
+  // Every index is visited exactly once, in ranges of at most grain
+  const int64_t n = 100003;
+  std::vector<std::atomic<int>> visits(n);
+  for (std::atomic<int>& v : visits) {
+    v = 0;
+  }
+  std::atomic<int64_t> ranges(0);
+  xrage::ParallelFor(&scheduler, n, 1000, [&](int64_t begin, int64_t end) {
+    XRAGE_CHECK(begin < end && end - begin <= 1000);
+    for (int64_t i = begin; i < end; i++) {
+      visits[i]++;
+    }
+    ranges++;
+  });
+  for (int64_t i = 0; i < n; i++) {
+    XRAGE_CHECK(visits[i] == 1);
+  }
+  XRAGE_CHECK(ranges == (n + 999) / 1000);
+
+  // Up to grain indices run inline as one range
+  const std::thread::id caller = std::this_thread::get_id();
+  int calls = 0;
+  xrage::ParallelFor(&scheduler, 10, 10, [&](int64_t begin, int64_t end) {
+    XRAGE_CHECK(std::this_thread::get_id() == caller);
+    XRAGE_CHECK(begin == 0 && end == 10);
+    calls++;
+  });
+  XRAGE_CHECK(calls == 1);
+  // and an empty loop runs nothing
+  xrage::ParallelFor(&scheduler, 0, 10,
+                     [&](int64_t begin, int64_t end) { calls++; });
+  XRAGE_CHECK(calls == 1);
+}
+
+// File tasks that split their work into slabs, like the converters do
+void TestNested() {
+  xrage::TaskScheduler scheduler(4);
+  const int kFiles = 16;
+  const int64_t kValues = 20000;
+  std::vector<int64_t> sums(kFiles, 0);
+  xrage::TaskGroup files;
+  for (int f = 0; f < kFiles; f++) {
+    scheduler.Spawn(&files, [&, f] {
+      std::vector<int64_t> partial((kValues + 99) / 100, 0);
+      xrage::ParallelFor(&scheduler, kValues, 100,
+                         [&](int64_t begin, int64_t end) {
+                           for (int64_t i = begin; i < end; i++) {
+                             partial[begin / 100] += i * (f + 1);
+                           }
+                         });
+      for (int64_t p : partial) {
+        sums[f] += p;
+      }
+    });
+  }
+  scheduler.Wait(&files);
+  for (int f = 0; f < kFiles; f++) {
+    XRAGE_CHECK(sums[f] == kValues * (kValues - 1) / 2 * (f + 1));
+  }
+}
+
+void TestErrors() {
+  xrage::TaskScheduler scheduler(3);
+  std::atomic<int> done(0);
+  xrage::TaskGroup group;
+  for (int t = 0; t < 50; t++) {
+    scheduler.Spawn(&group, [&, t] {
+      if (t == 17) {
+        throw parquet::ParquetException("Task ", t, " failed");
+      }
+      done++;
+    });
+  }
+  std::string error;
+  try {
+    scheduler.Wait(&group);
+  } catch (const parquet::ParquetException& e) {
+    error = e.what();
+  }
+  XRAGE_CHECK(error.find("Task 17 failed") != std::string::npos);
+  // The other tasks still ran
+  XRAGE_CHECK(done == 49);
+
+  // A failed range fails the whole loop
+  XRAGE_CHECK(xrage::Throws([&] {
+    xrage::ParallelFor(&scheduler, 1000, 10, [](int64_t begin, int64_t) {
+      if (begin == 500) {
+        throw parquet::ParquetException("Range failed");
+      }
+    });
+  }));
+  // and leaves the scheduler usable
+  std::atomic<int64_t> count(0);
+  xrage::ParallelFor(&scheduler, 1000, 10,
+                     [&](int64_t begin, int64_t end) { count += end - begin; });
+  XRAGE_CHECK(count == 1000);
+}
+
+}  // namespace
+
+int main() {
+  xrage::RunTest("ParallelFor", TestParallelFor);
+  xrage::RunTest("Nested", TestNested);
+  xrage::RunTest("Errors", TestErrors);
+  return 0;
+}
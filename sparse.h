@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include "kernels.h"
+#include "roi.h"
+
+#include <arrow/util/key_value_metadata.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace xrage {
+
+// Sparse output of the v2 converters
+struct SparseOptions {
+  SparseOptions() : enabled(false), threshold(0) {}
+  // Only write cells where v02 or v03 is greater than threshold in absolute
+  // value. Omitted cells are implied to be 0.
+  bool enabled;
+  float threshold;
+
+  // Return the indices of the cells to write out of the n cells of a grid,
+  // in increasing order
+  std::vector<int32_t> SelectCells(const float* v02, const float* v03,
+                                   int n) const {
+    std::vector<int32_t> cells(n);
+    cells.resize(xrage::SelectCells(v02, v03, n, threshold, cells.data()));
+    printf("Keeping %zu/%d non-empty cells\n", cells.size(), n);
+    return cells;
+  }
+};
+
+// Record how the cells of a grid were selected. rowid is relative to the
+// extent the region of interest resolved to, which callers record next to
+// it.
+inline void AddSelectionMetadata(const SparseOptions& sparse, const Roi& roi,
+                                 arrow::KeyValueMetadata* kv) {
+  if (sparse.enabled) {
+    kv->Append("sparse", "true");
+    kv->Append("sparse_threshold", std::to_string(sparse.threshold));
+    kv->Append("fill_value", "0");
+  }
+  if (roi.enabled) {
+    kv->Append(roi.physical ? "roi_phys" : "roi", roi.spec);
+  }
+}
+
+}  // namespace xrage
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <parquet/exception.h>
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks for the unit tests, which do not depend on a test framework. A
+// failed check prints its location and exits with failure, which ctest
+// reports.
+#define XRAGE_CHECK(cond)                                              \
+  do {                                                                 \
+    if (!(cond)) {                                                     \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+              #cond);                                                  \
+      exit(EXIT_FAILURE);                                              \
+    }                                                                  \
+  } while (0)
+
+namespace xrage {
+
+// A directory for the files of a test, removed with its files when the test
+// is done. It is created under $TMPDIR, or /tmp if unset. A failed check
+// exits without removing it, which leaves the files for inspection.
+class TestDir {
+ public:
+  TestDir() {
+    const char* tmp = getenv("TMPDIR");
+    path_ = std::string(tmp && *tmp ? tmp : "/tmp") + "/xrage_test.XXXXXX";
+    if (!mkdtemp(&path_[0])) {
+      perror("mkdtemp");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  ~TestDir() {
+    DIR* const dir = opendir(path_.c_str());
+    if (dir) {
+      struct dirent* entry;
+      while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_type == DT_REG) {
+          unlink(File(entry->d_name).c_str());
+        }
+      }
+      closedir(dir);
+    }
+    rmdir(path_.c_str());
+  }
+
+  const std::string& path() const { return path_; }
+  std::string File(const std::string& name) const {
+    return path_ + "/" + name;
+  }
+
+ private:
+  // No copying allowed
+  TestDir(const TestDir&);
+  void operator=(const TestDir& other);
+
+  std::string path_;
+};
+
+// Return whether fn throws parquet::ParquetException, the way the library
+// reports errors
+template <typename Fn>
+bool Throws(Fn fn) {
+  try {
+    fn();
+  } catch (const parquet::ParquetException&) {
+    return true;
+  }
+  return false;
+}
+
+// Return n > 10 smoothly varying values with noise and the bit patterns
+// that trouble encoders: signed zeros, denormals, infinities, NaNs and
+// jumps between magnitudes
+inline std::vector<float> TestValues(size_t n) {
+  std::mt19937 rng(42);
+  std::normal_distribution<float> noise(0, 1);
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) {
+    v[i] = sinf(i * 0.01f) * 1000 + noise(rng);
+  }
+  const float special[] = {0.0f,
+                           -0.0f,
+                           std::numeric_limits<float>::denorm_min(),
+                           -std::numeric_limits<float>::denorm_min(),
+                           std::numeric_limits<float>::max(),
+                           std::numeric_limits<float>::lowest(),
+                           INFINITY,
+                           -INFINITY,
+                           NAN,
+                           1e-30f,
+                           -1e30f};
+  for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++) {
+    v[(i * 97 + 13) % n] = special[i];
+  }
+  return v;
+}
+
+// Run a test function, announcing it first so that a failed check can be
+// told apart from the output of the test before it
+inline void RunTest(const char* name, void (*test)()) {
+  printf("%s\n", name);
+  fflush(stdout);
+  test();
+}
+
+}  // namespace xrage
@@ -32,6 +32,18 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "async_output.h"
+#include "chunk_store.h"
+#include "column_codecs.h"
+#include "kernels.h"
+#include "lorenzo.h"
+#include "prefetch.h"
+#include "raw_export.h"
+#include "roi.h"
+#include "row_writer.h"
+#include "scheduler.h"
+#include "work_list.h"
+
 #include <arrow/io/file.h>
 #include <arrow/util/key_value_metadata.h>
 #include <parquet/stream_writer.h>
@@ -46,13 +58,16 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <getopt.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace {
 
@@ -62,9 +77,20 @@ class Iterator {
   ~Iterator() {}
 
   void SeekToFirst() { i_ = 0; }
+  void Seek(int i) { i_ = i; }
   bool Valid() const { return i_ >= 0 && i_ < n_; }
   void Next() { i_++; }
 
+  // Index of the current element in vtk point order
+  int index() const { return i_; }
+
+  // Raw arrays for bulk kernels
+  int size() const { return n_; }
+  const float* v02_data() const { return v02_; }
+  const float* v03_data() const { return v03_; }
+  float* v02_data() { return v02_; }
+  float* v03_data() { return v03_; }
+
   float prs() const { return prs_[i_]; }
   float tev() const { return tev_[i_]; }
   float v02() const { return v02_[i_]; }
@@ -119,16 +145,66 @@ std::unordered_map<std::string, std::string> ExtraMetadata(
   return kv;
 }
 
+// Values are rounded to 6 decimal places before being written
+inline float RoundValue(float v) { return roundf(v * 1000000) / 1000000; }
+
+// Scaled integer representation of a value column. A value v is stored as
+// q = round((v - offset) / scale), which reads back as offset + q * scale.
+struct Quantization {
+  double error;  // Maximum absolute error, scale / 2
+  double offset;
+  double scale;
+  int bits;                      // 16 or 32
+  std::vector<uint32_t> values;  // Quantized values in vtk point order
+
+  // Value as it is written to the file
+  float Value(int idx) const {
+    return float(offset + double(int32_t(values[idx])) * scale);
+  }
+};
+
+// How the values of a column are written. By default values are written as
+// floats rounded with RoundValue.
+struct ValueColumn {
+  ValueColumn() : round(true), q(nullptr), residuals(nullptr) {}
+  // Groomed columns are written as is
+  bool round;
+  // Write quantized integers instead of floats
+  const Quantization* q;
+  // Write Lorenzo residuals (see lorenzo.h) instead of floats
+  const int32_t* residuals;
+
+  // Value of the column at point idx as it is read back from the file
+  float Value(float v, int idx) const {
+    return q ? q->Value(idx) : round ? RoundValue(v) : v;
+  }
+};
+
 struct ParquetWriterOptions {
-  ParquetWriterOptions() {}
+  ParquetWriterOptions() : random_access(0) {}
+  xrage::ColumnCodecs codecs;
+  xrage::ColumnPrecision precision;
+  xrage::AutoCodec auto_codec;
+  xrage::PageIndex page_index;
+  // Rows per data page of the random-access profile, or 0
+  int random_access;
+  xrage::OutputFormat format;
+  xrage::OutputStreamOptions stream;
 };
 
 class ParquetWriter {
  public:
   ParquetWriter(const ParquetWriterOptions& options,
                 std::shared_ptr<arrow::io::OutputStream> file,
-                std::shared_ptr<const arrow::KeyValueMetadata> kv);
-  void Append(Iterator* it);
+                std::shared_ptr<const arrow::KeyValueMetadata> kv,
+                const ValueColumn& v02, const ValueColumn& v03);
+  // Append the rows of the n points at rowids, or of the first n points in
+  // vtk order if rowids is null. Rows are handed to the writer one slab of
+  // columns at a time.
+  void AppendRows(const Iterator& it, const int32_t* rowids, int n);
+  // Only end row groups at FlushRowGroup, so that they match the zone map
+  void ExplicitRowGroups() { writer_->SetMaxRowGroupSize(0); }
+  void FlushRowGroup();
   void Finish();
   ~ParquetWriter();
 
@@ -136,12 +212,48 @@ class ParquetWriter {
   // No copying allowed
   ParquetWriter(const ParquetWriter&);
   void operator=(const ParquetWriter& other);
-  parquet::StreamWriter* writer_;
-  int32_t rowid_;
+  // The values of a column as written for a slab of AppendRows. Gathered
+  // or converted values are stored in the buffers.
+  struct SlabBuffers {
+    std::vector<float> f;
+    std::vector<int32_t> i32;
+    std::vector<uint16_t> u16;
+    std::vector<uint32_t> u32;
+  };
+  xrage::ColumnSlab Slab(const float* v, const ValueColumn& c,
+                         const int32_t* ids, int begin, int n,
+                         SlabBuffers* buf);
+  xrage::RowWriter* writer_;
+  ValueColumn v02_;
+  ValueColumn v03_;
+  bool pending_rgflush_;
+  std::vector<int32_t> ids_;
+  SlabBuffers b02_;
+  SlabBuffers b03_;
 };
 
 namespace {
-std::shared_ptr<parquet::schema::GroupNode> GetSchema() {
+// Quantized columns are stored as unsigned integers of the smallest width
+// that holds all quantized values. Lorenzo residuals are signed integers.
+parquet::schema::NodePtr ValueNode(const char* name, const ValueColumn& c) {
+  if (c.residuals) {
+    return parquet::schema::PrimitiveNode::Make(
+        name, parquet::Repetition::REQUIRED, parquet::Type::INT32,
+        parquet::ConvertedType::INT_32);
+  }
+  if (c.q) {
+    return parquet::schema::PrimitiveNode::Make(
+        name, parquet::Repetition::REQUIRED, parquet::Type::INT32,
+        c.q->bits == 16 ? parquet::ConvertedType::UINT_16
+                        : parquet::ConvertedType::UINT_32);
+  }
+  return parquet::schema::PrimitiveNode::Make(
+      name, parquet::Repetition::REQUIRED, parquet::Type::FLOAT,
+      parquet::ConvertedType::NONE);
+}
+
+std::shared_ptr<parquet::schema::GroupNode> GetSchema(const ValueColumn& v02,
+                                                      const ValueColumn& v03) {
   parquet::schema::NodeVector fields;
   fields.push_back(parquet::schema::PrimitiveNode::Make(
       "rowid", parquet::Repetition::REQUIRED, parquet::Type::INT32,
@@ -152,40 +264,133 @@ std::shared_ptr<parquet::schema::GroupNode> GetSchema() {
   //  fields.push_back(parquet::schema::PrimitiveNode::Make(
   //      "tev", parquet::Repetition::REQUIRED, parquet::Type::FLOAT,
   //      parquet::ConvertedType::NONE));
-  fields.push_back(parquet::schema::PrimitiveNode::Make(
-      "v02", parquet::Repetition::REQUIRED, parquet::Type::FLOAT,
-      parquet::ConvertedType::NONE));
-  fields.push_back(parquet::schema::PrimitiveNode::Make(
-      "v03", parquet::Repetition::REQUIRED, parquet::Type::FLOAT,
-      parquet::ConvertedType::NONE));
+  fields.push_back(ValueNode("v02", v02));
+  fields.push_back(ValueNode("v03", v03));
   return std::static_pointer_cast<parquet::schema::GroupNode>(
       parquet::schema::GroupNode::Make("schema", parquet::Repetition::REQUIRED,
                                        fields));
 }
+
+void SetValueDefaults(const char* name, const ValueColumn& c,
+                      parquet::WriterProperties::Builder* builder) {
+  if (c.residuals) {
+    // Residuals are mostly small integers that only pay off once compressed
+    builder->compression(name, parquet::Compression::ZSTD);
+  }
+}
+
+void SetValueEncoding(const char* name, const ValueColumn& c,
+                      parquet::WriterProperties::Builder* builder) {
+  if (c.q) {
+    // Quantized values are bit-packed
+    builder->encoding(name, parquet::Encoding::DELTA_BINARY_PACKED);
+  }
+}
 }  // namespace
 
 ParquetWriter::ParquetWriter(const ParquetWriterOptions& options,
                              std::shared_ptr<arrow::io::OutputStream> file,
-                             std::shared_ptr<const arrow::KeyValueMetadata> kv)
-    : writer_(nullptr), rowid_(0) {
+                             std::shared_ptr<const arrow::KeyValueMetadata> kv,
+                             const ValueColumn& v02, const ValueColumn& v03)
+    : writer_(nullptr), v02_(v02), v03_(v03), pending_rgflush_(false) {
   parquet::WriterProperties::Builder builder;
   builder.compression("rowid", parquet::Compression::SNAPPY);
   builder.compression(parquet::Compression::UNCOMPRESSED);
   builder.encoding("rowid", parquet::Encoding::DELTA_BINARY_PACKED);
   builder.encoding(parquet::Encoding::PLAIN);
   builder.disable_dictionary();
-  writer_ = new parquet::StreamWriter(parquet::ParquetFileWriter::Open(
-      std::move(file), GetSchema(), builder.build(), std::move(kv)));
+  SetValueDefaults("v02", v02, &builder);
+  SetValueDefaults("v03", v03, &builder);
+  options.codecs.Apply({"v02", "v03"}, &builder);
+  options.page_index.Apply(&builder);
+  SetValueEncoding("v02", v02, &builder);
+  SetValueEncoding("v03", v03, &builder);
+  if (options.random_access > 0) {
+    // Uncompressed PLAIN pages of a fixed number of rows put every value at
+    // an offset computable from the offset index (see xrage::CellLookup)
+    for (const char* name : {"v02", "v03"}) {
+      builder.encoding(name, parquet::Encoding::PLAIN);
+      builder.compression(name, parquet::Compression::UNCOMPRESSED);
+    }
+    builder.data_pagesize(int64_t(options.random_access) * sizeof(float));
+    builder.enable_write_page_index();
+  }
+  writer_ = xrage::OpenRowWriter(options.format, std::move(file),
+                                 GetSchema(v02, v03), builder.build(),
+                                 std::move(kv))
+                .release();
 }
 
-void ParquetWriter::Append(Iterator* it) {
-  //*writer_ << it->prs() << it->tev() << it->v02() << it->v03()
-  //       << parquet::EndRow;
-  *writer_ << rowid_++ << roundf(it->v02() * 1000000) / 1000000
-           << roundf(it->v03() * 1000000) / 1000000 << parquet::EndRow;
+namespace {
+// Return the n values of v at ids, or from begin on if ids is null, storing
+// them in out if they need to be gathered
+template <typename T>
+const T* Gather(const T* v, const int32_t* ids, int begin, int n,
+                std::vector<T>* out) {
+  if (!ids) {
+    return v + begin;
+  }
+  out->resize(n);
+  for (int i = 0; i < n; i++) {
+    (*out)[i] = v[ids[i]];
+  }
+  return out->data();
+}
+}  // namespace
+
+void ParquetWriter::AppendRows(const Iterator& it, const int32_t* rowids,
+                               int n) {
+  if (pending_rgflush_) {
+    *writer_ << parquet::EndRowGroup;
+    pending_rgflush_ = false;
+  }
+  for (int begin = 0; begin < n; begin += xrage::kSlabValues) {
+    const int m = std::min<int>(n - begin, xrage::kSlabValues);
+    const int32_t* ids = rowids ? rowids + begin : nullptr;
+    const int32_t* rowid = ids;
+    if (!rowid) {
+      ids_.resize(m);
+      for (int i = 0; i < m; i++) {
+        ids_[i] = begin + i;
+      }
+      rowid = ids_.data();
+    }
+    writer_->WriteRows({rowid, Slab(it.v02_data(), v02_, ids, begin, m, &b02_),
+                        Slab(it.v03_data(), v03_, ids, begin, m, &b03_)},
+                       m);
+  }
+}
+
+xrage::ColumnSlab ParquetWriter::Slab(const float* v, const ValueColumn& c,
+                                      const int32_t* ids, int begin, int n,
+                                      SlabBuffers* buf) {
+  if (c.residuals) {
+    return Gather(c.residuals, ids, begin, n, &buf->i32);
+  }
+  if (c.q && c.q->bits == 16) {
+    buf->u16.resize(n);
+    for (int i = 0; i < n; i++) {
+      buf->u16[i] = uint16_t(c.q->values[ids ? ids[i] : begin + i]);
+    }
+    return buf->u16.data();
+  }
+  if (c.q) {
+    return Gather(c.q->values.data(), ids, begin, n, &buf->u32);
+  }
+  if (c.round) {
+    buf->f.resize(n);
+    for (int i = 0; i < n; i++) {
+      buf->f[i] = RoundValue(v[ids ? ids[i] : begin + i]);
+    }
+    return buf->f.data();
+  }
+  return Gather(v, ids, begin, n, &buf->f);
 }
 
+void ParquetWriter::FlushRowGroup() { pending_rgflush_ = true; }
+
 void ParquetWriter::Finish() {
+  writer_->Close();
   delete writer_;
   writer_ = nullptr;
 }
@@ -203,32 +408,679 @@ inline bool StringEndWith(const std::string& str, const char* suffix) {
   return std::strncmp(&str[0] + lenstr - lensuffix, suffix, lensuffix) == 0;
 }
 
-void Rewrite(const std::string& from, const std::string& to) {
+enum Layout { kNatural, kMorton, kHilbert, kBrick };
+
+struct RewriteOptions {
+  RewriteOptions()
+      : layout(kNatural),
+        rows_per_group(1 << 20),
+        brick_size(32),
+        sparse(false),
+        sparse_threshold(0),
+        crop(false),
+        crop_threshold(0),
+        lorenzo(false),
+        lorenzo_slab(64),
+        raw(false),
+        jobs(1),
+        threads(0) {}
+  // Order in which grid points are written as rows
+  Layout layout;
+  // Number of rows in each row group for the morton and hilbert layouts, and
+  // the minimum for the brick layout, which never splits a brick
+  int rows_per_group;
+  // Edge length of the cubic bricks of the brick layout. Consecutive bricks
+  // are written to the same row group until it has rows_per_group rows.
+  int brick_size;
+  // Only write cells where v02 or v03 is greater than sparse_threshold in
+  // absolute value. Omitted cells are implied to be 0.
+  bool sparse;
+  float sparse_threshold;
+  // Only write the bounding box of the cells where v02 or v03 is greater
+  // than crop_threshold in absolute value
+  bool crop;
+  float crop_threshold;
+  // Only read and write this part of each grid
+  xrage::Roi roi;
+  // Store value columns as integers quantized to the given maximum absolute
+  // error. The "" entry applies to all value columns.
+  std::unordered_map<std::string, double> quantize;
+  // Store value columns as Lorenzo prediction residuals computed over slabs
+  // of lorenzo_slab planes
+  bool lorenzo;
+  int lorenzo_slab;
+  // Also export the value columns of every grid as .npy files with a JSON
+  // sidecar (see raw_export.h)
+  bool raw;
+  // Write a chunk store of the value columns instead of a parquet file
+  xrage::ChunkStoreOptions chunks;
+  // Read ahead upcoming input files while converting
+  xrage::PrefetchOptions prefetch;
+  // Number of files converted at once
+  int jobs;
+  // Number of workers shared by the files and the tasks they are split
+  // into. 0 means one per core.
+  int threads;
+  ParquetWriterOptions writer;
+};
+
+// Parse a "[column=]error" quantization setting
+bool ParseQuantize(const char* str, RewriteOptions* options) {
+  const char* eq = strchr(str, '=');
+  const std::string column = eq ? std::string(str, eq - str) : "";
+  if (!column.empty() && column != "v02" && column != "v03") {
+    return false;
+  }
+  char* end;
+  const double error = strtod(eq ? eq + 1 : str, &end);
+  if (*end != '\0' || !(error > 0)) {
+    return false;
+  }
+  options->quantize[column] = error;
+  return true;
+}
+
+// Quantize the n values of v so that none is off by more than error. The
+// offset is the smallest value and the scale is twice the error. Exits if
+// any value is NaN or infinite, since those have no quantized value.
+void QuantizeColumn(xrage::TaskScheduler* scheduler, const char* name,
+                    const float* v, int n, double error, Quantization* q,
+                    std::unordered_map<std::string, std::string>* kv) {
+  // The range is reduced over slabs, then the slabs are quantized
+  const int64_t slabs = (n + xrage::kSlabValues - 1) / xrage::kSlabValues;
+  std::vector<float> slab_lo(slabs);
+  std::vector<float> slab_hi(slabs);
+  // Index of the first non-finite value of each slab, or -1
+  std::vector<int64_t> slab_bad(slabs, -1);
+  xrage::ParallelFor(scheduler, slabs, 1, [&](int64_t b, int64_t e) {
+    for (int64_t s = b; s < e; s++) {
+      const int64_t begin = s * xrage::kSlabValues;
+      const size_t len = std::min<int64_t>(n - begin, xrage::kSlabValues);
+      const size_t bad = xrage::FindNonFinite(v + begin, len);
+      if (bad < len) {
+        slab_bad[s] = begin + bad;
+      } else {
+        xrage::MinMax(v + begin, len, &slab_lo[s], &slab_hi[s]);
+      }
+    }
+  });
+  for (int64_t s = 0; s < slabs; s++) {
+    if (slab_bad[s] >= 0) {
+      fprintf(stderr,
+              "Cannot quantize %s: value %g at cell %lld is not finite\n",
+              name, v[slab_bad[s]], static_cast<long long>(slab_bad[s]));
+      exit(EXIT_FAILURE);
+    }
+  }
+  float lo = 0;
+  float hi = 0;
+  if (n > 0) {
+    lo = *std::min_element(slab_lo.begin(), slab_lo.end());
+    hi = *std::max_element(slab_hi.begin(), slab_hi.end());
+  }
+  q->error = error;
+  q->offset = lo;
+  q->scale = 2 * error;
+  const double qmax = floor((double(hi) - lo) / q->scale + 0.5);
+  if (!(qmax < 2147483648.0)) {
+    fprintf(stderr, "Quantization error %g is too small for %s range %g:%g\n",
+            error, name, lo, hi);
+    exit(EXIT_FAILURE);
+  }
+  q->bits = qmax <= 65535 ? 16 : 32;
+  q->values.resize(n);
+  xrage::ParallelFor(scheduler, n, xrage::kSlabValues,
+                     [&](int64_t begin, int64_t end) {
+                       xrage::Quantize(v + begin, end - begin, q->offset,
+                                       q->scale, q->values.data() + begin);
+                     });
+  char buf[32];
+  const std::string col(name);
+  snprintf(buf, sizeof(buf), "%.17g", q->offset);
+  (*kv)[col + "_offset"] = buf;
+  snprintf(buf, sizeof(buf), "%.17g", q->scale);
+  (*kv)[col + "_scale"] = buf;
+  snprintf(buf, sizeof(buf), "%.17g", q->error);
+  (*kv)[col + "_quantize_error"] = buf;
+  printf("Quantizing %s to %d bits (offset %g, scale %g)\n", name, q->bits,
+         q->offset, q->scale);
+}
+
+// Replace the values of a column by the Lorenzo residuals of the values that
+// would otherwise be written. Every predictor slab is one task.
+void PredictColumn(const RewriteOptions& options,
+                   xrage::TaskScheduler* scheduler, vtkImageData* image,
+                   const float* v, ValueColumn* c,
+                   std::vector<int32_t>* residuals) {
+  int* ext = image->GetExtent();
+  const int nx = ext[1] - ext[0] + 1;
+  const int ny = ext[3] - ext[2] + 1;
+  const int nz = ext[5] - ext[4] + 1;
+  const int slab = options.lorenzo_slab;
+  const int64_t plane = int64_t(nx) * ny;
+  std::vector<float> values(image->GetNumberOfPoints());
+  residuals->resize(values.size());
+  xrage::ParallelFor(
+      scheduler, xrage::LorenzoSlabs(nz, slab), 1, [&](int64_t b, int64_t e) {
+        for (int64_t s = b; s < e; s++) {
+          const int64_t end = std::min<int64_t>(nz, (s + 1) * slab) * plane;
+          for (int64_t i = s * slab * plane; i < end; i++) {
+            values[i] = c->Value(v[i], int(i));
+          }
+          xrage::LorenzoEncodeSlab(values.data(), nx, ny, nz, slab, int(s),
+                                   residuals->data());
+        }
+      });
+  c->residuals = residuals->data();
+}
+
+// Pick the codec of a float value column from a sample of the values that
+// are written, in the order they are written. Rows are the cells listed in
+// order when it is not empty.
+void ChooseCodec(const ParquetWriterOptions& options, const char* name,
+                 const float* v, int n, const std::vector<int32_t>& order,
+                 const ValueColumn& c, xrage::ColumnCodecs* codecs,
+                 std::unordered_map<std::string, std::string>* kv) {
+  if (c.q || c.residuals) {
+    return;
+  }
+  std::vector<float> sample;
+  if (order.empty()) {
+    xrage::SampleValues(v, n, &sample);
+  } else {
+    xrage::SampleValues(v, int64_t(order.size()), &sample, order.data());
+  }
+  if (c.round) {
+    for (float& x : sample) {
+      x = RoundValue(x);
+    }
+  }
+  const char* codec =
+      xrage::AutoSelectCodec(options.auto_codec, name, sample, codecs);
+  if (codec) {
+    (*kv)[std::string(name) + "_codec"] = codec;
+  }
+}
+
+// Pick the codecs of both value columns. Columns are measured one at a time
+// so that their timings are comparable.
+void ChooseCodecs(const ParquetWriterOptions& options, const Iterator& it,
+                  const std::vector<int32_t>& order, const ValueColumn& c02,
+                  const ValueColumn& c03, xrage::ColumnCodecs* codecs,
+                  std::unordered_map<std::string, std::string>* kv) {
+  ChooseCodec(options, "v02", it.v02_data(), it.size(), order, c02, codecs,
+              kv);
+  ChooseCodec(options, "v03", it.v03_data(), it.size(), order, c03, codecs,
+              kv);
+}
+
+// Return the quantization error of a column, or 0 if it is not quantized
+double QuantizeError(const RewriteOptions& options, const std::string& column) {
+  auto it = options.quantize.find(column);
+  if (it == options.quantize.end()) {
+    it = options.quantize.find("");
+  }
+  return it != options.quantize.end() ? it->second : 0;
+}
+
+// Spread the lower 21 bits of x so that there are two zero bits between
+// every two consecutive bits.
+inline uint64_t SpreadBits(uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+inline uint64_t MortonKey(uint32_t i, uint32_t j, uint32_t k) {
+  return SpreadBits(i) | SpreadBits(j) << 1 | SpreadBits(k) << 2;
+}
+
+// Hilbert index of a point in a 2^bits cube. Uses John Skilling's transpose
+// algorithm ("Programming the Hilbert curve", AIP Conf. Proc. 707, 2004).
+inline uint64_t HilbertKey(uint32_t i, uint32_t j, uint32_t k, int bits) {
+  uint32_t x[3] = {k, j, i};
+  const uint32_t m = 1u << (bits - 1);
+  for (uint32_t q = m; q > 1; q >>= 1) {
+    const uint32_t p = q - 1;
+    for (int d = 0; d < 3; d++) {
+      if (x[d] & q) {
+        x[0] ^= p;
+      } else {
+        const uint32_t t = (x[0] ^ x[d]) & p;
+        x[0] ^= t;
+        x[d] ^= t;
+      }
+    }
+  }
+  x[1] ^= x[0];
+  x[2] ^= x[1];
+  uint32_t t = 0;
+  for (uint32_t q = m; q > 1; q >>= 1) {
+    if (x[2] & q) t ^= q - 1;
+  }
+  x[0] ^= t;
+  x[1] ^= t;
+  x[2] ^= t;
+  return MortonKey(x[2], x[1], x[0]);
+}
+
+// The vtk point indices of an image in the order they should be written,
+// together with the end offset of each row group in that order.
+struct SpatialOrder {
+  std::vector<int32_t> order;
+  std::vector<size_t> group_ends;
+};
+
+void CurveOrder(const RewriteOptions& options, vtkImageData* image,
+                SpatialOrder* result) {
+  int* ext = image->GetExtent();
+  const uint32_t nx = ext[1] - ext[0] + 1;
+  const uint32_t ny = ext[3] - ext[2] + 1;
+  const uint32_t nz = ext[5] - ext[4] + 1;
+  int bits = 1;
+  while ((1u << bits) < std::max(nx, std::max(ny, nz))) bits++;
+  struct Entry {
+    uint64_t key;
+    int32_t idx;
+    bool operator<(const Entry& other) const { return key < other.key; }
+  };
+  std::vector<Entry> entries;
+  entries.reserve(size_t(nx) * ny * nz);
+  int32_t idx = 0;
+  for (uint32_t k = 0; k < nz; k++) {
+    for (uint32_t j = 0; j < ny; j++) {
+      for (uint32_t i = 0; i < nx; i++) {
+        const uint64_t key = options.layout == kHilbert
+                                 ? HilbertKey(i, j, k, bits)
+                                 : MortonKey(i, j, k);
+        entries.push_back(Entry{key, idx++});
+      }
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+  result->order.reserve(entries.size());
+  for (const Entry& e : entries) {
+    result->order.push_back(e.idx);
+  }
+  for (size_t r = options.rows_per_group; r < entries.size();
+       r += options.rows_per_group) {
+    result->group_ends.push_back(r);
+  }
+  result->group_ends.push_back(entries.size());
+}
+
+void BrickOrder(const RewriteOptions& options, vtkImageData* image,
+                SpatialOrder* result) {
+  int* ext = image->GetExtent();
+  const int nx = ext[1] - ext[0] + 1;
+  const int ny = ext[3] - ext[2] + 1;
+  const int nz = ext[5] - ext[4] + 1;
+  const int b = options.brick_size;
+  result->order.reserve(size_t(nx) * ny * nz);
+  for (int bk = 0; bk < nz; bk += b) {
+    for (int bj = 0; bj < ny; bj += b) {
+      for (int bi = 0; bi < nx; bi += b) {
+        for (int k = bk; k < std::min(bk + b, nz); k++) {
+          for (int j = bj; j < std::min(bj + b, ny); j++) {
+            for (int i = bi; i < std::min(bi + b, nx); i++) {
+              result->order.push_back((k * ny + j) * nx + i);
+            }
+          }
+        }
+        const size_t begin =
+            result->group_ends.empty() ? 0 : result->group_ends.back();
+        if (result->order.size() - begin >= size_t(options.rows_per_group)) {
+          result->group_ends.push_back(result->order.size());
+        }
+      }
+    }
+  }
+  if (result->group_ends.empty() ||
+      result->group_ends.back() != result->order.size()) {
+    result->group_ends.push_back(result->order.size());
+  }
+}
+
+// Drop from an order all points not in cells, which must be sorted. Row groups
+// left empty are removed.
+void FilterOrder(const std::vector<int32_t>& cells, int n, SpatialOrder* so) {
+  std::vector<uint8_t> keep(n, 0);
+  for (int32_t c : cells) {
+    keep[c] = 1;
+  }
+  std::vector<size_t> group_ends;
+  size_t m = 0;
+  size_t r = 0;
+  for (size_t end : so->group_ends) {
+    for (; r < end; r++) {
+      so->order[m] = so->order[r];
+      m += keep[so->order[r]];
+    }
+    if (group_ends.empty() ? m != 0 : m != group_ends.back()) {
+      group_ends.push_back(m);
+    }
+  }
+  so->order.resize(m);
+  so->group_ends.swap(group_ends);
+}
+
+// The (i,j,k) bounding box and the min/max of every written column of a row
+// group. Boxes are inclusive and expressed in extent coordinates.
+struct ZoneMapEntry {
+  int lo[3];
+  int hi[3];
+  int32_t rowid_min, rowid_max;
+  float v02_min, v02_max;
+  float v03_min, v03_max;
+};
+
+// Every row group is one task
+std::vector<ZoneMapEntry> BuildZoneMap(xrage::TaskScheduler* scheduler,
+                                       const SpatialOrder& so,
+                                       vtkImageData* image,
+                                       const ValueColumn& c02,
+                                       const ValueColumn& c03) {
+  int* ext = image->GetExtent();
+  const int nx = ext[1] - ext[0] + 1;
+  const int ny = ext[3] - ext[2] + 1;
+  std::vector<ZoneMapEntry> zm(so.group_ends.size());
+  xrage::ParallelFor(scheduler, zm.size(), 1, [&](int64_t begin, int64_t end) {
+    Iterator it(image);
+    for (int64_t g = begin; g < end; g++) {
+      ZoneMapEntry& e = zm[g];
+      e.lo[0] = e.lo[1] = e.lo[2] = INT32_MAX;
+      e.hi[0] = e.hi[1] = e.hi[2] = INT32_MIN;
+      e.rowid_min = INT32_MAX;
+      e.rowid_max = INT32_MIN;
+      e.v02_min = e.v03_min = INFINITY;
+      e.v02_max = e.v03_max = -INFINITY;
+      for (size_t r = g > 0 ? so.group_ends[g - 1] : 0;
+           r < so.group_ends[g]; r++) {
+        const int idx = so.order[r];
+        const int ijk[3] = {idx % nx, idx / nx % ny, idx / nx / ny};
+        for (int d = 0; d < 3; d++) {
+          e.lo[d] = std::min(e.lo[d], ext[2 * d] + ijk[d]);
+          e.hi[d] = std::max(e.hi[d], ext[2 * d] + ijk[d]);
+        }
+        it.Seek(idx);
+        e.rowid_min = std::min(e.rowid_min, idx);
+        e.rowid_max = std::max(e.rowid_max, idx);
+        const float v02 = c02.Value(it.v02(), idx);
+        const float v03 = c03.Value(it.v03(), idx);
+        e.v02_min = std::min(e.v02_min, v02);
+        e.v02_max = std::max(e.v02_max, v02);
+        e.v03_min = std::min(e.v03_min, v03);
+        e.v03_max = std::max(e.v03_max, v03);
+      }
+    }
+  });
+  return zm;
+}
+
+// Write the zone map as a tab separated sidecar file with one line per
+// row group. See pqtreader.h for the reading side.
+void WriteZoneMap(const std::vector<ZoneMapEntry>& zm, const std::string& to) {
+  FILE* f = fopen(to.c_str(), "w");
+  if (!f) {
+    fprintf(stderr, "Fail to open file %s: %s\n", to.c_str(), strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f,
+          "rowgroup\ti0\ti1\tj0\tj1\tk0\tk1\trowid_min\trowid_max\t"
+          "v02_min\tv02_max\tv03_min\tv03_max\n");
+  for (size_t g = 0; g < zm.size(); g++) {
+    const ZoneMapEntry& e = zm[g];
+    fprintf(f, "%zu\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d", g, e.lo[0], e.hi[0],
+            e.lo[1], e.hi[1], e.lo[2], e.hi[2], e.rowid_min, e.rowid_max);
+    fprintf(f, "\t%.9g\t%.9g\t%.9g\t%.9g\n", e.v02_min, e.v02_max, e.v03_min,
+            e.v03_max);
+  }
+  if (fclose(f) != 0) {
+    fprintf(stderr, "Fail to write file %s: %s\n", to.c_str(),
+            strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+const char* LayoutName(Layout layout) {
+  switch (layout) {
+    case kMorton:
+      return "morton";
+    case kHilbert:
+      return "hilbert";
+    case kBrick:
+      return "brick";
+    default:
+      return "natural";
+  }
+}
+
+// Crop an image to the bounding box of its non-background cells. An image
+// without any such cell is cropped to its first point. The original extent
+// is recorded in kv.
+void CropImage(const RewriteOptions& options, vtkImageData* image,
+               std::unordered_map<std::string, std::string>* kv) {
+  int ext[6];
+  image->GetExtent(ext);
+  Iterator it(image);
+  int lo[3], hi[3];
+  if (!xrage::NonEmptyBounds(it.v02_data(), it.v03_data(), ext[1] - ext[0] + 1,
+                             ext[3] - ext[2] + 1, ext[5] - ext[4] + 1,
+                             options.crop_threshold, lo, hi)) {
+    lo[0] = lo[1] = lo[2] = 0;
+    hi[0] = hi[1] = hi[2] = 0;
+  }
+  int box[6];
+  for (int d = 0; d < 3; d++) {
+    box[2 * d] = ext[2 * d] + lo[d];
+    box[2 * d + 1] = ext[2 * d] + hi[d];
+  }
+  printf("Cropping to %d:%d,%d:%d,%d:%d\n", box[0], box[1], box[2], box[3],
+         box[4], box[5]);
+  image->Crop(box);
+  for (int i = 0; i < 6; i++) {
+    (*kv)["uncropped_extent_" + std::to_string(i)] = std::to_string(ext[i]);
+  }
+  (*kv)["crop_threshold"] = std::to_string(options.crop_threshold);
+}
+
+// Geometry and value columns of an image for the raw and chunk store outputs
+xrage::RawGrid MakeRawGrid(
+    vtkImageData* image, const Iterator& it,
+    const std::unordered_map<std::string, std::string>& kv) {
+  xrage::RawGrid grid;
+  image->GetExtent(grid.extent);
+  const double* ori = image->GetOrigin();
+  const double* spacing = image->GetSpacing();
+  for (int d = 0; d < 3; d++) {
+    grid.dims[d] = grid.extent[2 * d + 1] - grid.extent[2 * d] + 1;
+    grid.origin[d] = ori[d] + grid.extent[2 * d] * spacing[d];
+    grid.spacing[d] = spacing[d];
+  }
+  grid.cycle_index = atoi(kv.at("cycle_index").c_str());
+  grid.fields["v02"] = it.v02_data();
+  grid.fields["v03"] = it.v03_data();
+  return grid;
+}
+
+// Export the value columns of an image as raw arrays next to the converted
+// file to, before they are groomed, quantized or reordered
+void ExportRaw(vtkImageData* image, const Iterator& it,
+               const std::unordered_map<std::string, std::string>& kv,
+               const std::string& to) {
+  const xrage::RawGrid grid = MakeRawGrid(image, it, kv);
+  const std::string base = to.substr(0, to.rfind('.'));
+  printf("Exporting raw arrays to %s.*.npy\n", base.c_str());
+  xrage::WriteRawExport(base, grid, kv);
+}
+
+void Rewrite(const RewriteOptions& options, xrage::TaskScheduler* scheduler,
+             const std::string& from, const std::string& to) {
   printf("Rewriting %s to parquet... \n", from.c_str());
+  const double cached = xrage::CachedFraction(from);
+  if (cached >= 0) {
+    printf("Input is %.1f%% in the page cache\n", 100 * cached);
+  }
   vtkNew<vtkXMLImageDataReader> reader;
   reader->SetFileName(from.c_str());
-  reader->Update();
+  reader->UpdateInformation();
+  xrage::UpdateReader(options.roi, reader.Get());
   vtkImageData* image = reader->GetOutput();
-  std::shared_ptr<arrow::io::FileOutputStream> file;
-  PARQUET_ASSIGN_OR_THROW(file, arrow::io::FileOutputStream::Open(to))
-  ParquetWriter writer(
-      ParquetWriterOptions(), file,
-      std::make_shared<arrow::KeyValueMetadata>(ExtraMetadata(image)));
+  // Extent the region of interest resolved to, before any cropping
+  const std::string roi_extent = xrage::ExtentString(image->GetExtent());
+  std::unordered_map<std::string, std::string> crop_kv;
+  if (options.crop) {
+    CropImage(options, image, &crop_kv);
+  }
+  std::unordered_map<std::string, std::string> kv = ExtraMetadata(image);
+  kv.insert(crop_kv.begin(), crop_kv.end());
+  SpatialOrder so;
+  std::vector<ZoneMapEntry> zm;
+  const std::string zmfile = to + ".zonemap";
   Iterator it(image);
-  it.SeekToFirst();
-  while (it.Valid()) {
-    writer.Append(&it);
-    it.Next();
+  if (options.raw) {
+    ExportRaw(image, it, kv, to);
+  }
+  // Per-value transforms run one slab per task. Only the appends to the
+  // writer are serial.
+  const xrage::ColumnPrecision& precision = options.writer.precision;
+  xrage::ParallelFor(scheduler, it.size(), xrage::kSlabValues,
+                     [&](int64_t begin, int64_t end) {
+                       precision.Groom("v02", it.v02_data() + begin,
+                                       end - begin);
+                       precision.Groom("v03", it.v03_data() + begin,
+                                       end - begin);
+                     });
+  for (const char* name : {"v02", "v03"}) {
+    if (precision.Get(name) != 0) {
+      kv[std::string(name) + "_keep_bits"] =
+          std::to_string(precision.Get(name));
+    }
+  }
+  if (options.layout != kNatural) {
+    if (options.layout == kBrick) {
+      BrickOrder(options, image, &so);
+      kv["brick_size"] = std::to_string(options.brick_size);
+    } else {
+      CurveOrder(options, image, &so);
+    }
+    kv["layout"] = LayoutName(options.layout);
+  }
+  if (options.sparse) {
+    std::vector<int32_t> cells(it.size());
+    cells.resize(xrage::SelectCells(it.v02_data(), it.v03_data(), it.size(),
+                                    options.sparse_threshold, cells.data()));
+    printf("Keeping %zu/%d non-empty cells\n", cells.size(), it.size());
+    if (options.layout != kNatural) {
+      FilterOrder(cells, it.size(), &so);
+    } else {
+      so.order.swap(cells);
+      so.group_ends.push_back(so.order.size());
+    }
+    kv["sparse"] = "true";
+    kv["sparse_threshold"] = std::to_string(options.sparse_threshold);
+    kv["fill_value"] = "0";
+  }
+  if (options.roi.enabled) {
+    kv[options.roi.physical ? "roi_phys" : "roi"] = options.roi.spec;
+    kv["roi_extent"] = roi_extent;
+  }
+  if (options.chunks.enabled) {
+    xrage::ChunkStoreWriter store(options.chunks, scheduler);
+    store.Write(to, MakeRawGrid(image, it, kv), kv);
+    printf("Wrote %lld chunks (%lld bytes), skipped %lld empty chunks\n",
+           static_cast<long long>(store.stored_chunks()),
+           static_cast<long long>(store.stored_bytes()),
+           static_cast<long long>(store.empty_chunks()));
+    return;
+  }
+  if (options.writer.random_access > 0) {
+    kv["random_access"] = std::to_string(options.writer.random_access);
+  }
+  ValueColumn c02;
+  ValueColumn c03;
+  c02.round = options.writer.precision.Get("v02") == 0;
+  c03.round = options.writer.precision.Get("v03") == 0;
+  Quantization q02;
+  Quantization q03;
+  const double e02 = QuantizeError(options, "v02");
+  const double e03 = QuantizeError(options, "v03");
+  if (e02 > 0) {
+    QuantizeColumn(scheduler, "v02", it.v02_data(), it.size(), e02, &q02,
+                   &kv);
+    c02.q = &q02;
+  }
+  if (e03 > 0) {
+    QuantizeColumn(scheduler, "v03", it.v03_data(), it.size(), e03, &q03,
+                   &kv);
+    c03.q = &q03;
+  }
+  // Round in place so that the values are written as is
+  ValueColumn* const columns[2] = {&c02, &c03};
+  float* const data[2] = {it.v02_data(), it.v03_data()};
+  for (int c = 0; c < 2; c++) {
+    if (columns[c]->round && !columns[c]->q) {
+      xrage::ParallelFor(scheduler, it.size(), xrage::kSlabValues,
+                         [&](int64_t begin, int64_t end) {
+                           xrage::RoundValues(data[c] + begin, end - begin);
+                         });
+      columns[c]->round = false;
+    }
+  }
+  std::vector<int32_t> r02;
+  std::vector<int32_t> r03;
+  if (options.lorenzo) {
+    PredictColumn(options, scheduler, image, it.v02_data(), &c02, &r02);
+    PredictColumn(options, scheduler, image, it.v03_data(), &c03, &r03);
+    kv["predictor"] = "lorenzo";
+    kv["predictor_slab"] = std::to_string(options.lorenzo_slab);
+  }
+  if (options.layout != kNatural) {
+    zm = BuildZoneMap(scheduler, so, image, c02, c03);
+    kv["zonemap"] = zmfile.substr(zmfile.rfind('/') + 1);
+  }
+  ParquetWriterOptions writer_options = options.writer;
+  if (options.writer.auto_codec.enabled) {
+    ChooseCodecs(options.writer, it, so.order, c02, c03,
+                 &writer_options.codecs, &kv);
+  }
+  std::shared_ptr<xrage::AsyncOutputStream> file;
+  PARQUET_ASSIGN_OR_THROW(
+      file, xrage::AsyncOutputStream::Open(to, writer_options.stream))
+  ParquetWriter writer(writer_options, file,
+                       std::make_shared<arrow::KeyValueMetadata>(kv), c02,
+                       c03);
+  if (options.layout != kNatural || options.sparse) {
+    writer.ExplicitRowGroups();
+    size_t r = 0;
+    for (size_t end : so.group_ends) {
+      writer.AppendRows(it, so.order.data() + r, end - r);
+      writer.FlushRowGroup();
+      r = end;
+    }
+  } else {
+    writer.AppendRows(it, nullptr, it.size());
   }
   writer.Finish();
+  PARQUET_THROW_NOT_OK(file->Close());
+  printf("%s\n", file->Summary().c_str());
+  if (!zm.empty()) {
+    WriteZoneMap(zm, zmfile);
+  }
 }
 
-void ProcessDir(const char* indir, const char* outdir) {
+void ProcessDir(const RewriteOptions& options, const char* indir,
+                const char* outdir) {
   DIR* const dir = opendir(indir);
   if (!dir) {
     fprintf(stderr, "Fail to open dir %s: %s\n", indir, strerror(errno));
     exit(EXIT_FAILURE);
   }
+  std::vector<xrage::WorkItem> items;
   std::string tmp1 = indir;
   size_t base1 = tmp1.size();
   std::string tmp2 = outdir;
@@ -244,21 +1096,317 @@ void ProcessDir(const char* indir, const char* outdir) {
         tmp2.resize(base2);
         tmp2 += '/';
         tmp2 += f.substr(0, f.size() - 4);
-        tmp2 += ".parquet";
-        Rewrite(tmp1, tmp2);
+        tmp2 += options.chunks.enabled ? ".zarr"
+                                       : options.writer.format.extension();
+        xrage::WorkItem item;
+        item.from = tmp1;
+        item.to = tmp2;
+        items.push_back(item);
       }
     }
     entry = readdir(dir);
   }
   closedir(dir);
+  xrage::PlanWorkItems(&items, options.jobs);
+  xrage::Prefetcher prefetcher(options.prefetch, xrage::WorkInputs(items));
+  xrage::WorkProgress progress(items);
+  xrage::TaskScheduler scheduler(options.threads);
+  xrage::RunWorkItems(&scheduler, items, options.jobs, [&](size_t i) {
+    prefetcher.Start(i);
+    Rewrite(options, &scheduler, items[i].from, items[i].to);
+    progress.Done(items[i]);
+  });
+  printf("%s\n", scheduler.Summary().c_str());
   printf("Done!\n");
 }
 
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] inputdir <outputdir>\n"
+          "  -l, --layout natural|morton|hilbert|brick\n"
+          "      order in which cells are written\n"
+          "  -g, --rows-per-group n\n"
+          "      rows per row group of the morton and hilbert layouts, and\n"
+          "      the minimum of the brick layout, which never splits bricks\n"
+          "  -b, --brick-size n\n"
+          "      brick edge length of the brick layout\n"
+          "  -e, --encoding [column=]plain|byte_stream_split\n"
+          "      encoding of value columns\n"
+          "  -z, --compression [column=]codec\n"
+          "      compression of value columns: uncompressed, snappy,\n"
+          "      zstd[:level], lz4 or gzip[:level]\n"
+          "  -A, --auto-codec size|speed|within:pct\n"
+          "      pick the encoding and compression of value columns without\n"
+          "      -e/-z settings, their own or for all columns, by sampling\n"
+          "  -s, --sparse threshold\n"
+          "      only write cells with |v02| or |v03| above threshold\n"
+          "  -c, --crop threshold\n"
+          "      only write the bounding box of cells with |v02| or |v03|\n"
+          "      above threshold\n"
+          "  -r, --roi i0:i1,j0:j1,k0:k1\n"
+          "      only convert this index range\n"
+          "  -R, --roi-phys x0:x1,y0:y1,z0:z1\n"
+          "      only convert this physical coordinate range\n"
+          "  -q, --quantize [column=]error\n"
+          "      store value columns as integers with at most this absolute\n"
+          "      error\n"
+          "  -k, --keep-bits [column=]n\n"
+          "      keep n mantissa bits of value columns\n"
+          "  -p, --predictor none|lorenzo\n"
+          "      store value columns as prediction residuals (natural layout\n"
+          "      only)\n"
+          "  -a, --random-access rows\n"
+          "      write value columns as uncompressed plain pages of this many\n"
+          "      rows with a page index, for lookups by rowid (natural layout\n"
+          "      only)\n"
+          "  -P, --page-index\n"
+          "      write column and offset indexes with the min/max of every\n"
+          "      data page\n"
+          "  -S, --page-size bytes\n"
+          "      target data page size\n"
+          "  -f, --format parquet|arrow[:lz4|:zstd]\n"
+          "      output file format\n"
+          "  -x, --raw\n"
+          "      also export v02 and v03 as .npy arrays with a .json sidecar\n"
+          "  -Z, --chunk-store n|nx,ny,nz\n"
+          "      write v02 and v03 as a Zarr v2 store of chunks of this shape\n"
+          "      instead of a parquet file\n"
+          "  -C, --chunk-compression none|zstd[:level]|gzip[:level]\n"
+          "      compression of chunk store chunks\n"
+          "  -j, --threads n\n"
+          "      worker threads shared by files and the slabs, row groups\n"
+          "      and chunks they are split into (default: one per core)\n"
+          "  -D, --direct\n"
+          "      write output with O_DIRECT, bypassing the page cache\n"
+          "  -F, --prefetch n\n"
+          "      read ahead the next n input files while converting (default\n"
+          "      2, 0 disables)\n"
+          "  -M, --prefetch-budget MiB\n"
+          "      most prefetched input not converted yet (default 1024)\n"
+          "  -J, --jobs n\n"
+          "      convert up to n files at once, largest first (default 1)\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
 int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s inputdir <outputdir>", argv[0]);
+  static const struct option kLongOpts[] = {
+      {"layout", required_argument, nullptr, 'l'},
+      {"rows-per-group", required_argument, nullptr, 'g'},
+      {"brick-size", required_argument, nullptr, 'b'},
+      {"encoding", required_argument, nullptr, 'e'},
+      {"compression", required_argument, nullptr, 'z'},
+      {"auto-codec", required_argument, nullptr, 'A'},
+      {"sparse", required_argument, nullptr, 's'},
+      {"crop", required_argument, nullptr, 'c'},
+      {"roi", required_argument, nullptr, 'r'},
+      {"roi-phys", required_argument, nullptr, 'R'},
+      {"quantize", required_argument, nullptr, 'q'},
+      {"keep-bits", required_argument, nullptr, 'k'},
+      {"predictor", required_argument, nullptr, 'p'},
+      {"random-access", required_argument, nullptr, 'a'},
+      {"page-index", no_argument, nullptr, 'P'},
+      {"page-size", required_argument, nullptr, 'S'},
+      {"format", required_argument, nullptr, 'f'},
+      {"direct", no_argument, nullptr, 'D'},
+      {"prefetch", required_argument, nullptr, 'F'},
+      {"prefetch-budget", required_argument, nullptr, 'M'},
+      {"jobs", required_argument, nullptr, 'J'},
+      {"raw", no_argument, nullptr, 'x'},
+      {"chunk-store", required_argument, nullptr, 'Z'},
+      {"chunk-compression", required_argument, nullptr, 'C'},
+      {"threads", required_argument, nullptr, 'j'},
+      {nullptr, 0, nullptr, 0}};
+  static const char kShortOpts[] =
+      "l:g:b:e:z:A:s:c:r:R:q:k:p:a:PS:f:xZ:C:j:DF:M:J:";
+  RewriteOptions options;
+  int c;
+  while ((c = getopt_long(argc, argv, kShortOpts, kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'l':
+        if (strcmp(optarg, "natural") == 0) {
+          options.layout = kNatural;
+        } else if (strcmp(optarg, "morton") == 0) {
+          options.layout = kMorton;
+        } else if (strcmp(optarg, "hilbert") == 0) {
+          options.layout = kHilbert;
+        } else if (strcmp(optarg, "brick") == 0) {
+          options.layout = kBrick;
+        } else {
+          Usage(argv[0]);
+        }
+        break;
+      case 'g':
+        options.rows_per_group = atoi(optarg);
+        if (options.rows_per_group <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'b':
+        options.brick_size = atoi(optarg);
+        if (options.brick_size <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'e':
+        if (!options.writer.codecs.ParseEncoding(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'z':
+        if (!options.writer.codecs.ParseCompression(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'A':
+        if (!options.writer.auto_codec.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 's':
+        options.sparse = true;
+        options.sparse_threshold = atof(optarg);
+        break;
+      case 'c':
+        options.crop = true;
+        options.crop_threshold = atof(optarg);
+        break;
+      case 'r':
+      case 'R':
+        if (!xrage::ParseRoi(optarg, c == 'R', &options.roi)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'q':
+        if (!ParseQuantize(optarg, &options)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'k':
+        if (!options.writer.precision.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'p':
+        if (strcmp(optarg, "none") == 0) {
+          options.lorenzo = false;
+        } else if (strcmp(optarg, "lorenzo") == 0) {
+          options.lorenzo = true;
+        } else {
+          Usage(argv[0]);
+        }
+        break;
+      case 'a':
+        options.writer.random_access = atoi(optarg);
+        if (options.writer.random_access <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'P':
+        options.writer.page_index.enabled = true;
+        break;
+      case 'S':
+        if (!options.writer.page_index.ParsePageSize(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'f':
+        if (!options.writer.format.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'D':
+        options.writer.stream.direct = true;
+        break;
+      case 'F':
+        options.prefetch.files = atoi(optarg);
+        if (options.prefetch.files < 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'M':
+        if (!options.prefetch.ParseBudget(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'J':
+        options.jobs = atoi(optarg);
+        if (options.jobs <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'x':
+        options.raw = true;
+        break;
+      case 'Z':
+        if (!options.chunks.ParseChunk(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'C':
+        if (!options.chunks.ParseCompression(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'j':
+        options.threads = atoi(optarg);
+        if (options.threads <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    Usage(argv[0]);
+  }
+  xrage::CheckColumns({"v02", "v03"}, options.writer.codecs,
+                      options.writer.precision);
+  if (options.lorenzo &&
+      (options.layout != kNatural || options.sparse ||
+       !options.quantize.empty())) {
+    fprintf(stderr,
+            "The lorenzo predictor requires the natural layout and cannot be "
+            "combined with --sparse or --quantize\n");
+    exit(EXIT_FAILURE);
+  }
+  if (options.writer.random_access > 0 &&
+      (options.layout != kNatural || options.sparse ||
+       !options.quantize.empty() || options.lorenzo ||
+       !options.writer.codecs.empty() || options.writer.auto_codec.enabled ||
+       options.writer.page_index.page_size > 0)) {
+    fprintf(stderr,
+            "The random-access profile requires the natural layout and cannot "
+            "be combined with --sparse, --quantize, --predictor, --page-size "
+            "or codec settings\n");
+    exit(EXIT_FAILURE);
+  }
+  if (options.writer.format.ipc &&
+      (!options.writer.codecs.empty() || options.writer.auto_codec.enabled ||
+       options.writer.page_index.enabled ||
+       options.writer.page_index.page_size > 0 ||
+       options.writer.random_access > 0)) {
+    fprintf(stderr,
+            "The arrow format cannot be combined with --encoding, "
+            "--compression, --auto-codec, --page-index, --page-size or "
+            "--random-access\n");
+    exit(EXIT_FAILURE);
+  }
+  if (options.chunks.enabled &&
+      (options.layout != kNatural || options.sparse ||
+       !options.quantize.empty() || options.lorenzo ||
+       options.writer.random_access > 0 || options.writer.format.ipc ||
+       !options.writer.codecs.empty() || options.writer.auto_codec.enabled ||
+       options.writer.page_index.enabled ||
+       options.writer.page_index.page_size > 0)) {
+    fprintf(stderr,
+            "The chunk store output cannot be combined with --layout, "
+            "--sparse, --quantize, --predictor, --random-access, --format, "
+            "--encoding, --compression, --auto-codec, --page-index or "
+            "--page-size\n");
     exit(EXIT_FAILURE);
   }
-  ProcessDir(argv[1], argc > 2 ? argv[2] : ".");
+  ProcessDir(options, argv[optind], optind + 1 < argc ? argv[optind + 1] : ".");
   return 0;
 }
@@ -32,7 +32,16 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "async_output.h"
+#include "column_codecs.h"
+#include "kernels.h"
+#include "prefetch.h"
+#include "roi.h"
+#include "row_writer.h"
+#include "sparse.h"
+
 #include <arrow/io/file.h>
+#include <arrow/util/key_value_metadata.h>
 #include <parquet/stream_writer.h>
 
 #include <vtkDataArraySelection.h>
@@ -44,6 +53,7 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <getopt.h>
 #include <map>
 #include <math.h>
 #include <stdint.h>
@@ -51,6 +61,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <vector>
 
 namespace {
 
@@ -60,12 +71,23 @@ class Iterator {
   ~Iterator() {}
 
   void SeekToFirst() { i_ = 0; }
+  void Seek(int i) { i_ = i; }
   bool Valid() const { return i_ >= 0 && i_ < n_; }
   void Next() { i_++; }
 
   float v02() const { return v02_[i_]; }
   float v03() const { return v03_[i_]; }
 
+  // Index of the current element in vtk point order
+  int index() const { return i_; }
+
+  // Raw arrays for bulk kernels
+  int size() const { return n_; }
+  const float* v02_data() const { return v02_; }
+  const float* v03_data() const { return v03_; }
+  float* v02_data() { return v02_; }
+  float* v03_data() { return v03_; }
+
  private:
   int n_;  // Total number of elements
   float* v02_;
@@ -87,13 +109,22 @@ Iterator::Iterator(vtkImageData* image) {
 
 struct ParquetWriterOptions {
   ParquetWriterOptions() {}
+  xrage::ColumnCodecs codecs;
+  // Groomed columns are written as is instead of being rounded to 6 decimal
+  // places
+  xrage::ColumnPrecision precision;
+  xrage::AutoCodec auto_codec;
+  xrage::PageIndex page_index;
+  xrage::OutputFormat format;
+  xrage::OutputStreamOptions stream;
 };
 
 class ParquetWriter {
  public:
   ParquetWriter(const ParquetWriterOptions& options,
-                std::shared_ptr<arrow::io::OutputStream> file);
-  void Append(int timestep, float v02, float v03);
+                std::shared_ptr<arrow::io::OutputStream> file,
+                std::shared_ptr<const arrow::KeyValueMetadata> kv);
+  void Append(int timestep, int rowid, float v02, float v03);
   void FlushRowGroup();
   void Finish();
   ~ParquetWriter();
@@ -102,8 +133,9 @@ class ParquetWriter {
   // No copying allowed
   ParquetWriter(const ParquetWriter&);
   void operator=(const ParquetWriter& other);
-  parquet::StreamWriter* writer_;
-  int32_t rowid_;
+  xrage::RowWriter* writer_;
+  bool round02_;
+  bool round03_;
   bool pending_rgflush_;
 };
 
@@ -129,8 +161,12 @@ std::shared_ptr<parquet::schema::GroupNode> GetSchema() {
 }  // namespace
 
 ParquetWriter::ParquetWriter(const ParquetWriterOptions& options,
-                             std::shared_ptr<arrow::io::OutputStream> file)
-    : writer_(nullptr), rowid_(0), pending_rgflush_(false) {
+                             std::shared_ptr<arrow::io::OutputStream> file,
+                             std::shared_ptr<const arrow::KeyValueMetadata> kv)
+    : writer_(nullptr),
+      round02_(options.precision.Get("v02") == 0),
+      round03_(options.precision.Get("v03") == 0),
+      pending_rgflush_(false) {
   parquet::WriterProperties::Builder builder;
   builder.compression("timestep", parquet::Compression::SNAPPY);
   builder.compression("rowid", parquet::Compression::SNAPPY);
@@ -139,25 +175,31 @@ ParquetWriter::ParquetWriter(const ParquetWriterOptions& options,
   builder.encoding("rowid", parquet::Encoding::DELTA_BINARY_PACKED);
   builder.encoding(parquet::Encoding::PLAIN);
   builder.disable_dictionary();
-  writer_ = new parquet::StreamWriter(parquet::ParquetFileWriter::Open(
-      std::move(file), GetSchema(), builder.build()));
+  options.codecs.Apply({"v02", "v03"}, &builder);
+  options.page_index.Apply(&builder);
+  writer_ = xrage::OpenRowWriter(options.format, std::move(file), GetSchema(),
+                                 builder.build(), std::move(kv))
+                .release();
 }
 
-void ParquetWriter::Append(int timestep, float v02, float v03) {
+void ParquetWriter::Append(int timestep, int rowid, float v02, float v03) {
   if (pending_rgflush_) {
     *writer_ << parquet::EndRowGroup;
     pending_rgflush_ = false;
   }
-  *writer_ << timestep << rowid_++ << roundf(v02 * 1000000) / 1000000
-           << roundf(v03 * 1000000) / 1000000 << parquet::EndRow;
+  if (round02_) {
+    v02 = roundf(v02 * 1000000) / 1000000;
+  }
+  if (round03_) {
+    v03 = roundf(v03 * 1000000) / 1000000;
+  }
+  *writer_ << timestep << rowid << v02 << v03 << parquet::EndRow;
 }
 
-void ParquetWriter::FlushRowGroup() {
-  pending_rgflush_ = true;
-  rowid_ = 0;
-}
+void ParquetWriter::FlushRowGroup() { pending_rgflush_ = true; }
 
 void ParquetWriter::Finish() {
+  writer_->Close();
   delete writer_;
   writer_ = nullptr;
 }
@@ -175,26 +217,184 @@ inline bool StringEndWith(const std::string& str, const char* suffix) {
   return std::strncmp(&str[0] + lenstr - lensuffix, suffix, lensuffix) == 0;
 }
 
-void Rewrite(const std::string& from, int timestep, ParquetWriter* writer) {
-  printf("Processing %s... \n", from.c_str());
-  vtkNew<vtkXMLImageDataReader> reader;
+struct RewriteOptions {
+  RewriteOptions()
+      : keyframe_interval(0),
+        delta_threshold(0) {}
+  // Only write the non-empty cells of each grid
+  xrage::SparseOptions sparse;
+  // Write all cells of every keyframe_interval-th timestep. In between, only
+  // write the cells where v02 or v03 changed by more than delta_threshold
+  // since the cell was last written. 0 writes all cells of every timestep.
+  int keyframe_interval;
+  float delta_threshold;
+  // Only read and write this part of each grid
+  xrage::Roi roi;
+  // Read ahead upcoming input files while converting
+  xrage::PrefetchOptions prefetch;
+  ParquetWriterOptions writer;
+};
+
+// Key-value metadata recording how cells were selected and written, and how
+// many cells the rowids of each timestep index: those of the extent the
+// region of interest resolves to in the timestep, or those of the grid of
+// the first timestep. This reads the header of the input files.
+std::shared_ptr<arrow::KeyValueMetadata> FileMetadata(
+    const RewriteOptions& options, const std::map<int, std::string>& files) {
+  if (files.empty()) {
+    return nullptr;
+  }
+  std::shared_ptr<arrow::KeyValueMetadata> kv =
+      std::make_shared<arrow::KeyValueMetadata>();
+  xrage::AddSelectionMetadata(options.sparse, options.roi, kv.get());
+  if (options.roi.enabled) {
+    std::string first;
+    for (auto const& f : files) {
+      int extent[6];
+      xrage::ResolveRoi(options.roi, f.second, extent);
+      const std::string e = xrage::ExtentString(extent);
+      // Deltas compare the cells of a timestep with the same rowids of the
+      // last keyframe
+      if (options.keyframe_interval > 0 && !first.empty() && e != first) {
+        fprintf(stderr,
+                "--keyframe-interval requires the region of interest to "
+                "select the same extent in every timestep, not %s at "
+                "timestep %d and %s before\n",
+                e.c_str(), f.first, first.c_str());
+        exit(EXIT_FAILURE);
+      }
+      first = e;
+      kv->Append("roi_extent_" + std::to_string(f.first), e);
+    }
+  } else {
+    int extent[6];
+    xrage::ResolveRoi(options.roi, files.begin()->second, extent);
+    kv->Append("cells", std::to_string(xrage::ExtentCells(extent)));
+  }
+  options.writer.precision.AddMetadata({"v02", "v03"}, kv.get());
+  if (options.keyframe_interval > 0) {
+    // Keyframes are the timesteps at multiples of keyframe_interval in this
+    // list
+    std::string timesteps;
+    for (auto const& f : files) {
+      if (!timesteps.empty()) {
+        timesteps += ',';
+      }
+      timesteps += std::to_string(f.first);
+    }
+    kv->Append("timesteps", timesteps);
+    kv->Append("keyframe_interval", std::to_string(options.keyframe_interval));
+    kv->Append("delta_threshold", std::to_string(options.delta_threshold));
+  }
+  return kv;
+}
+
+// Values of every cell as of the last time the cell was written
+struct DeltaState {
+  DeltaState() : frames(0) {}
+  int frames;
+  std::vector<float> v02;
+  std::vector<float> v03;
+};
+
+// Write all cells of a keyframe. Otherwise only write the cells that
+// changed since they were last written.
+void WriteFrame(const RewriteOptions& options, int timestep, Iterator* it,
+                DeltaState* state, ParquetWriter* writer) {
+  if (state->frames++ % options.keyframe_interval == 0) {
+    state->v02.assign(it->v02_data(), it->v02_data() + it->size());
+    state->v03.assign(it->v03_data(), it->v03_data() + it->size());
+    it->SeekToFirst();
+    while (it->Valid()) {
+      writer->Append(timestep, it->index(), it->v02(), it->v03());
+      it->Next();
+    }
+    return;
+  }
+  if (int(state->v02.size()) != it->size()) {
+    fprintf(stderr, "Grid size changed at timestep %d\n", timestep);
+    exit(EXIT_FAILURE);
+  }
+  std::vector<int32_t> cells(it->size());
+  cells.resize(xrage::SelectChangedCells(
+      it->v02_data(), it->v03_data(), it->size(), options.delta_threshold,
+      state->v02.data(), state->v03.data(), cells.data()));
+  printf("Writing %zu/%d changed cells\n", cells.size(), it->size());
+  for (int32_t idx : cells) {
+    it->Seek(idx);
+    writer->Append(timestep, idx, it->v02(), it->v03());
+  }
+}
+
+// Zero the low mantissa bits of the groomed columns in place
+void Groom(const RewriteOptions& options, Iterator* it) {
+  options.writer.precision.Groom("v02", it->v02_data(), it->size());
+  options.writer.precision.Groom("v03", it->v03_data(), it->size());
+}
+
+// Read the value columns of the region of interest of a grid
+void Read(const RewriteOptions& options, const std::string& from,
+          vtkXMLImageDataReader* reader) {
   reader->SetFileName(from.c_str());
   reader->UpdateInformation();
   vtkDataArraySelection* das = reader->GetPointDataArraySelection();
   das->DisableAllArrays();
   das->EnableArray("v02");
   das->EnableArray("v03");
-  reader->Update();
+  xrage::UpdateReader(options.roi, reader);
+}
+
+// Pick the codecs of the merged file from the cells of the first timestep
+// that are written, which reads that timestep once more
+void ChooseCodecs(const RewriteOptions& options, const std::string& first,
+                  ParquetWriterOptions* writer, arrow::KeyValueMetadata* kv) {
+  printf("Sampling %s... \n", first.c_str());
+  vtkNew<vtkXMLImageDataReader> reader;
+  Read(options, first, reader.Get());
+  Iterator it(reader->GetOutput());
+  Groom(options, &it);
+  std::vector<int32_t> cells;
+  if (options.sparse.enabled) {
+    cells =
+        options.sparse.SelectCells(it.v02_data(), it.v03_data(), it.size());
+  }
+  xrage::AutoSelectCodecs(options.writer.auto_codec, options.writer.precision,
+                          {"v02", "v03"}, {it.v02_data(), it.v03_data()},
+                          it.size(), options.sparse.enabled ? &cells : nullptr,
+                          &writer->codecs, kv);
+}
+
+void Rewrite(const RewriteOptions& options, const std::string& from,
+             int timestep, DeltaState* state, ParquetWriter* writer) {
+  printf("Processing %s... \n", from.c_str());
+  const double cached = xrage::CachedFraction(from);
+  if (cached >= 0) {
+    printf("Input is %.1f%% in the page cache\n", 100 * cached);
+  }
+  vtkNew<vtkXMLImageDataReader> reader;
+  Read(options, from, reader.Get());
   Iterator it(reader->GetOutput());
-  it.SeekToFirst();
-  while (it.Valid()) {
-    writer->Append(timestep, it.v02(), it.v03());
-    it.Next();
+  Groom(options, &it);
+  if (options.keyframe_interval > 0) {
+    WriteFrame(options, timestep, &it, state, writer);
+  } else if (options.sparse.enabled) {
+    for (int32_t idx :
+         options.sparse.SelectCells(it.v02_data(), it.v03_data(), it.size())) {
+      it.Seek(idx);
+      writer->Append(timestep, idx, it.v02(), it.v03());
+    }
+  } else {
+    it.SeekToFirst();
+    while (it.Valid()) {
+      writer->Append(timestep, it.index(), it.v02(), it.v03());
+      it.Next();
+    }
   }
   writer->FlushRowGroup();
 }
 
-void ProcessDir(const char* indir, const char* outdir) {
+void ProcessDir(const RewriteOptions& options, const char* indir,
+                const char* outdir) {
   std::map<int, std::string> work_items;
   DIR* const dir = opendir(indir);
   if (!dir) {
@@ -216,7 +416,7 @@ void ProcessDir(const char* indir, const char* outdir) {
         if (tmp2.size() == base2) {
           tmp2 += '/';
           tmp2 += f.substr(0, f.size() - 4 - 5 - 1);
-          tmp2 += ".parquet";
+          tmp2 += options.writer.format.extension();
         }
         int t = atoi(f.substr(f.size() - 4 - 5, 5).c_str());
         work_items[t] = tmp1;
@@ -225,21 +425,187 @@ void ProcessDir(const char* indir, const char* outdir) {
     entry = readdir(dir);
   }
   closedir(dir);
-  std::shared_ptr<arrow::io::FileOutputStream> file;
-  PARQUET_ASSIGN_OR_THROW(file, arrow::io::FileOutputStream::Open(tmp2))
-  ParquetWriter writer(ParquetWriterOptions(), file);
+  const std::shared_ptr<arrow::KeyValueMetadata> kv =
+      FileMetadata(options, work_items);
+  ParquetWriterOptions writer_options = options.writer;
+  if (options.writer.auto_codec.enabled && !work_items.empty()) {
+    ChooseCodecs(options, work_items.begin()->second, &writer_options,
+                 kv.get());
+  }
+  std::shared_ptr<xrage::AsyncOutputStream> file;
+  PARQUET_ASSIGN_OR_THROW(
+      file, xrage::AsyncOutputStream::Open(tmp2, writer_options.stream))
+  ParquetWriter writer(writer_options, file, kv);
+  DeltaState state;
+  std::vector<std::string> inputs;
   for (auto const& kv : work_items) {
-    Rewrite(kv.second, kv.first, &writer);
+    inputs.push_back(kv.second);
+  }
+  xrage::Prefetcher prefetcher(options.prefetch, inputs);
+  size_t i = 0;
+  for (auto const& kv : work_items) {
+    prefetcher.Start(i++);
+    Rewrite(options, kv.second, kv.first, &state, &writer);
   }
   writer.Finish();
+  PARQUET_THROW_NOT_OK(file->Close());
+  printf("%s\n", file->Summary().c_str());
   printf("Done!\n");
 }
 
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] inputdir <outputdir>\n"
+          "  -e, --encoding [column=]plain|byte_stream_split\n"
+          "      encoding of value columns\n"
+          "  -z, --compression [column=]codec\n"
+          "      compression of value columns: uncompressed, snappy,\n"
+          "      zstd[:level], lz4 or gzip[:level]\n"
+          "  -A, --auto-codec size|speed|within:pct\n"
+          "      pick the encoding and compression of value columns without\n"
+          "      -e/-z settings, their own or for all columns, by sampling\n"
+          "  -s, --sparse threshold\n"
+          "      only write cells with |v02| or |v03| above threshold\n"
+          "  -r, --roi i0:i1,j0:j1,k0:k1\n"
+          "      only convert this index range\n"
+          "  -R, --roi-phys x0:x1,y0:y1,z0:z1\n"
+          "      only convert this physical coordinate range\n"
+          "  -k, --keep-bits [column=]n\n"
+          "      keep n mantissa bits of value columns\n"
+          "  -K, --keyframe-interval k\n"
+          "      write all cells of every k-th timestep and only the changed\n"
+          "      cells of the others\n"
+          "  -d, --delta-threshold t\n"
+          "      minimum change of a cell between keyframes to be written\n"
+          "  -P, --page-index\n"
+          "      write column and offset indexes with the min/max of every\n"
+          "      data page\n"
+          "  -S, --page-size bytes\n"
+          "      target data page size\n"
+          "  -f, --format parquet|arrow[:lz4|:zstd]\n"
+          "      output file format\n"
+          "  -D, --direct\n"
+          "      write output with O_DIRECT, bypassing the page cache\n"
+          "  -F, --prefetch n\n"
+          "      read ahead the next n input files while converting (default\n"
+          "      2, 0 disables)\n"
+          "  -M, --prefetch-budget MiB\n"
+          "      most prefetched input not converted yet (default 1024)\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
 int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s inputdir <outputdir>", argv[0]);
+  static const struct option kLongOpts[] = {
+      {"encoding", required_argument, nullptr, 'e'},
+      {"compression", required_argument, nullptr, 'z'},
+      {"auto-codec", required_argument, nullptr, 'A'},
+      {"sparse", required_argument, nullptr, 's'},
+      {"roi", required_argument, nullptr, 'r'},
+      {"roi-phys", required_argument, nullptr, 'R'},
+      {"keep-bits", required_argument, nullptr, 'k'},
+      {"keyframe-interval", required_argument, nullptr, 'K'},
+      {"delta-threshold", required_argument, nullptr, 'd'},
+      {"page-index", no_argument, nullptr, 'P'},
+      {"page-size", required_argument, nullptr, 'S'},
+      {"format", required_argument, nullptr, 'f'},
+      {"direct", no_argument, nullptr, 'D'},
+      {"prefetch", required_argument, nullptr, 'F'},
+      {"prefetch-budget", required_argument, nullptr, 'M'},
+      {nullptr, 0, nullptr, 0}};
+  static const char kShortOpts[] = "e:z:A:s:r:R:k:K:d:PS:f:DF:M:";
+  RewriteOptions options;
+  int c;
+  while ((c = getopt_long(argc, argv, kShortOpts, kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'e':
+        if (!options.writer.codecs.ParseEncoding(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'z':
+        if (!options.writer.codecs.ParseCompression(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'A':
+        if (!options.writer.auto_codec.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 's':
+        options.sparse.enabled = true;
+        options.sparse.threshold = atof(optarg);
+        break;
+      case 'r':
+      case 'R':
+        if (!xrage::ParseRoi(optarg, c == 'R', &options.roi)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'k':
+        if (!options.writer.precision.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'K':
+        options.keyframe_interval = atoi(optarg);
+        if (options.keyframe_interval <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'd':
+        options.delta_threshold = atof(optarg);
+        break;
+      case 'P':
+        options.writer.page_index.enabled = true;
+        break;
+      case 'S':
+        if (!options.writer.page_index.ParsePageSize(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'f':
+        if (!options.writer.format.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'D':
+        options.writer.stream.direct = true;
+        break;
+      case 'F':
+        options.prefetch.files = atoi(optarg);
+        if (options.prefetch.files < 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'M':
+        if (!options.prefetch.ParseBudget(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    Usage(argv[0]);
+  }
+  xrage::CheckColumns({"v02", "v03"}, options.writer.codecs,
+                      options.writer.precision);
+  if (options.writer.format.ipc &&
+      (!options.writer.codecs.empty() || options.writer.auto_codec.enabled ||
+       options.writer.page_index.enabled ||
+       options.writer.page_index.page_size > 0)) {
+    fprintf(stderr,
+            "The arrow format cannot be combined with --encoding, "
+            "--compression, --auto-codec, --page-index or --page-size\n");
+    exit(EXIT_FAILURE);
+  }
+  if (options.keyframe_interval > 0 && options.sparse.enabled) {
+    fprintf(stderr, "--keyframe-interval cannot be combined with --sparse\n");
     exit(EXIT_FAILURE);
   }
-  ProcessDir(argv[1], argc > 2 ? argv[2] : ".");
+  ProcessDir(options, argv[optind], optind + 1 < argc ? argv[optind + 1] : ".");
   return 0;
 }
@@ -32,7 +32,18 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "async_output.h"
+#include "column_codecs.h"
+#include "kernels.h"
+#include "prefetch.h"
+#include "roi.h"
+#include "row_writer.h"
+#include "scheduler.h"
+#include "sparse.h"
+#include "work_list.h"
+
 #include <arrow/io/file.h>
+#include <arrow/util/key_value_metadata.h>
 #include <parquet/stream_writer.h>
 
 #include <vtkDataArraySelection.h>
@@ -44,12 +55,16 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <getopt.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <exception>
 #include <string>
+#include <vector>
 
 namespace {
 
@@ -59,12 +74,23 @@ class Iterator {
   ~Iterator() {}
 
   void SeekToFirst() { i_ = 0; }
+  void Seek(int i) { i_ = i; }
   bool Valid() const { return i_ >= 0 && i_ < n_; }
   void Next() { i_++; }
 
   float v02() const { return v02_[i_]; }
   float v03() const { return v03_[i_]; }
 
+  // Index of the current element in vtk point order
+  int index() const { return i_; }
+
+  // Raw arrays for bulk kernels
+  int size() const { return n_; }
+  const float* v02_data() const { return v02_; }
+  const float* v03_data() const { return v03_; }
+  float* v02_data() { return v02_; }
+  float* v03_data() { return v03_; }
+
  private:
   int n_;  // Total number of elements
   float* v02_;
@@ -85,15 +111,23 @@ Iterator::Iterator(vtkImageData* image) {
 }
 
 struct ParquetWriterOptions {
-  ParquetWriterOptions(int rowid) : rowid(rowid) {}
-  int32_t rowid;
+  ParquetWriterOptions() {}
+  xrage::ColumnCodecs codecs;
+  // Groomed columns are written as is instead of being rounded to 6 decimal
+  // places
+  xrage::ColumnPrecision precision;
+  xrage::AutoCodec auto_codec;
+  xrage::PageIndex page_index;
+  xrage::OutputFormat format;
+  xrage::OutputStreamOptions stream;
 };
 
 class ParquetWriter {
  public:
   ParquetWriter(const ParquetWriterOptions& options,
-                std::shared_ptr<arrow::io::OutputStream> file);
-  void Append(int timestep, float v02, float v03);
+                std::shared_ptr<arrow::io::OutputStream> file,
+                std::shared_ptr<const arrow::KeyValueMetadata> kv);
+  void Append(int timestep, int rowid, float v02, float v03);
   void Finish();
   ~ParquetWriter();
 
@@ -101,8 +135,9 @@ class ParquetWriter {
   // No copying allowed
   ParquetWriter(const ParquetWriter&);
   void operator=(const ParquetWriter& other);
-  parquet::StreamWriter* writer_;
-  int32_t rowid_;
+  xrage::RowWriter* writer_;
+  bool round02_;
+  bool round03_;
 };
 
 namespace {
@@ -127,8 +162,11 @@ std::shared_ptr<parquet::schema::GroupNode> GetSchema() {
 }  // namespace
 
 ParquetWriter::ParquetWriter(const ParquetWriterOptions& options,
-                             std::shared_ptr<arrow::io::OutputStream> file)
-    : writer_(nullptr), rowid_(options.rowid) {
+                             std::shared_ptr<arrow::io::OutputStream> file,
+                             std::shared_ptr<const arrow::KeyValueMetadata> kv)
+    : writer_(nullptr),
+      round02_(options.precision.Get("v02") == 0),
+      round03_(options.precision.Get("v03") == 0) {
   parquet::WriterProperties::Builder builder;
   builder.compression("timestep", parquet::Compression::SNAPPY);
   builder.compression("rowid", parquet::Compression::SNAPPY);
@@ -137,16 +175,25 @@ ParquetWriter::ParquetWriter(const ParquetWriterOptions& options,
   builder.encoding("rowid", parquet::Encoding::DELTA_BINARY_PACKED);
   builder.encoding(parquet::Encoding::PLAIN);
   builder.disable_dictionary();
-  writer_ = new parquet::StreamWriter(parquet::ParquetFileWriter::Open(
-      std::move(file), GetSchema(), builder.build()));
+  options.codecs.Apply({"v02", "v03"}, &builder);
+  options.page_index.Apply(&builder);
+  writer_ = xrage::OpenRowWriter(options.format, std::move(file), GetSchema(),
+                                 builder.build(), std::move(kv))
+                .release();
 }
 
-void ParquetWriter::Append(int timestep, float v02, float v03) {
-  *writer_ << timestep << rowid_++ << roundf(v02 * 1000000) / 1000000
-           << roundf(v03 * 1000000) / 1000000 << parquet::EndRow;
+void ParquetWriter::Append(int timestep, int rowid, float v02, float v03) {
+  if (round02_) {
+    v02 = roundf(v02 * 1000000) / 1000000;
+  }
+  if (round03_) {
+    v03 = roundf(v03 * 1000000) / 1000000;
+  }
+  *writer_ << timestep << rowid << v02 << v03 << parquet::EndRow;
 }
 
 void ParquetWriter::Finish() {
+  writer_->Close();
   delete writer_;
   writer_ = nullptr;
 }
@@ -164,23 +211,79 @@ inline bool StringEndWith(const std::string& str, const char* suffix) {
   return std::strncmp(&str[0] + lenstr - lensuffix, suffix, lensuffix) == 0;
 }
 
-int Rewrite0(int timestep, int rowid, Iterator* it, const std::string& from,
-             const std::string& to) {
-  std::shared_ptr<arrow::io::FileOutputStream> file;
-  PARQUET_ASSIGN_OR_THROW(file, arrow::io::FileOutputStream::Open(to))
-  ParquetWriter writer(ParquetWriterOptions(rowid), file);
-  int n = 0;
-  while (it->Valid() && n < 100 * 500 * 500) {
-    writer.Append(timestep, it->v02(), it->v03());
-    n++;
-    it->Next();
+struct RewriteOptions {
+  RewriteOptions()
+      : rows_per_file(100 * 500 * 500),
+        threads(0),
+        jobs(1) {}
+  // Max number of rows written to each .0, .1, ... output file
+  int rows_per_file;
+  // Number of workers shared by the timesteps and their .N files. 0 means
+  // one per hardware thread.
+  int threads;
+  // Only write the non-empty cells of each grid
+  xrage::SparseOptions sparse;
+  // Only read and write this part of each grid
+  xrage::Roi roi;
+  // Read ahead upcoming input files while converting
+  xrage::PrefetchOptions prefetch;
+  // Number of files converted at once
+  int jobs;
+  ParquetWriterOptions writer;
+};
+
+// Key-value metadata recording how cells were selected and written. extent
+// is the extent of the grid that was read.
+std::shared_ptr<arrow::KeyValueMetadata> FileMetadata(
+    const RewriteOptions& options, const int extent[6]) {
+  if (!options.sparse.enabled && !options.roi.enabled &&
+      options.writer.precision.empty() && !options.writer.auto_codec.enabled) {
+    return nullptr;
+  }
+  std::shared_ptr<arrow::KeyValueMetadata> kv =
+      std::make_shared<arrow::KeyValueMetadata>();
+  xrage::AddSelectionMetadata(options.sparse, options.roi, kv.get());
+  if (options.roi.enabled) {
+    kv->Append("roi_extent", xrage::ExtentString(extent));
+  }
+  options.writer.precision.AddMetadata({"v02", "v03"}, kv.get());
+  return kv;
+}
+
+// Zero the low mantissa bits of the groomed columns in place
+void Groom(const RewriteOptions& options, Iterator* it) {
+  options.writer.precision.Groom("v02", it->v02_data(), it->size());
+  options.writer.precision.Groom("v03", it->v03_data(), it->size());
+}
+
+// Write rows [begin, begin + n) of a timestep into a separate parquet file.
+// Row r is the vtk point cells[r], or r itself when cells is nullptr. Each
+// call uses its own iterator and writer so that multiple calls may run
+// concurrently over the same read-only vtk arrays.
+void Rewrite0(const ParquetWriterOptions& options, int timestep,
+              const std::vector<int32_t>* cells, int begin, int n, Iterator it,
+              const std::string& to,
+              std::shared_ptr<const arrow::KeyValueMetadata> kv) {
+  std::shared_ptr<xrage::AsyncOutputStream> file;
+  PARQUET_ASSIGN_OR_THROW(
+      file, xrage::AsyncOutputStream::Open(to, options.stream))
+  ParquetWriter writer(options, file, std::move(kv));
+  for (int r = begin; r < begin + n; r++) {
+    it.Seek(cells ? (*cells)[r] : r);
+    writer.Append(timestep, it.index(), it.v02(), it.v03());
   }
   writer.Finish();
-  return n;
+  PARQUET_THROW_NOT_OK(file->Close());
+  printf("%s\n", file->Summary().c_str());
 }
 
-void Rewrite(int timestep, const std::string& from, const std::string& to) {
+void Rewrite(const RewriteOptions& options, xrage::TaskScheduler* scheduler,
+             int timestep, const std::string& from, const std::string& to) {
   printf("Rewriting %s to parquet... \n", from.c_str());
+  const double cached = xrage::CachedFraction(from);
+  if (cached >= 0) {
+    printf("Input is %.1f%% in the page cache\n", 100 * cached);
+  }
   vtkNew<vtkXMLImageDataReader> reader;
   reader->SetFileName(from.c_str());
   reader->UpdateInformation();
@@ -188,28 +291,59 @@ void Rewrite(int timestep, const std::string& from, const std::string& to) {
   das->DisableAllArrays();
   das->EnableArray("v02");
   das->EnableArray("v03");
-  reader->Update();
+  xrage::UpdateReader(options.roi, reader.Get());
   vtkImageData* image = reader->GetOutput();
   Iterator it(image);
-  it.SeekToFirst();
-  std::string myto = to;
-  int i = 0;
-  int rowid = 0;
-  while (it.Valid()) {
-    myto.resize(to.size());
-    myto += ".";
-    myto += std::to_string(i);
-    i++;
-    rowid += Rewrite0(timestep, rowid, &it, from, myto);
+  Groom(options, &it);
+  std::vector<int32_t> cells;
+  if (options.sparse.enabled) {
+    cells =
+        options.sparse.SelectCells(it.v02_data(), it.v03_data(), it.size());
+  }
+  const std::shared_ptr<arrow::KeyValueMetadata> kv =
+      FileMetadata(options, image->GetExtent());
+  // All .N files of a timestep share the codecs picked for it
+  ParquetWriterOptions writer_options = options.writer;
+  if (options.writer.auto_codec.enabled) {
+    xrage::AutoSelectCodecs(options.writer.auto_codec,
+                            options.writer.precision, {"v02", "v03"},
+                            {it.v02_data(), it.v03_data()}, it.size(),
+                            options.sparse.enabled ? &cells : nullptr,
+                            &writer_options.codecs, kv.get());
+  }
+  // Chunk boundaries are known up front so all chunks can be encoded at once
+  const int n = options.sparse.enabled ? int(cells.size()) : it.size();
+  const int rows = options.rows_per_file;
+  // A timestep without any cell left still gets an empty .0 file so that
+  // its metadata is written and readers see every timestep
+  const int chunks = std::max(1, (n + rows - 1) / rows);
+  // Every .N file is a task that idle workers can steal, so a big timestep
+  // left at the end of a run still keeps all of them busy
+  xrage::TaskGroup group;
+  for (int i = 0; i < chunks; i++) {
+    scheduler->Spawn(&group, [&, i]() {
+      const std::string myto = to + "." + std::to_string(i);
+      try {
+        Rewrite0(writer_options, timestep,
+                 options.sparse.enabled ? &cells : nullptr, i * rows,
+                 std::min(rows, n - i * rows), it, myto, kv);
+      } catch (const std::exception& e) {
+        fprintf(stderr, "Fail to write %s: %s\n", myto.c_str(), e.what());
+        exit(EXIT_FAILURE);
+      }
+    });
   }
+  scheduler->Wait(&group);
 }
 
-void ProcessDir(const char* indir, const char* outdir) {
+void ProcessDir(const RewriteOptions& options, const char* indir,
+                const char* outdir) {
   DIR* const dir = opendir(indir);
   if (!dir) {
     fprintf(stderr, "Fail to open dir %s: %s\n", indir, strerror(errno));
     exit(EXIT_FAILURE);
   }
+  std::vector<xrage::WorkItem> items;
   std::string tmp1 = indir;
   size_t base1 = tmp1.size();
   std::string tmp2 = outdir;
@@ -225,22 +359,192 @@ void ProcessDir(const char* indir, const char* outdir) {
         tmp2.resize(base2);
         tmp2 += '/';
         tmp2 += f.substr(0, f.size() - 4);
-        tmp2 += ".parquet";
-        int t = atoi(f.substr(f.size() - 4 - 5, 5).c_str());
-        Rewrite(t, tmp1, tmp2);
+        tmp2 += options.writer.format.extension();
+        xrage::WorkItem item;
+        item.from = tmp1;
+        item.to = tmp2;
+        item.timestep = atoi(f.substr(f.size() - 4 - 5, 5).c_str());
+        items.push_back(item);
       }
     }
     entry = readdir(dir);
   }
   closedir(dir);
+  xrage::PlanWorkItems(&items, options.jobs);
+  xrage::Prefetcher prefetcher(options.prefetch, xrage::WorkInputs(items));
+  xrage::WorkProgress progress(items);
+  xrage::TaskScheduler scheduler(options.threads);
+  xrage::RunWorkItems(&scheduler, items, options.jobs, [&](size_t i) {
+    prefetcher.Start(i);
+    Rewrite(options, &scheduler, items[i].timestep, items[i].from,
+            items[i].to);
+    progress.Done(items[i]);
+  });
+  printf("%s\n", scheduler.Summary().c_str());
   printf("Done!\n");
 }
 
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] inputdir <outputdir>\n"
+          "  -n, --rows-per-file n\n"
+          "      max number of rows in each output file\n"
+          "  -j, --threads n\n"
+          "      worker threads shared by all output files (default: one per\n"
+          "      core)\n"
+          "  -e, --encoding [column=]plain|byte_stream_split\n"
+          "      encoding of value columns\n"
+          "  -z, --compression [column=]codec\n"
+          "      compression of value columns: uncompressed, snappy,\n"
+          "      zstd[:level], lz4 or gzip[:level]\n"
+          "  -A, --auto-codec size|speed|within:pct\n"
+          "      pick the encoding and compression of value columns without\n"
+          "      -e/-z settings, their own or for all columns, by sampling\n"
+          "  -s, --sparse threshold\n"
+          "      only write cells with |v02| or |v03| above threshold\n"
+          "  -r, --roi i0:i1,j0:j1,k0:k1\n"
+          "      only convert this index range\n"
+          "  -R, --roi-phys x0:x1,y0:y1,z0:z1\n"
+          "      only convert this physical coordinate range\n"
+          "  -k, --keep-bits [column=]n\n"
+          "      keep n mantissa bits of value columns\n"
+          "  -P, --page-index\n"
+          "      write column and offset indexes with the min/max of every\n"
+          "      data page\n"
+          "  -S, --page-size bytes\n"
+          "      target data page size\n"
+          "  -f, --format parquet|arrow[:lz4|:zstd]\n"
+          "      output file format\n"
+          "  -D, --direct\n"
+          "      write output with O_DIRECT, bypassing the page cache\n"
+          "  -F, --prefetch n\n"
+          "      read ahead the next n input files while converting (default\n"
+          "      2, 0 disables)\n"
+          "  -M, --prefetch-budget MiB\n"
+          "      most prefetched input not converted yet (default 1024)\n"
+          "  -J, --jobs n\n"
+          "      convert up to n files at once, largest first (default 1)\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
 int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s inputdir <outputdir>", argv[0]);
+  static const struct option kLongOpts[] = {
+      {"rows-per-file", required_argument, nullptr, 'n'},
+      {"threads", required_argument, nullptr, 'j'},
+      {"encoding", required_argument, nullptr, 'e'},
+      {"compression", required_argument, nullptr, 'z'},
+      {"auto-codec", required_argument, nullptr, 'A'},
+      {"sparse", required_argument, nullptr, 's'},
+      {"roi", required_argument, nullptr, 'r'},
+      {"roi-phys", required_argument, nullptr, 'R'},
+      {"keep-bits", required_argument, nullptr, 'k'},
+      {"page-index", no_argument, nullptr, 'P'},
+      {"page-size", required_argument, nullptr, 'S'},
+      {"format", required_argument, nullptr, 'f'},
+      {"direct", no_argument, nullptr, 'D'},
+      {"prefetch", required_argument, nullptr, 'F'},
+      {"prefetch-budget", required_argument, nullptr, 'M'},
+      {"jobs", required_argument, nullptr, 'J'},
+      {nullptr, 0, nullptr, 0}};
+  static const char kShortOpts[] = "n:j:e:z:A:s:r:R:k:PS:f:DF:M:J:";
+  RewriteOptions options;
+  int c;
+  while ((c = getopt_long(argc, argv, kShortOpts, kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'n':
+        options.rows_per_file = atoi(optarg);
+        if (options.rows_per_file <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'j':
+        options.threads = atoi(optarg);
+        if (options.threads <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'e':
+        if (!options.writer.codecs.ParseEncoding(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'z':
+        if (!options.writer.codecs.ParseCompression(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'A':
+        if (!options.writer.auto_codec.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 's':
+        options.sparse.enabled = true;
+        options.sparse.threshold = atof(optarg);
+        break;
+      case 'r':
+      case 'R':
+        if (!xrage::ParseRoi(optarg, c == 'R', &options.roi)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'k':
+        if (!options.writer.precision.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'P':
+        options.writer.page_index.enabled = true;
+        break;
+      case 'S':
+        if (!options.writer.page_index.ParsePageSize(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'f':
+        if (!options.writer.format.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'D':
+        options.writer.stream.direct = true;
+        break;
+      case 'F':
+        options.prefetch.files = atoi(optarg);
+        if (options.prefetch.files < 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'M':
+        if (!options.prefetch.ParseBudget(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'J':
+        options.jobs = atoi(optarg);
+        if (options.jobs <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    Usage(argv[0]);
+  }
+  xrage::CheckColumns({"v02", "v03"}, options.writer.codecs,
+                      options.writer.precision);
+  if (options.writer.format.ipc &&
+      (!options.writer.codecs.empty() || options.writer.auto_codec.enabled ||
+       options.writer.page_index.enabled ||
+       options.writer.page_index.page_size > 0)) {
+    fprintf(stderr,
+            "The arrow format cannot be combined with --encoding, "
+            "--compression, --auto-codec, --page-index or --page-size\n");
     exit(EXIT_FAILURE);
   }
-  ProcessDir(argv[1], argc > 2 ? argv[2] : ".");
+  ProcessDir(options, argv[optind], optind + 1 < argc ? argv[optind + 1] : ".");
   return 0;
 }
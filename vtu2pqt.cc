@@ -32,7 +32,15 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "async_output.h"
+#include "column_codecs.h"
+#include "prefetch.h"
+#include "row_writer.h"
+#include "scheduler.h"
+#include "work_list.h"
+
 #include <arrow/io/file.h>
+#include <arrow/util/key_value_metadata.h>
 #include <parquet/stream_writer.h>
 
 #include <vtkCellData.h>
@@ -43,80 +51,37 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <iterator>
 #include <string>
+#include <vector>
 
 namespace xrage {
 
-class Iterator {
- public:
-  explicit Iterator(vtkUnstructuredGrid* grid);
-  ~Iterator() {}
-
-  void SeekToFirst() { i_ = 0; }
-  bool Valid() const { return i_ >= 0 && i_ < n_; }
-  void Next() { i_++; }
-
-  float rho() const { return rho_[i_]; }
-  float prs() const { return prs_[i_]; }
-  float tev() const { return tev_[i_]; }
-  float xdt() const { return xdt_[i_]; }
-  float ydt() const { return ydt_[i_]; }
-  float zdt() const { return zdt_[i_]; }
-  float snd() const { return snd_[i_]; }
-  float grd() const { return grd_[i_]; }
-  float mat() const { return mat_[i_]; }
-  float v02() const { return v02_[i_]; }
-  float v03() const { return v03_[i_]; }
-
- private:
-  int n_;  // Total number of elements
-  float* rho_;
-  float* prs_;
-  float* tev_;
-  float* xdt_;
-  float* ydt_;
-  float* zdt_;
-  float* snd_;
-  float* grd_;
-  float* mat_;
-  float* v02_;
-  float* v03_;
-  int i_;
-};
-
-Iterator::Iterator(vtkUnstructuredGrid* grid) {
-  vtkCellData* const celldata = grid->GetCellData();
-  n_ = grid->GetNumberOfCells();
-#define GET_POINTER(celldata, fieldname)                             \
-  vtkFloatArray::FastDownCast(celldata->GetAbstractArray(fieldname)) \
-      ->GetPointer(0)
-  rho_ = GET_POINTER(celldata, "rho");
-  prs_ = GET_POINTER(celldata, "prs");
-  tev_ = GET_POINTER(celldata, "tev");
-  xdt_ = GET_POINTER(celldata, "xdt");
-  ydt_ = GET_POINTER(celldata, "ydt");
-  zdt_ = GET_POINTER(celldata, "zdt");
-  snd_ = GET_POINTER(celldata, "snd");
-  grd_ = GET_POINTER(celldata, "grd");
-  mat_ = GET_POINTER(celldata, "mat");
-  v02_ = GET_POINTER(celldata, "v02");
-  v03_ = GET_POINTER(celldata, "v03");
-#undef GET_POINTER
-  i_ = 0;
-}
+// Cell data arrays written as columns, in schema order
+const char* const kColumns[] = {"rho", "prs", "tev", "xdt", "ydt", "zdt",
+                                "snd", "grd", "mat", "v02", "v03"};
 
 struct ParquetWriterOptions {
   ParquetWriterOptions() {}
+  ColumnCodecs codecs;
+  ColumnPrecision precision;
+  AutoCodec auto_codec;
+  PageIndex page_index;
+  OutputFormat format;
+  OutputStreamOptions stream;
 };
 
 class ParquetWriter {
  public:
   ParquetWriter(const ParquetWriterOptions& options,
-                std::shared_ptr<arrow::io::OutputStream> file);
-  void Append(Iterator* it);
+                std::shared_ptr<arrow::io::OutputStream> file,
+                std::shared_ptr<const arrow::KeyValueMetadata> kv);
+  // Append n rows given as one array per column of kColumns
+  void AppendColumns(const std::vector<float*>& columns, int64_t n);
   void Finish();
   ~ParquetWriter();
 
@@ -124,7 +89,7 @@ class ParquetWriter {
   // No copying allowed
   ParquetWriter(const ParquetWriter&);
   void operator=(const ParquetWriter& other);
-  parquet::StreamWriter* writer_;
+  RowWriter* writer_;
 };
 
 namespace {
@@ -169,22 +134,27 @@ std::shared_ptr<parquet::schema::GroupNode> GetSchema() {
 }
 }  // namespace
 
-ParquetWriter::ParquetWriter(const ParquetWriterOptions& options,
-                             std::shared_ptr<arrow::io::OutputStream> file) {
+ParquetWriter::ParquetWriter(
+    const ParquetWriterOptions& options,
+    std::shared_ptr<arrow::io::OutputStream> file,
+    std::shared_ptr<const arrow::KeyValueMetadata> kv) {
   parquet::WriterProperties::Builder builder;
   builder.compression(parquet::Compression::ZSTD);
   // builder.disable_dictionary();
-  writer_ = new parquet::StreamWriter(parquet::ParquetFileWriter::Open(
-      std::move(file), GetSchema(), builder.build()));
+  options.codecs.Apply({std::begin(kColumns), std::end(kColumns)}, &builder);
+  options.page_index.Apply(&builder);
+  writer_ = OpenRowWriter(options.format, std::move(file), GetSchema(),
+                          builder.build(), std::move(kv))
+                .release();
 }
 
-void ParquetWriter::Append(Iterator* it) {
-  *writer_ << it->rho() << it->prs() << it->tev() << it->xdt() << it->ydt()
-           << it->zdt() << it->snd() << it->grd() << it->mat() << it->v02()
-           << it->v03() << parquet::EndRow;
+void ParquetWriter::AppendColumns(const std::vector<float*>& columns,
+                                  int64_t n) {
+  writer_->WriteRows({columns.begin(), columns.end()}, n);
 }
 
 void ParquetWriter::Finish() {
+  writer_->Close();
   delete writer_;
   writer_ = NULL;
 }
@@ -202,30 +172,88 @@ inline bool StringEndWith(const std::string& str, const char* suffix) {
   return std::strncmp(&str[0] + lenstr - lensuffix, suffix, lensuffix) == 0;
 }
 
-void Rewrite(const std::string& from, const std::string& to) {
+struct RewriteOptions {
+  RewriteOptions() : jobs(1), threads(0) {}
+  // Read ahead upcoming input files while converting
+  xrage::PrefetchOptions prefetch;
+  // Number of files converted at once
+  int jobs;
+  // Number of workers shared by the files and their columns. 0 means one
+  // per hardware thread.
+  int threads;
+  xrage::ParquetWriterOptions writer;
+};
+
+void Rewrite(const RewriteOptions& options, xrage::TaskScheduler* scheduler,
+             const std::string& from, const std::string& to) {
   printf("Rewriting %s to parquet... \n", from.c_str());
+  const double cached = xrage::CachedFraction(from);
+  if (cached >= 0) {
+    printf("Input is %.1f%% in the page cache\n", 100 * cached);
+  }
   vtkNew<vtkXMLUnstructuredGridReader> reader;
   reader->SetFileName(from.c_str());
   reader->Update();
   vtkUnstructuredGrid* grid = reader->GetOutput();
-  std::shared_ptr<arrow::io::FileOutputStream> file;
-  PARQUET_ASSIGN_OR_THROW(file, arrow::io::FileOutputStream::Open(to))
-  xrage::ParquetWriter writer(xrage::ParquetWriterOptions(), file);
-  xrage::Iterator it(grid);
-  it.SeekToFirst();
-  while (it.Valid()) {
-    writer.Append(&it);
-    it.Next();
+  vtkCellData* const celldata = grid->GetCellData();
+  xrage::ParquetWriterOptions writer_options = options.writer;
+  std::shared_ptr<arrow::KeyValueMetadata> kv =
+      std::make_shared<arrow::KeyValueMetadata>();
+  options.writer.precision.AddMetadata(
+      {std::begin(xrage::kColumns), std::end(xrage::kColumns)}, kv.get());
+  // Every column is one task, which grooms its values one slab per task
+  const size_t ncolumns = std::size(xrage::kColumns);
+  std::vector<float*> values(ncolumns);
+  std::vector<int64_t> sizes(ncolumns);
+  for (size_t c = 0; c < ncolumns; c++) {
+    vtkFloatArray* const array = vtkFloatArray::FastDownCast(
+        celldata->GetAbstractArray(xrage::kColumns[c]));
+    values[c] = array->GetPointer(0);
+    sizes[c] = array->GetNumberOfValues();
+  }
+  xrage::ParallelFor(scheduler, ncolumns, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t c = begin; c < end; c++) {
+      float* const v = values[c];
+      xrage::ParallelFor(scheduler, sizes[c], xrage::kSlabValues,
+                         [&](int64_t b, int64_t e) {
+                           options.writer.precision.Groom(xrage::kColumns[c],
+                                                          v + b, e - b);
+                         });
+    }
+  });
+  // Codecs are measured one column at a time so that their timings are
+  // comparable
+  if (options.writer.auto_codec.enabled) {
+    std::vector<float> sample;
+    for (size_t c = 0; c < ncolumns; c++) {
+      const char* const name = xrage::kColumns[c];
+      xrage::SampleValues(values[c], sizes[c], &sample);
+      const char* const codec = xrage::AutoSelectCodec(
+          options.writer.auto_codec, name, sample, &writer_options.codecs);
+      if (codec) {
+        kv->Append(std::string(name) + "_codec", codec);
+      }
+    }
   }
+  std::shared_ptr<xrage::AsyncOutputStream> file;
+  PARQUET_ASSIGN_OR_THROW(
+      file, xrage::AsyncOutputStream::Open(to, writer_options.stream))
+  xrage::ParquetWriter writer(writer_options, file,
+                              kv->size() > 0 ? kv : nullptr);
+  writer.AppendColumns(values, grid->GetNumberOfCells());
   writer.Finish();
+  PARQUET_THROW_NOT_OK(file->Close());
+  printf("%s\n", file->Summary().c_str());
 }
 
-void ProcessDir(const char* indir, const char* outdir) {
+void ProcessDir(const RewriteOptions& options, const char* indir,
+                const char* outdir) {
   DIR* const dir = opendir(indir);
   if (!dir) {
     fprintf(stderr, "Fail to open dir %s: %s\n", indir, strerror(errno));
     exit(EXIT_FAILURE);
   }
+  std::vector<xrage::WorkItem> items;
   std::string tmp1 = indir;
   size_t base1 = tmp1.size();
   std::string tmp2 = outdir;
@@ -241,21 +269,162 @@ void ProcessDir(const char* indir, const char* outdir) {
         tmp2.resize(base2);
         tmp2 += '/';
         tmp2 += f.substr(0, f.size() - 4);
-        tmp2 += ".parquet";
-        Rewrite(tmp1, tmp2);
+        tmp2 += options.writer.format.extension();
+        xrage::WorkItem item;
+        item.from = tmp1;
+        item.to = tmp2;
+        items.push_back(item);
       }
     }
     entry = readdir(dir);
   }
   closedir(dir);
+  xrage::PlanWorkItems(&items, options.jobs);
+  xrage::Prefetcher prefetcher(options.prefetch, xrage::WorkInputs(items));
+  xrage::WorkProgress progress(items);
+  xrage::TaskScheduler scheduler(options.threads);
+  xrage::RunWorkItems(&scheduler, items, options.jobs, [&](size_t i) {
+    prefetcher.Start(i);
+    Rewrite(options, &scheduler, items[i].from, items[i].to);
+    progress.Done(items[i]);
+  });
+  printf("%s\n", scheduler.Summary().c_str());
   printf("Done!\n");
 }
 
+void Usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] inputdir <outputdir>\n"
+          "  -e, --encoding [column=]plain|byte_stream_split\n"
+          "      encoding of value columns\n"
+          "  -z, --compression [column=]codec\n"
+          "      compression of value columns: uncompressed, snappy,\n"
+          "      zstd[:level], lz4 or gzip[:level]\n"
+          "  -A, --auto-codec size|speed|within:pct\n"
+          "      pick the encoding and compression of value columns without\n"
+          "      -e/-z settings, their own or for all columns, by sampling\n"
+          "  -k, --keep-bits [column=]n\n"
+          "      keep n mantissa bits of value columns\n"
+          "  -P, --page-index\n"
+          "      write column and offset indexes with the min/max of every\n"
+          "      data page\n"
+          "  -S, --page-size bytes\n"
+          "      target data page size\n"
+          "  -f, --format parquet|arrow[:lz4|:zstd]\n"
+          "      output file format\n"
+          "  -D, --direct\n"
+          "      write output with O_DIRECT, bypassing the page cache\n"
+          "  -F, --prefetch n\n"
+          "      read ahead the next n input files while converting (default\n"
+          "      2, 0 disables)\n"
+          "  -M, --prefetch-budget MiB\n"
+          "      most prefetched input not converted yet (default 1024)\n"
+          "  -J, --jobs n\n"
+          "      convert up to n files at once, largest first (default 1)\n"
+          "  -j, --threads n\n"
+          "      worker threads shared by files and their columns (default:\n"
+          "      one per core)\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
 int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s inputdir <outputdir>", argv[0]);
+  static const struct option kLongOpts[] = {
+      {"encoding", required_argument, nullptr, 'e'},
+      {"compression", required_argument, nullptr, 'z'},
+      {"auto-codec", required_argument, nullptr, 'A'},
+      {"keep-bits", required_argument, nullptr, 'k'},
+      {"page-index", no_argument, nullptr, 'P'},
+      {"page-size", required_argument, nullptr, 'S'},
+      {"format", required_argument, nullptr, 'f'},
+      {"direct", no_argument, nullptr, 'D'},
+      {"prefetch", required_argument, nullptr, 'F'},
+      {"prefetch-budget", required_argument, nullptr, 'M'},
+      {"jobs", required_argument, nullptr, 'J'},
+      {"threads", required_argument, nullptr, 'j'},
+      {nullptr, 0, nullptr, 0}};
+  static const char kShortOpts[] = "e:z:A:k:PS:f:DF:M:J:j:";
+  RewriteOptions options;
+  int c;
+  while ((c = getopt_long(argc, argv, kShortOpts, kLongOpts, nullptr)) != -1) {
+    switch (c) {
+      case 'e':
+        if (!options.writer.codecs.ParseEncoding(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'z':
+        if (!options.writer.codecs.ParseCompression(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'A':
+        if (!options.writer.auto_codec.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'k':
+        if (!options.writer.precision.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'P':
+        options.writer.page_index.enabled = true;
+        break;
+      case 'S':
+        if (!options.writer.page_index.ParsePageSize(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'f':
+        if (!options.writer.format.Parse(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'D':
+        options.writer.stream.direct = true;
+        break;
+      case 'F':
+        options.prefetch.files = atoi(optarg);
+        if (options.prefetch.files < 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'M':
+        if (!options.prefetch.ParseBudget(optarg)) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'J':
+        options.jobs = atoi(optarg);
+        if (options.jobs <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      case 'j':
+        options.threads = atoi(optarg);
+        if (options.threads <= 0) {
+          Usage(argv[0]);
+        }
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    Usage(argv[0]);
+  }
+  xrage::CheckColumns({std::begin(xrage::kColumns), std::end(xrage::kColumns)},
+                      options.writer.codecs, options.writer.precision);
+  if (options.writer.format.ipc &&
+      (!options.writer.codecs.empty() || options.writer.auto_codec.enabled ||
+       options.writer.page_index.enabled ||
+       options.writer.page_index.page_size > 0)) {
+    fprintf(stderr,
+            "The arrow format cannot be combined with --encoding, "
+            "--compression, --auto-codec, --page-index or --page-size\n");
     exit(EXIT_FAILURE);
   }
-  ProcessDir(argv[1], argc > 2 ? argv[2] : ".");
+  ProcessDir(options, argv[optind], optind + 1 < argc ? argv[optind + 1] : ".");
   return 0;
 }
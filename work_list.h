@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "scheduler.h"
+#include "timing.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace xrage {
+
+// An input file of a converter and the output it is converted to
+struct WorkItem {
+  WorkItem() : timestep(0), bytes(-1) {}
+  std::string from;
+  std::string to;
+  int timestep;
+  int64_t bytes;  // Size of the input, -1 if unknown
+};
+
+// Run fn(i) for every item as tasks of scheduler, with up to jobs items in
+// flight. Items start in list order; each finished item spawns the next
+// one. Workers not busy with an item steal the slab tasks that items spawn
+// on the same scheduler. Conversion errors are fatal.
+template <typename Fn>
+void RunWorkItems(TaskScheduler* scheduler, const std::vector<WorkItem>& items,
+                  int jobs, Fn fn) {
+  const size_t n = items.size();
+  std::atomic<size_t> next(0);
+  TaskGroup group;
+  // Items are claimed before their task is spawned, so that every task
+  // converts one
+  std::function<void(size_t)> work;
+  auto spawn_next = [&]() {
+    const size_t i = next.fetch_add(1);
+    if (i < n) {
+      scheduler->Spawn(&group, [&work, i]() { work(i); });
+    }
+  };
+  work = [&](size_t i) {
+    try {
+      fn(i);
+    } catch (const std::exception& e) {
+      fprintf(stderr, "Fail to convert %s: %s\n", items[i].from.c_str(),
+              e.what());
+      exit(EXIT_FAILURE);
+    }
+    spawn_next();
+  };
+  for (int j = 0; j < std::max(1, jobs); j++) {
+    spawn_next();
+  }
+  scheduler->Wait(&group);
+}
+
+// Input bytes per second a converter is assumed to process one file at,
+// for the estimate made before any file has finished
+constexpr double kAssumedWorkRate = 100e6;
+
+// Stat the inputs of all items and order them largest first, so that a big
+// timestep doesn't start last and keep one worker busy long after the
+// others went idle. The stat calls are spread over a few threads because
+// they are slow one at a time on a parallel file system. Prints the plan
+// with an estimate of the total time for jobs files in flight.
+inline void PlanWorkItems(std::vector<WorkItem>* items, int jobs) {
+  const int n = int(items->size());
+  const int threads = std::max(1, std::min(16, n));
+  std::atomic<int> next(0);
+  auto work = [&]() {
+    int i;
+    while ((i = next.fetch_add(1)) < n) {
+      struct stat st;
+      WorkItem& item = (*items)[i];
+      item.bytes = stat(item.from.c_str(), &st) == 0 ? st.st_size : -1;
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; t++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (std::thread& t : workers) {
+    t.join();
+  }
+  std::stable_sort(items->begin(), items->end(),
+                   [](const WorkItem& a, const WorkItem& b) {
+                     return a.bytes > b.bytes;
+                   });
+  int64_t total = 0;
+  for (const WorkItem& item : *items) {
+    total += std::max<int64_t>(item.bytes, 0);
+  }
+  printf("Planned %d files, %.1f MB in total", n, total * 1e-6);
+  if (n > 0) {
+    printf(", %.1f to %.1f MB each",
+           std::max<int64_t>(items->back().bytes, 0) * 1e-6,
+           std::max<int64_t>(items->front().bytes, 0) * 1e-6);
+  }
+  printf("\n");
+  // Nothing is measured yet, so assume a typical per-file rate. Files go to
+  // whichever job frees up first, so the run takes as long as the busiest
+  // job. WorkProgress replaces this with the measured rate.
+  std::vector<int64_t> lanes(std::max(1, std::min(jobs, std::max(n, 1))), 0);
+  for (const WorkItem& item : *items) {
+    *std::min_element(lanes.begin(), lanes.end()) +=
+        std::max<int64_t>(item.bytes, 0);
+  }
+  const int64_t busiest = *std::max_element(lanes.begin(), lanes.end());
+  printf("Estimated %.1f s at an assumed %.0f MB/s per file\n",
+         busiest / kAssumedWorkRate, kAssumedWorkRate * 1e-6);
+}
+
+// The inputs of a work list, in order
+inline std::vector<std::string> WorkInputs(const std::vector<WorkItem>& items) {
+  std::vector<std::string> inputs;
+  for (const WorkItem& item : items) {
+    inputs.push_back(item.from);
+  }
+  return inputs;
+}
+
+// Tracks finished work items and estimates the time left from the input
+// throughput measured so far
+class WorkProgress {
+ public:
+  explicit WorkProgress(const std::vector<WorkItem>& items)
+      : files_(items.size()),
+        done_files_(0),
+        total_(0),
+        done_(0),
+        start_(NowSeconds()) {
+    for (const WorkItem& item : items) {
+      total_ += std::max<int64_t>(item.bytes, 0);
+    }
+  }
+
+  // Note that item finished and print the estimate. Thread-safe.
+  void Done(const WorkItem& item) {
+    std::lock_guard<std::mutex> lock(mu_);
+    done_files_++;
+    done_ += std::max<int64_t>(item.bytes, 0);
+    const double elapsed = NowSeconds() - start_;
+    const double rate = elapsed > 0 ? done_ / elapsed : 0;
+    printf("Finished %zu/%zu files (%.1f/%.1f MB) in %.1f s", done_files_,
+           files_, done_ * 1e-6, total_ * 1e-6, elapsed);
+    if (rate > 0) {
+      printf(", %.1f MB/s, about %.1f s left", rate * 1e-6,
+             (total_ - done_) / rate);
+    }
+    printf("\n");
+  }
+
+ private:
+  std::mutex mu_;
+  const size_t files_;
+  size_t done_files_;
+  int64_t total_;
+  int64_t done_;
+  const double start_;
+};
+
+}  // namespace xrage
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2024 Triad National Security, LLC, as operator of Los Alamos
+ * National Laboratory with the U.S. Department of Energy/National Nuclear
+ * Security Administration. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of TRIAD, Los Alamos National Laboratory, LANL, the
+ *    U.S. Government, nor the names of its contributors may be used to endorse
+ *    or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <parquet/exception.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <zdict.h>
+#include <zstd.h>
+#include <string>
+#include <vector>
+
+namespace xrage {
+
+// A ZSTD dictionary trained on page-sized chunks of converted value
+// columns, with the digested forms used to compress and decompress pages.
+// Parquet pages cannot reference an external dictionary, so this is only used
+// to evaluate dictionary compression of small pages outside of parquet (see
+// pqtzdict).
+class ZstdDictionary {
+ public:
+  ZstdDictionary() : cdict_(nullptr), ddict_(nullptr) {}
+  ~ZstdDictionary() { Reset(); }
+
+  // Train a dictionary of at most capacity bytes from samples, the
+  // concatenation of chunks of the given sizes. Throws
+  // parquet::ParquetException on errors.
+  void Train(const std::string& samples, const std::vector<size_t>& sizes,
+             size_t capacity, int level) {
+    std::string dict(capacity, '\0');
+    const size_t n =
+        ZDICT_trainFromBuffer(&dict[0], capacity, samples.data(), sizes.data(),
+                              unsigned(sizes.size()));
+    if (ZDICT_isError(n)) {
+      throw parquet::ParquetException("Fail to train dictionary: ",
+                                      ZDICT_getErrorName(n));
+    }
+    dict.resize(n);
+    Init(dict, level);
+  }
+
+  // Write the raw dictionary, which zstd -D accepts. Throws
+  // parquet::ParquetException on errors.
+  void Save(const std::string& path) const {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+      throw parquet::ParquetException("Fail to open dictionary ", path, ": ",
+                                      strerror(errno));
+    }
+    const bool written = fwrite(dict_.data(), 1, dict_.size(), f) ==
+                         dict_.size();
+    const int err = errno;
+    if (fclose(f) != 0 || !written) {
+      throw parquet::ParquetException("Fail to write dictionary ", path, ": ",
+                                      strerror(written ? errno : err));
+    }
+  }
+
+  size_t size() const { return dict_.size(); }
+  const ZSTD_CDict* cdict() const { return cdict_; }
+  const ZSTD_DDict* ddict() const { return ddict_; }
+
+ private:
+  // No copying allowed
+  ZstdDictionary(const ZstdDictionary&);
+  void operator=(const ZstdDictionary& other);
+
+  void Init(const std::string& dict, int level) {
+    Reset();
+    dict_ = dict;
+    cdict_ = ZSTD_createCDict(dict_.data(), dict_.size(), level);
+    ddict_ = ZSTD_createDDict(dict_.data(), dict_.size());
+    if (!cdict_ || !ddict_) {
+      throw parquet::ParquetException("Fail to digest dictionary");
+    }
+  }
+
+  void Reset() {
+    ZSTD_freeCDict(cdict_);
+    ZSTD_freeDDict(ddict_);
+    cdict_ = nullptr;
+    ddict_ = nullptr;
+  }
+
+  std::string dict_;
+  ZSTD_CDict* cdict_;
+  ZSTD_DDict* ddict_;
+};
+
+}  // namespace xrage